@@ -0,0 +1,31 @@
+# check_ram.py - Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+#
+# Fails a Nano build whose .data and .bss leave less than the stack reserve of
+# its SRAM. PlatformIO's own size check only warns once the statics alone are
+# over. Kept with MemoryBudget::Sram and MemoryBudget::Stack in src/memory.h.
+
+import subprocess
+import sys
+
+Import("env")
+
+SRAM = 2048
+STACK = 256
+
+
+def check_ram(target, source, env):
+    sizes = subprocess.check_output([env.subst("$SIZETOOL"), "-A", str(target[0])]).decode()
+    used = 0
+    for line in sizes.splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[0] in (".data", ".bss", ".noinit"):
+            used += int(fields[1])
+
+    print("SRAM: %d bytes static, %d of %d left for the stack" % (used, SRAM - used, SRAM))
+    if used + STACK > SRAM:
+        sys.stderr.write("Error: the statics leave less than the %d byte stack reserve\n" % STACK)
+        return 1
+    return 0
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", check_ram)
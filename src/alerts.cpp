@@ -0,0 +1,289 @@
+/*------------------------------------------------------------------------------
+    ()      File: alerts.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Table driven alerts over temperature, air quality and the door.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include "alerts.h"
+#include "hal.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        //------------------------------------------------------------------------------
+        // In priority order. Air quality is permille of a Good reading, so 127 is
+        // VOCTable's Bad and 63 its Awful. Kept in flash, a rule is copied out to
+        // be read.
+        //------------------------------------------------------------------------------
+        constexpr AlertEngine::Rule RULES[] PROGMEM =
+        {
+                //signal                           level                          enter  exit  dwell  clear  text
+                { AlertEngine::Signal_Temperature, AlertEngine::Level_Critical,   450,   430,  10,    60,    "HOT" },
+                { AlertEngine::Signal_AirQuality,  AlertEngine::Level_Critical,   63,    80,   30,    120,   "AIR" },
+                { AlertEngine::Signal_Temperature, AlertEngine::Level_Warning,    380,   360,  30,    120,   "Hot" },
+                { AlertEngine::Signal_AirQuality,  AlertEngine::Level_Warning,    127,   150,  60,    120,   "Air" },
+                { AlertEngine::Signal_Door,        AlertEngine::Level_Warning,    1,     0,    300,   0,     "Opn" },
+                { AlertEngine::Signal_Temperature, AlertEngine::Level_Notice,     100,   120,  60,    60,    "Cld" },
+        };
+        const uint8_t RULE_COUNT = sizeof(RULES) / sizeof(RULES[0]);
+
+        //a rule whose enter and exit meet has no band to hold it.
+        constexpr bool banded( const AlertEngine::Rule * rules, uint8_t count )
+        {
+                return count == 0 || ( rules[0].enter != rules[0].exit && banded(rules + 1, count - 1) );
+        }
+
+        static_assert( banded(RULES, RULE_COUNT), "alert rule without hysteresis" );
+
+        AlertEngine::Signal signalOf( uint8_t index )
+        {
+                return (AlertEngine::Signal)pgm_read_byte( &RULES[index].signal );
+        }
+
+        bool rising( const AlertEngine::Rule & rule )
+        {
+                return rule.enter > rule.exit;
+        }
+
+        bool pastEnter( const AlertEngine::Rule & rule, int16_t value )
+        {
+                return rising(rule) ? value >= rule.enter : value <= rule.enter;
+        }
+
+        bool pastExit( const AlertEngine::Rule & rule, int16_t value )
+        {
+                return rising(rule) ? value <= rule.exit : value >= rule.exit;
+        }
+
+        bool due( unsigned long deadline, unsigned long now )
+        {
+                return (long)(now - deadline) >= 0;
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint8_t AlertEngine::ruleCount()
+{
+        return RULE_COUNT;
+}
+
+AlertEngine::Rule AlertEngine::rule( uint8_t index )
+{
+        Rule rule;
+        memcpy_P( &rule, &RULES[index], sizeof(rule) );
+        return rule;
+}
+
+//------------------------------------------------------------------------------
+// The bands start empty, so the first value of each signal is evaluated.
+//------------------------------------------------------------------------------
+AlertEngine::AlertEngine()
+{
+        static_assert( RULE_COUNT <= MaxRules, "too many alert rules" );
+        for( uint8_t i=0; i<RULE_COUNT; i++ )
+        {
+                m_states[i] = Clear;
+                m_due[i] = 0;
+        }
+        for( uint8_t signal=0; signal<MAX_SIGNAL; signal++ )
+        {
+                m_quietLow[signal] = INT16_MAX;
+                m_quietHigh[signal] = INT16_MIN;
+                m_values[signal] = 0;
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool AlertEngine::update( Signal signal, int16_t value, unsigned long now )
+{
+        m_updates++;
+        m_values[signal] = value;
+        if( value > m_quietLow[signal] && value < m_quietHigh[signal] )
+        {
+                return false;
+        }
+
+        HAL_PROBE("alerts");
+        m_crossings++;
+        for( uint8_t i=0; i<RULE_COUNT; i++ )
+        {
+                if( signalOf(i) == signal )
+                {
+                        evaluate( i, value, now );
+                }
+        }
+        rebuildBand( signal );
+        return choose();
+}
+
+//------------------------------------------------------------------------------
+// A dwell or clear that ran its course. The value cannot have crossed back,
+// the update doing so would have cancelled it.
+//------------------------------------------------------------------------------
+bool AlertEngine::service( unsigned long now )
+{
+        bool finished[MAX_SIGNAL] = {};
+        for( uint8_t i=0; i<RULE_COUNT; i++ )
+        {
+                if( (m_states[i] == Raising || m_states[i] == Clearing) && due(m_due[i], now) )
+                {
+                        m_states[i] = m_states[i] == Raising ? Raised : Clear;
+                        finished[signalOf(i)] = true;
+                }
+        }
+
+        for( uint8_t signal=0; signal<MAX_SIGNAL; signal++ )
+        {
+                if( finished[signal] )
+                {
+                        rebuildBand( (Signal)signal );
+                }
+        }
+        return choose();
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+unsigned long AlertEngine::nextDeadline( unsigned long now ) const
+{
+        unsigned long next = Scheduler::NoDeadline;
+        for( uint8_t i=0; i<RULE_COUNT; i++ )
+        {
+                if( m_states[i] == Raising || m_states[i] == Clearing )
+                {
+                        next = Min( next, due(m_due[i], now) ? 0UL : m_due[i] - now );
+                }
+        }
+        return next;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+AlertEngine::Level AlertEngine::level() const
+{
+        return m_current == NoRule ? Level_None : (Level)pgm_read_byte( &RULES[m_current].level );
+}
+
+const char * AlertEngine::text() const
+{
+        return m_current == NoRule ? PSTR("") : RULES[m_current].text;
+}
+
+//------------------------------------------------------------------------------
+// A dwell is cancelled only once the value is back past exit, and a clear only
+// once it is past enter again, the band between holds either way.
+//------------------------------------------------------------------------------
+void AlertEngine::evaluate( uint8_t index, int16_t value, unsigned long now )
+{
+        const Rule rule = AlertEngine::rule( index );
+        State & state = m_states[index];
+        switch( state )
+        {
+        case Clear:
+                if( pastEnter(rule, value) )
+                {
+                        state = rule.dwellSeconds == 0 ? Raised : Raising;
+                        m_due[index] = now + rule.dwellSeconds * 1000UL;
+                }
+                break;
+        case Raising:
+                if( pastExit(rule, value) )
+                {
+                        state = Clear;
+                }
+                break;
+        case Raised:
+                if( pastExit(rule, value) )
+                {
+                        state = rule.clearSeconds == 0 ? Clear : Clearing;
+                        m_due[index] = now + rule.clearSeconds * 1000UL;
+                }
+                break;
+        case Clearing:
+                if( pastEnter(rule, value) )
+                {
+                        state = Raised;
+                }
+                break;
+        }
+}
+
+//------------------------------------------------------------------------------
+// Clear and clearing rules wait on enter, raising and raised ones on exit.
+//------------------------------------------------------------------------------
+void AlertEngine::rebuildBand( Signal signal )
+{
+        int16_t low = INT16_MIN;
+        int16_t high = INT16_MAX;
+        for( uint8_t i=0; i<RULE_COUNT; i++ )
+        {
+                if( signalOf(i) != signal )
+                {
+                        continue;
+                }
+
+                const Rule rule = AlertEngine::rule( i );
+                const bool waitingToRaise = m_states[i] == Clear || m_states[i] == Clearing;
+                const int16_t threshold = waitingToRaise ? rule.enter : rule.exit;
+                if( rising(rule) == waitingToRaise )
+                {
+                        high = Min( high, threshold );
+                }
+                else
+                {
+                        low = Max( low, threshold );
+                }
+        }
+        m_quietLow[signal] = low;
+        m_quietHigh[signal] = high;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool AlertEngine::choose()
+{
+        uint8_t chosen = NoRule;
+        for( uint8_t i=0; i<RULE_COUNT && chosen == NoRule; i++ )
+        {
+                if( m_states[i] == Raised || m_states[i] == Clearing )
+                {
+                        chosen = i;
+                }
+        }
+
+        if( chosen == m_current )
+        {
+                return false;
+        }
+        m_current = chosen;
+        m_changes++;
+        return true;
+}
@@ -0,0 +1,113 @@
+/*------------------------------------------------------------------------------
+    ()      File: alerts.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Table driven alerts over temperature, air quality and the door,
+              with hysteresis, dwell times and priorities.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include "utility.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Each rule watches one signal. It is raised once the signal has stayed past
+// enter for dwellSeconds, and cleared once it has stayed back past exit for
+// clearSeconds; between the two nothing changes, so a reading sat on a
+// threshold cannot flap. Whether a rule fires on high or low values follows
+// from which side of exit its enter is.
+//
+// Rules are listed in priority order and the first one raised is the alert
+// shown. The door is fed as 0 shut and 1 open, its rule's dwell is how long
+// it may be left open.
+//
+// Evaluation is incremental: each signal keeps the band of values within
+// which none of its rules can change state, derived from their states, so an
+// update inside it is a pair of compares. Only a crossing walks the rules.
+//------------------------------------------------------------------------------
+class AlertEngine
+{
+public:
+    enum Signal : uint8_t { Signal_Temperature, Signal_AirQuality, Signal_Door, MAX_SIGNAL };
+    enum Level : uint8_t { Level_None, Level_Notice, Level_Warning, Level_Critical };
+
+    struct Rule
+    {
+        Signal signal;
+        Level level;
+        int16_t enter;                  //deci *C, permille, or door open.
+        int16_t exit;
+        uint16_t dwellSeconds;
+        uint16_t clearSeconds;
+        char text[4];
+    };
+
+    static const uint8_t NoRule = 0xFF;
+
+    static uint8_t ruleCount();
+    static Rule rule( uint8_t index );
+
+    AlertEngine();
+
+    // Each returns true when the alert shown changed.
+    bool update( Signal signal, int16_t value, unsigned long now );
+    bool service( unsigned long now );
+
+    // Milliseconds until service() has a dwell or clear to finish.
+    unsigned long nextDeadline( unsigned long now ) const;
+
+    uint8_t current() const { return m_current; }
+    Level level() const;
+    const char * text() const;              //in flash.
+
+    unsigned long updates() const { return m_updates; }
+    unsigned long crossings() const { return m_crossings; }
+    unsigned long changes() const { return m_changes; }
+
+private:
+    enum State : uint8_t { Clear, Raising, Raised, Clearing };
+
+    static const uint8_t MaxRules = 6;
+
+    void evaluate( uint8_t index, int16_t value, unsigned long now );
+    void rebuildBand( Signal signal );
+    bool choose();
+
+    State m_states[MaxRules];
+    unsigned long m_due[MaxRules];
+
+    //values strictly between these leave every rule of the signal as it is.
+    int16_t m_quietLow[MAX_SIGNAL];
+    int16_t m_quietHigh[MAX_SIGNAL];
+    int16_t m_values[MAX_SIGNAL];
+
+    uint8_t m_current = NoRule;
+    unsigned long m_updates = 0;
+    unsigned long m_crossings = 0;
+    unsigned long m_changes = 0;
+};
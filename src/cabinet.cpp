@@ -0,0 +1,1169 @@
+/*------------------------------------------------------------------------------
+    ()      File: cabinet.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Printer enclosure sensor suite.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <string.h>
+#include <stddef.h>
+#include "cabinet.h"
+#include "memory.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+constexpr DisplayField TempAndVocLayout::fields[];
+
+namespace
+{
+        const unsigned long SENSOR_REFRESH_MS = 1000;
+        const unsigned long SENSOR_REFRESH_MIN_MS = 250;
+
+        const unsigned long IDLE_WINDOW_US = 10000000;
+
+        //with the door events between, a summary a quarter hour reopens each
+        //EEPROM page a few times a day: decades of endurance.
+        const unsigned long SUMMARY_PERIOD_MS = 900000;
+
+        const Rgb DOOR_OPEN_COLOUR = {255,255,255};
+        const Rgb DOOR_CLOSED_COLOUR = {255,0,0};
+
+        const Cabinet::Settings DEFAULT_SETTINGS PROGMEM =
+        {
+                SENSOR_REFRESH_MS, 255, DOOR_OPEN_COLOUR, DOOR_CLOSED_COLOUR,
+                320, 150,       //heater *C for ms.
+                Hal::LedStrip::Count
+        };
+
+        Cabinet::Settings defaultSettings()
+        {
+                Cabinet::Settings settings;
+                memcpy_P( &settings, &DEFAULT_SETTINGS, sizeof(settings) );
+                return settings;
+        }
+
+        static_assert( sizeof(Cabinet::Settings) <= Journal::MaxPayload, "settings must fit one journal record" );
+
+        //static footprint, see MemoryBudget. Objects are only held to their
+        //budgets as the Nano lays them out.
+        static_assert( Hal::LedStrip::Count * MemoryBudget::PixelBytes <= MemoryBudget::LedPixels, "LEDCOUNT is over the strip's SRAM budget" );
+        static_assert( TempAndVocLayout::Height * (2 * TempAndVocLayout::Width + 1) <= MemoryBudget::Panel, "the panel is over its SRAM budget" );
+#if defined(IS_NANO_BUILD)
+        static_assert( sizeof(SensorHistory) <= MemoryBudget::History, "SensorHistory is over its SRAM budget" );
+        static_assert( sizeof(Scheduler) <= MemoryBudget::Scheduler, "Scheduler is over its SRAM budget" );
+        static_assert( sizeof(I2CQueue) <= MemoryBudget::BusQueue, "I2CQueue is over its SRAM budget" );
+        static_assert( sizeof(LedEffects) <= MemoryBudget::Effects, "LedEffects is over its SRAM budget" );
+        static_assert( sizeof(Console) <= MemoryBudget::Console, "Console is over its SRAM budget" );
+        static_assert( sizeof(Journal) <= MemoryBudget::Journal, "Journal is over its SRAM budget" );
+        static_assert( sizeof(AlertEngine) <= MemoryBudget::Alerts, "AlertEngine is over its SRAM budget" );
+        static_assert( sizeof(LcdWriter) <= MemoryBudget::LcdWriter, "LcdWriter is over its SRAM budget" );
+        static_assert( sizeof(DoorMonitor) <= MemoryBudget::Door, "DoorMonitor is over its SRAM budget" );
+        static_assert( sizeof(TelemetryStream) <= MemoryBudget::Telemetry, "TelemetryStream is over its SRAM budget" );
+        static_assert( sizeof(AdaptiveSampler) <= MemoryBudget::Sampler, "AdaptiveSampler is over its SRAM budget" );
+        static_assert( sizeof(Cabinet::Devices) <= MemoryBudget::Devices, "Cabinet::Devices is over its SRAM budget" );
+        static_assert( Cabinet::MaxSensors <= MemoryBudget::GasSensors, "more gas sensors than the SRAM budget allows" );
+#endif //defined(IS_NANO_BUILD)
+
+        //console commands, by index into the table.
+        enum ConsoleCommand : uint8_t
+        {
+                Command_Stats,
+                Command_Display,
+                Command_Profile,
+                Command_Get,
+                Command_Set,
+                Command_Save,
+                Command_Default,
+                Command_Test,
+                Command_Memory,
+                Command_Count
+        };
+
+        const Console::Command CONSOLE_COMMANDS[Command_Count] PROGMEM =
+        {
+                { "stats",   "readings and counters" },
+                { "display", "the panel buffer" },
+                { "profile", "job timings" },
+                { "get",     "settings, as set takes" },
+                { "set",     "<setting> <value>.." },
+                { "save",    "keep settings" },
+                { "default", "built-in settings" },
+                { "test",    "LED test pattern" },
+                { "memory",  "SRAM and stack use" },
+        };
+
+        //how each alert level shows on the strip, critical blinks it dark.
+        struct AlertPulse
+        {
+                Rgb colour;
+                uint16_t periodMs;
+        };
+
+        const AlertPulse ALERT_PULSES[] PROGMEM =
+        {
+                /* Level_None */        { {0,0,0},       0 },
+                /* Level_Notice */      { {0,0,255},     4000 },
+                /* Level_Warning */     { {255,160,0},   2000 },
+                /* Level_Critical */    { {0,0,0},       400 },
+        };
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+Cabinet::Cabinet( const Devices & devices )
+        : m_lcd( *devices.lcd )
+        , m_leds( *devices.leds )
+        , m_doorPin( devices.doorPin )
+        , m_lcdWriter( m_queue, devices.bus, LcdAddress )
+        , m_display( render, this )
+        , m_journal( *devices.storage )
+        , m_effects( *devices.leds )
+        , m_console( CONSOLE_COMMANDS, Command_Count, consoleCommand, this, m_telemetry )
+        , m_settings( defaultSettings() )
+{
+        for( uint8_t i=0; i<MaxSensors; i++ )
+        {
+                m_sensors[i].cabinet = this;
+                m_sensors[i].sensor = devices.gasSensors[i];
+        }
+}
+
+//------------------------------------------------------------------------------
+// The buses and serial port are begun by the owner beforehand.
+//------------------------------------------------------------------------------
+void Cabinet::begin()
+{
+        //persistent log, picking up where the last run left off.
+        m_journal.begin();
+        m_journal.replay( restore, this );
+
+        //oversampling and filter, starting in the fast profile.
+        const AdaptiveSampler::Profile profile = m_sampler.profile();
+        for( uint8_t i=0; i<MaxSensors; i++ )
+        {
+                Hal::GasSensor * sensor = m_sensors[i].sensor;
+                if( sensor == nullptr || !sensor->begin(sensorAddress(i), true) )
+                {
+                        m_sensors[i].sensor = nullptr;
+                        continue;
+                }
+                sensor->setTemperatureOversampling( profile.osTemperature );
+                sensor->setHumidityOversampling( profile.osHumidity );
+                sensor->setPressureOversampling( profile.osPressure );
+                sensor->setIIRFilterSize( BME680_FILTER_SIZE_3 );
+                sensor->setGasHeater( m_settings.heaterCelsius, m_settings.heaterMs );
+                m_sensorCount++;
+        }
+
+        //display
+        m_lcd.begin();
+        m_lcd.backlight();
+
+        //LEDS, white with the door open and red with it shut.
+        m_leds.begin();
+        m_effects.addSegment( 0, m_settings.ledCount, m_settings.openColour, m_settings.closedColour );
+        m_effects.setBrightness( m_settings.brightness );
+
+        const Records::Boot boot = { ++m_boots };
+        m_journal.append( Records::Type_Boot, &boot, sizeof(boot) );
+        m_journal.flush();
+
+        //tasks
+        const unsigned long now = Hal::millis();
+        m_sensorTask = m_scheduler.addPeriodic( sensorTask, this, m_settings.refreshMs, Priority_Sensor, now );
+        m_lightsTask = m_scheduler.addOneShot( lightsTask, this, Priority_Lights );
+        m_summaryTask = m_scheduler.addPeriodic( summaryTask, this, SUMMARY_PERIOD_MS, Priority_Summary, now );
+        m_alertTask = m_scheduler.addOneShot( alertTask, this, Priority_Alerts );
+        m_sampler.begin( m_settings.refreshMs, now );
+        m_historyMs = now;
+        m_idleWindowStart = Hal::micros();
+
+        //door, publishes its initial state on the first loop.
+        m_door.begin( m_doorPin );
+
+        //slave interface, serving the initial config until the first reading.
+        publishSettings();
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Cabinet::loop()
+{
+        HAL_PROBE("loop");
+        const unsigned long runtime = Hal::millis();
+        measureIdle();
+
+        if( m_door.poll(runtime) )
+        {
+                m_environmentInfo.doorOpen = m_door.open();
+                m_effects.setDoor( m_environmentInfo.doorOpen, runtime );
+                m_scheduler.runAfter( m_lightsTask, 0, runtime );
+                if( m_sampler.wake(runtime) )
+                {
+                        //the air is about to change, read it now rather than a slow period on.
+                        applySamplingProfile( runtime );
+                        m_scheduler.runAfter( m_sensorTask, 0, runtime );
+                }
+                feedAlerts( AlertEngine::Signal_Door, m_environmentInfo.doorOpen ? 1 : 0, runtime );
+                sendTelemetry();
+                publishRegisters();
+                recordDoor();
+        }
+
+        applySlaveConfig();
+
+        m_scheduler.run( runtime );
+
+        if( m_lcdWriter.lost() && m_lcdWriter.idle() )
+        {
+                m_lcdWriter.clearLost();
+                m_display.invalidate();
+                m_display.draw();
+        }
+        m_lcdWriter.pump();
+        m_queue.service();
+
+        m_console.service();
+        m_telemetry.pump();
+        m_journal.service();
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+unsigned long Cabinet::idleMillis( unsigned long now ) const
+{
+        if( !m_lcdWriter.idle() || !m_telemetry.idle() || !m_console.idle() || !m_queue.idle() )
+        {
+                return 0;
+        }
+
+        unsigned long next = m_scheduler.nextDeadline( now );
+        if( m_door.settling() )
+        {
+                next = Min( next, m_door.settleMillis(now) );
+        }
+        if( m_journal.busy() )
+        {
+                //the cell finishes its write on its own, look again shortly.
+                next = Min( next, m_journal.ready() ? 0UL : 1UL );
+        }
+        return next;
+}
+
+//------------------------------------------------------------------------------
+// A door edge, a master's write or serial input ends the sleep early, the
+// next loop() deals with it.
+//------------------------------------------------------------------------------
+bool Cabinet::sleep()
+{
+        const unsigned long idle = idleMillis( Hal::millis() );
+        if( idle == 0 )
+        {
+                return false;
+        }
+
+        const unsigned long begin = Hal::micros();
+        Hal::idle( idle );
+        m_idleMicros += Hal::micros() - begin;
+        return true;
+}
+
+//------------------------------------------------------------------------------
+// Closes the window once it is full, the figure covers the last whole window.
+//------------------------------------------------------------------------------
+void Cabinet::measureIdle()
+{
+        const unsigned long now = Hal::micros();
+        const unsigned long elapsed = now - m_idleWindowStart;
+        if( elapsed < IDLE_WINDOW_US )
+        {
+                return;
+        }
+        m_idlePermille = (uint16_t)Min<unsigned long>( m_idleMicros / (elapsed / 1000), 1000 );
+        m_idleMicros = 0;
+        m_idleWindowStart = now;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Cabinet::sensorTask( void * context )
+{
+        static_cast<Cabinet *>( context )->updateSensor();
+}
+
+void Cabinet::lightsTask( void * context )
+{
+        static_cast<Cabinet *>( context )->updateLights();
+}
+
+void Cabinet::summaryTask( void * context )
+{
+        static_cast<Cabinet *>( context )->recordSummary();
+}
+
+void Cabinet::alertTask( void * context )
+{
+        Cabinet & cabinet = *static_cast<Cabinet *>( context );
+        const unsigned long now = Hal::millis();
+        if( cabinet.m_alerts.service(now) )
+        {
+                cabinet.showAlert( now );
+        }
+        cabinet.armAlerts( now );
+}
+
+//------------------------------------------------------------------------------
+// Every conversion is started before any is collected, so the conversions
+// overlap and a cycle takes about as long as one sensor's. Only the
+// conversions do: the bus transactions that start and fetch them still run
+// one at a time. Each reading is fetched as its own conversion ends.
+//------------------------------------------------------------------------------
+void Cabinet::updateSensor()
+{
+        HAL_PROBE("updateSensor");
+
+        bool pending = false;
+        unsigned long wait = Scheduler::NoDeadline;
+        for( uint8_t i=0; i<MaxSensors; i++ )
+        {
+                SensorChannel & channel = m_sensors[i];
+                if( channel.sensor == nullptr || channel.collected )
+                {
+                        continue;
+                }
+                pending = true;
+
+                //the bus queue brings us forward once the transfer has run.
+                if( channel.transfer != I2CTransaction::Queued )
+                {
+                        const int readingTime = channel.sensor->remainingReadingMillis();
+                        I2CTransaction::Operation operation = nullptr;
+                        if( readingTime == Hal::GasSensor::reading_not_started )
+                        {
+                                if( !m_cycleStarted )
+                                {
+                                        m_cycleStarted = true;
+                                        m_cycleStart = Hal::micros();
+                                }
+                                operation = beginGasReading;
+                        }
+                        else if( readingTime > 0 )
+                        {
+                                wait = Min( wait, (unsigned long)readingTime );
+                        }
+                        else
+                        {
+                                operation = endGasReading;
+                        }
+
+                        if( operation != nullptr && !submitSensorOperation(channel, operation) )
+                        {
+                                wait = Min( wait, 1UL );   //queue full, try again shortly.
+                        }
+                }
+
+                if( !m_pipelined )
+                {
+                        break;
+                }
+        }
+
+        if( pending )
+        {
+                if( wait != Scheduler::NoDeadline )
+                {
+                        m_scheduler.continueAfter( wait );
+                }
+                return;
+        }
+
+        if( m_sensorCount != 0 )
+        {
+                collectReadings();
+        }
+}
+
+//------------------------------------------------------------------------------
+// The whole cycle is in, combine the sensors that answered. A cycle none of
+// them answered leaves the last figures standing.
+//------------------------------------------------------------------------------
+void Cabinet::collectReadings()
+{
+        m_cycleStarted = false;
+        m_cycleMicros = Hal::micros() - m_cycleStart;
+
+        float temperature = 0.0f;
+        float humidity = 0.0f;
+        uint32_t pressure = 0;
+        uint32_t resistance = 0xFFFFFFFFUL;
+        uint8_t answered = 0;
+        int16_t hottest = INT16_MIN;
+        for( uint8_t i=0; i<MaxSensors; i++ )
+        {
+                SensorChannel & channel = m_sensors[i];
+                if( channel.sensor == nullptr )
+                {
+                        continue;
+                }
+
+                channel.collected = false;
+                if( channel.misses != 0 )
+                {
+                        continue;
+                }
+
+                answered++;
+                channel.info.temperature = channel.sensor->temperature;
+                channel.info.humidity = channel.sensor->humidity;
+                channel.info.pressure = channel.sensor->pressure;
+                channel.info.voc = channel.sensor->gas_resistance;
+
+                temperature += channel.info.temperature;
+                humidity += channel.info.humidity;
+                pressure += channel.info.pressure;
+                resistance = Min( resistance, channel.sensor->gas_resistance );
+                hottest = Max( hottest, (int16_t)FieldWriter::toFixed(channel.info.temperature, 1) );
+        }
+        if( answered == 0 )
+        {
+                return;
+        }
+
+        m_hottest = hottest;
+        m_environmentInfo.temperature = temperature / answered;
+        m_environmentInfo.humidity = humidity / answered;
+        m_environmentInfo.pressure = pressure / answered;
+        m_environmentInfo.voc = resistance;
+        m_sensorReadings++;
+        sendTelemetry();
+        showReadings();
+        publishRegisters();
+}
+
+//------------------------------------------------------------------------------
+// History, sampling rate and panel, from the reading just collected.
+//------------------------------------------------------------------------------
+void Cabinet::showReadings()
+{
+        //display temperature, "Temp %5.2f*C".
+        const uint32_t resistance = (uint32_t)m_environmentInfo.voc;
+        const int32_t centiDegrees = FieldWriter::toFixed( m_environmentInfo.temperature, 2 );
+        m_display.field<TempAndVocLayout::Temp>().text_P(PSTR("Temp ")).fixed(centiDegrees, 2, 5).text_P(PSTR("*C"));
+
+        //history, the trend figures are maintained as samples arrive. Each sample
+        //stands for the whole seconds since the last, the remainder carries over.
+        const unsigned long now = Hal::millis();
+        const uint16_t seconds = (uint16_t)((now - m_historyMs) / 1000);
+        m_historyMs += seconds * 1000UL;
+        const int16_t deciDegrees = (int16_t)FieldWriter::toFixed( m_environmentInfo.temperature, 1 );
+        const int16_t airQualityPermille = VOCTable::permilleOfGood( resistance );
+        m_history.add( deciDegrees, airQualityPermille, seconds );
+
+        //extremes for the next summary.
+        if( m_periodEmpty )
+        {
+                m_period.peakTemperature = deciDegrees;
+                m_period.lowTemperature = deciDegrees;
+                m_period.worstAirQuality = airQualityPermille;
+                m_periodEmpty = false;
+        }
+        m_period.peakTemperature = Max( m_period.peakTemperature, deciDegrees );
+        m_period.lowTemperature = Min( m_period.lowTemperature, deciDegrees );
+        m_period.worstAirQuality = Min( m_period.worstAirQuality, airQualityPermille );
+        m_baselineOhms = Max( m_baselineOhms, resistance );
+
+        //sampling rate, from the change since the last reading and the minute's slope.
+        const TrendStats tempMinute = m_history.stats( SensorHistory::Temperature, SensorHistory::LastMinute );
+        const TrendStats airMinute = m_history.stats( SensorHistory::AirQuality, SensorHistory::LastMinute );
+        if( m_sampler.update( deciDegrees, airQualityPermille,
+                              tempMinute.buckets < 2 ? 0 : tempMinute.slopePerMinute,
+                              airMinute.buckets < 2 ? 0 : airMinute.slopePerMinute, now ) )
+        {
+                applySamplingProfile( now );
+        }
+
+        const TrendStats trend = m_history.stats( SensorHistory::Temperature, SensorHistory::LastTenMinutes );
+        const char trendMarker = trend.buckets < 2 ? ' ' : trend.slopePerMinute > 0 ? '^' : trend.slopePerMinute < 0 ? 'v' : '=';
+        m_display.field<TempAndVocLayout::TempTrend>().character( trendMarker );
+
+        //display air quality, "VOC %03d%%".
+        const uint8_t airQuality = VOCTable::percentOfGood( resistance );
+        m_display.field<TempAndVocLayout::VOC>().text_P(PSTR("VOC ")).integer(airQuality, 3, '0').character('%');
+
+        //display severity hint, only rewritten when the band changes.
+        const uint8_t severity = VOCTable::severity( resistance, m_vocSeverity );
+        if( severity != m_vocSeverity )
+        {
+                m_vocSeverity = severity;
+                m_display.field<TempAndVocLayout::VOCSeverity>().text_P( VOCTable::_asString[severity] );
+        }
+
+        feedAlerts( AlertEngine::Signal_Temperature, m_hottest, now );
+        feedAlerts( AlertEngine::Signal_AirQuality, airQualityPermille, now );
+        m_display.draw();
+}
+
+//------------------------------------------------------------------------------
+// The BME680 driver makes its own Wire calls, so its reads go through the bus
+// queue as operations and never hold loop() up behind an LCD redraw. False
+// when the sensor's bus queue is full.
+//------------------------------------------------------------------------------
+bool Cabinet::submitSensorOperation( SensorChannel & channel, I2CTransaction::Operation operation )
+{
+        I2CTransaction transaction;
+        transaction.operation = operation;
+        transaction.done = sensorTransferDone;
+        transaction.context = &channel;
+        transaction.flag = &channel.transfer;
+        return m_queue.submit( transaction );
+}
+
+//------------------------------------------------------------------------------
+// A failed transfer is a miss: the cycle finishes with the sensors that did
+// answer rather than retrying, and after MaxMisses in a row the sensor is
+// dropped.
+//------------------------------------------------------------------------------
+void Cabinet::sensorTransferDone( uint8_t status, void * context )
+{
+        SensorChannel & channel = *static_cast<SensorChannel *>( context );
+        Cabinet & cabinet = *channel.cabinet;
+        unsigned long wait = 0;
+        if( status == I2CTransaction::Failed )
+        {
+                channel.collected = true;
+                if( ++channel.misses >= MaxMisses )
+                {
+                        channel.sensor = nullptr;
+                        cabinet.m_sensorCount--;
+                }
+        }
+        else
+        {
+                wait = (unsigned long)Max( channel.sensor->remainingReadingMillis(), 0 );
+        }
+        cabinet.m_scheduler.runAfter( cabinet.m_sensorTask, wait, Hal::millis() );
+}
+
+//------------------------------------------------------------------------------
+// New oversampling is handed to the driver here, from inside the queued
+// operation, as setting it may touch the bus.
+//------------------------------------------------------------------------------
+bool Cabinet::beginGasReading( void * context )
+{
+        SensorChannel & channel = *static_cast<SensorChannel *>( context );
+        if( channel.profilePending )
+        {
+                const AdaptiveSampler::Profile profile = channel.cabinet->m_sampler.profile();
+                channel.sensor->setTemperatureOversampling( profile.osTemperature );
+                channel.sensor->setHumidityOversampling( profile.osHumidity );
+                channel.sensor->setPressureOversampling( profile.osPressure );
+                channel.profilePending = false;
+        }
+        if( channel.heaterPending )
+        {
+                const Settings & settings = channel.cabinet->m_settings;
+                channel.sensor->setGasHeater( settings.heaterCelsius, settings.heaterMs );
+                channel.heaterPending = false;
+        }
+        return channel.sensor->beginReading() != 0;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Cabinet::endGasReading( void * context )
+{
+        SensorChannel & channel = *static_cast<SensorChannel *>( context );
+        channel.collected = channel.sensor->endReading();
+        if( channel.collected )
+        {
+                channel.misses = 0;
+        }
+        return channel.collected;
+}
+
+//------------------------------------------------------------------------------
+// The period changes from the next release, the oversampling from the next
+// reading.
+//------------------------------------------------------------------------------
+void Cabinet::applySamplingProfile( unsigned long now )
+{
+        m_scheduler.setPeriod( m_sensorTask, m_sampler.interval(), now );
+        for( uint8_t i=0; i<MaxSensors; i++ )
+        {
+                m_sensors[i].profilePending = true;
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Cabinet::updateLights()
+{
+        HAL_PROBE("updateLights");
+
+        //the effects engine keeps to its own frame budget and only pushes changes.
+        const unsigned long pushes = m_effects.pushes();
+        const unsigned long nextFrame = m_effects.render( Hal::millis() );
+        if( m_effects.pushes() != pushes )
+        {
+                m_door.acknowledge( Hal::micros() );
+        }
+
+        if( nextFrame != LedEffects::Idle )
+        {
+                m_scheduler.continueAfter( nextFrame );
+        }
+}
+
+//------------------------------------------------------------------------------
+// Queues a snapshot of the enclosure state, loop() drains it to the UART.
+//------------------------------------------------------------------------------
+void Cabinet::sendTelemetry()
+{
+        TelemetryPacket packet;
+        packet.timestamp = Hal::millis();
+        packet.temperature = (int16_t)FieldWriter::toFixed( m_environmentInfo.temperature, 2 );
+        packet.humidity = (uint16_t)FieldWriter::toFixed( m_environmentInfo.humidity, 2 );
+        packet.pressure = m_environmentInfo.pressure;
+        packet.gasResistance = (uint32_t)m_environmentInfo.voc;
+        packet.flags = m_environmentInfo.doorOpen ? TelemetryPacket::Flag_DoorOpen : 0;
+        m_telemetry.send( packet );
+}
+
+//------------------------------------------------------------------------------
+// Fills the back copy of the register map and swaps it in, the slave handlers
+// only ever see whole snapshots.
+//------------------------------------------------------------------------------
+void Cabinet::publishRegisters()
+{
+#if defined(SLAVE_ADDRESS)
+        RegisterMap & map = m_slave.edit();
+        map.uptime = Hal::millis() / 1000;
+
+        map.readings.temperature = (int16_t)FieldWriter::toFixed( m_environmentInfo.temperature, 2 );
+        map.readings.humidity = (uint16_t)FieldWriter::toFixed( m_environmentInfo.humidity, 2 );
+        map.readings.pressure = m_environmentInfo.pressure;
+        map.readings.gasResistance = (uint32_t)m_environmentInfo.voc;
+        map.readings.airQuality = VOCTable::permilleOfGood( (uint32_t)m_environmentInfo.voc );
+        map.readings.flags = m_environmentInfo.doorOpen ? RegisterMap::Flag_DoorOpen : 0;
+        map.readings.alert = m_alerts.current() == AlertEngine::NoRule ? 0
+                           : (uint8_t)(m_alerts.level() << 4 | m_alerts.current());
+
+        const SensorHistory::Series series[] = { SensorHistory::Temperature, SensorHistory::AirQuality };
+        RegisterMap::Trend * registers[] = { &map.temperatureTrend, &map.airQualityTrend };
+        for( uint8_t i=0; i<2; i++ )
+        {
+                const TrendStats trend = m_history.stats( series[i], SensorHistory::LastTenMinutes );
+                registers[i]->min = trend.min;
+                registers[i]->max = trend.max;
+                registers[i]->mean = trend.mean;
+                registers[i]->slopePerMinute = trend.slopePerMinute;
+        }
+
+        map.health.sensorReadings = (uint16_t)m_sensorReadings;
+        map.health.doorEvents = (uint16_t)m_door.events();
+        map.health.busFailures = (uint16_t)m_queue.failed();
+        map.health.telemetryDropped = m_telemetry.dropped();
+        map.idlePermille = m_idlePermille;
+
+#if defined(PROFILING)
+        RegisterMap::Profile & profile = map.profile;
+        memset( &profile, 0, sizeof(profile) );
+        profile.select = m_profileJob;
+        profile.jobs = Profiler::jobs();
+        const ProfileStats * stats = Profiler::stats( m_profileJob );
+        if( stats != nullptr )
+        {
+                for( uint8_t i=0; i<sizeof(profile.name) && stats->name[i] != '\0'; i++ )
+                {
+                        profile.name[i] = stats->name[i];
+                }
+                profile.count = stats->count;
+                profile.meanMicros = stats->meanMicros();
+                profile.maxMicros = stats->maxMicros;
+                memcpy( profile.buckets, stats->buckets, sizeof(profile.buckets) );
+        }
+#endif //defined(PROFILING)
+
+        m_slave.publish();
+#endif //defined(SLAVE_ADDRESS)
+}
+
+//------------------------------------------------------------------------------
+// A new profile selection is published straight away. Config the master
+// wrote is clamped, applied, then published back so the master can read what
+// actually took effect.
+//------------------------------------------------------------------------------
+void Cabinet::applySlaveConfig()
+{
+#if defined(SLAVE_ADDRESS)
+        uint8_t select;
+        if( m_slave.takeProfileSelect(select) )
+        {
+#if defined(PROFILING)
+                if( select & RegisterMap::ProfileSelect_Reset )
+                {
+                        Profiler::reset();
+                }
+#endif //defined(PROFILING)
+                m_profileJob = select & ~RegisterMap::ProfileSelect_Reset;
+                publishRegisters();
+        }
+
+        RegisterMap::Config config;
+        if( !m_slave.takeConfig(config) )
+        {
+                return;
+        }
+
+        Settings settings = m_settings;
+        settings.refreshMs = Max<uint16_t>( config.refreshMs, SENSOR_REFRESH_MIN_MS );
+        settings.brightness = config.brightness;
+        settings.openColour = { config.openColour[0], config.openColour[1], config.openColour[2] };
+        settings.closedColour = { config.closedColour[0], config.closedColour[1], config.closedColour[2] };
+        applySettings( settings, Hal::millis() );
+#endif //defined(SLAVE_ADDRESS)
+}
+
+//------------------------------------------------------------------------------
+// Everything takes effect straight away except the sampling period, from the
+// next release, and the heater, from the next reading.
+//------------------------------------------------------------------------------
+void Cabinet::applySettings( const Settings & settings, unsigned long now )
+{
+        const bool heater = settings.heaterCelsius != m_settings.heaterCelsius || settings.heaterMs != m_settings.heaterMs;
+        m_settings = settings;
+        m_settingsSaved = false;
+
+        m_sampler.setBaseInterval( settings.refreshMs );
+        applySamplingProfile( now );
+        for( uint8_t i=0; i<MaxSensors; i++ )
+        {
+                m_sensors[i].heaterPending = m_sensors[i].heaterPending || heater;
+        }
+
+        m_effects.setBrightness( settings.brightness );
+        m_effects.setColours( 0, settings.openColour, settings.closedColour, now );
+        m_effects.setLength( 0, settings.ledCount );
+        m_scheduler.runAfter( m_lightsTask, 0, now );
+
+        publishSettings();
+}
+
+//------------------------------------------------------------------------------
+// A master reads back what actually took effect.
+//------------------------------------------------------------------------------
+void Cabinet::publishSettings()
+{
+#if defined(SLAVE_ADDRESS)
+        RegisterMap::Config & config = m_slave.edit().config;
+        config.refreshMs = m_settings.refreshMs;
+        config.brightness = m_settings.brightness;
+        memcpy( config.openColour, &m_settings.openColour, 3 );
+        memcpy( config.closedColour, &m_settings.closedColour, 3 );
+        m_slave.publish();
+#endif //defined(SLAVE_ADDRESS)
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Cabinet::render( void * context, const char * run, uint8_t line, uint8_t column, uint8_t length )
+{
+        HAL_PROBE("tempAndVocRender");
+        static_cast<Cabinet *>( context )->m_lcdWriter.write( column, line, run, length );
+}
+
+//------------------------------------------------------------------------------
+// One line of a reply per call, the console comes back for the next.
+//------------------------------------------------------------------------------
+bool Cabinet::consoleCommand( void * context, uint8_t command, Console::Args & args, uint8_t line, FieldWriter & out )
+{
+        Cabinet & cabinet = *static_cast<Cabinet *>( context );
+        const unsigned long now = Hal::millis();
+        switch( command )
+        {
+        case Command_Stats:
+                return cabinet.writeStats( line, out );
+
+        case Command_Display:
+                out.character( '|' ).text( cabinet.m_display.text(line) ).character( '|' );
+                return line + 1 < TempAndVocLayout::Height;
+
+        case Command_Profile:
+        {
+#if defined(PROFILING)
+                //a line for the name, one for the figures.
+                const ProfileStats * stats = Profiler::stats( line / 2 );
+                if( stats == nullptr )
+                {
+                        out.text_P( PSTR("no jobs yet") );
+                        return false;
+                }
+                if( line % 2 == 0 )
+                {
+                        out.text( stats->name );
+                        return true;
+                }
+                out.text_P( PSTR("  n ") ).integer( (int32_t)stats->count, 1 )
+                   .text_P( PSTR(" mean ") ).integer( (int32_t)stats->meanMicros(), 1 )
+                   .text_P( PSTR(" max ") ).integer( (int32_t)stats->maxMicros, 1 ).text_P( PSTR("us") );
+                return line / 2 + 1 < Profiler::jobs();
+#else
+                out.text_P( PSTR("built without PROFILING") );
+                return false;
+#endif //defined(PROFILING)
+        }
+
+        case Command_Get:
+                return cabinet.writeSettings( line, out );
+
+        case Command_Set:
+                cabinet.changeSetting( args, out );
+                return false;
+
+        case Command_Save:
+                cabinet.saveSettings( out );
+                return false;
+
+        case Command_Default:
+                cabinet.applySettings( defaultSettings(), now );
+                out.text_P( PSTR("ok, save to keep") );
+                return false;
+
+        case Command_Test:
+                cabinet.m_effects.testPattern( now );
+                cabinet.m_scheduler.runAfter( cabinet.m_lightsTask, 0, now );
+                out.text_P( PSTR("ok") );
+                return false;
+
+        case Command_Memory:
+                return writeMemory( line, out );
+        }
+        return false;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Cabinet::writeMemory( uint8_t line, FieldWriter & out )
+{
+        if( !MemoryMonitor::Measured )
+        {
+                out.text_P( PSTR("not measured natively") );
+                return false;
+        }
+
+        switch( line )
+        {
+        case 0:
+                out.text_P( PSTR("static ") ).integer( MemoryMonitor::staticBytes(), 1 )
+                   .text_P( PSTR(" of ") ).integer( MemoryBudget::Sram, 1 );
+                return true;
+
+        case 1:
+                out.text_P( PSTR("free ") ).integer( MemoryMonitor::freeNow(), 1 )
+                   .text_P( PSTR(", lowest ") ).integer( MemoryMonitor::freeLowest(), 1 );
+                return true;
+
+        default:
+                out.text_P( PSTR("stack never reached ") ).integer( MemoryMonitor::stackHeadroom(), 1 );
+                return false;
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Cabinet::writeStats( uint8_t line, FieldWriter & out ) const
+{
+        const EnvironmentInfo & info = m_environmentInfo;
+        switch( line )
+        {
+        case 0:
+                out.text_P( PSTR("up ") ).integer( (int32_t)(Hal::millis() / 1000), 1 )
+                   .text_P( PSTR(" s, idle ") ).fixed( m_idlePermille, 1, 1 ).character( '%' );
+                return true;
+
+        case 1:
+                out.fixed( FieldWriter::toFixed(info.temperature, 2), 2, 1 ).text_P( PSTR("*C ") )
+                   .fixed( FieldWriter::toFixed(info.humidity, 2), 2, 1 ).text_P( PSTR("% ") )
+                   .integer( (int32_t)info.pressure, 1 ).text_P( PSTR("Pa") );
+                return true;
+
+        case 2:
+                out.text_P( PSTR("voc ") ).integer( (int32_t)info.voc, 1 ).text_P( PSTR(" ohms, door ") ).text_P( info.doorOpen ? PSTR("open") : PSTR("shut") );
+                return true;
+
+        case 3:
+                out.text_P( PSTR("readings ") ).integer( (int32_t)m_sensorReadings, 1 )
+                   .text_P( PSTR(", cycle ") ).integer( (int32_t)(m_cycleMicros / 1000), 1 ).text_P( PSTR("ms") );
+                return true;
+
+        case 4:
+                out.text_P( PSTR("boot ") ).integer( m_boots, 1 ).text_P( PSTR(", ") ).integer( (int32_t)m_doorOpens, 1 ).text_P( PSTR(" opens") );
+                return true;
+
+        case 5:
+                out.text_P( PSTR("bus fails ") ).integer( (int32_t)m_queue.failed(), 1 )
+                   .text_P( PSTR(", tx dropped ") ).integer( m_telemetry.dropped(), 1 );
+                return true;
+
+        default:
+                out.text_P( PSTR("journal ") ).integer( (int32_t)m_journal.appended(), 1 )
+                   .text_P( PSTR(" kept, ") ).integer( (int32_t)m_journal.dropped(), 1 ).text_P( PSTR(" lost") );
+                return false;
+        }
+}
+
+//------------------------------------------------------------------------------
+// In the form set takes, so a saved reply can be played back.
+//------------------------------------------------------------------------------
+bool Cabinet::writeSettings( uint8_t line, FieldWriter & out ) const
+{
+        const Settings & settings = m_settings;
+        switch( line )
+        {
+        case 0:
+                out.text_P( PSTR("refresh ") ).integer( settings.refreshMs, 1 );
+                return true;
+
+        case 1:
+                out.text_P( PSTR("bright ") ).integer( settings.brightness, 1 );
+                return true;
+
+        case 2:
+        case 3:
+        {
+                const Rgb & colour = line == 2 ? settings.openColour : settings.closedColour;
+                out.text_P( line == 2 ? PSTR("open ") : PSTR("closed ") ).integer( colour.r, 1 ).character( ' ' )
+                   .integer( colour.g, 1 ).character( ' ' ).integer( colour.b, 1 );
+                return true;
+        }
+
+        case 4:
+                out.text_P( PSTR("heater ") ).integer( settings.heaterCelsius, 1 ).character( ' ' ).integer( settings.heaterMs, 1 );
+                return true;
+
+        case 5:
+                out.text_P( PSTR("leds ") ).integer( settings.ledCount, 1 );
+                return true;
+
+        default:
+                out.text_P( m_settingsSaved ? PSTR("(saved)") : PSTR("(not saved)") );
+                return false;
+        }
+}
+
+//------------------------------------------------------------------------------
+// The heater range is the BME680's.
+//------------------------------------------------------------------------------
+void Cabinet::changeSetting( Console::Args & args, FieldWriter & out )
+{
+        Settings settings = m_settings;
+        const char * name = args.word();
+        int32_t values[3];
+
+        bool valid = false;
+        if( name == nullptr )
+        {
+        }
+        else if( strcmp_P(name, PSTR("refresh")) == 0 && args.number(values[0], SENSOR_REFRESH_MIN_MS, 60000) )
+        {
+                settings.refreshMs = (uint16_t)values[0];
+                valid = true;
+        }
+        else if( strcmp_P(name, PSTR("bright")) == 0 && args.number(values[0], 0, 255) )
+        {
+                settings.brightness = (uint8_t)values[0];
+                valid = true;
+        }
+        else if( (strcmp_P(name, PSTR("open")) == 0 || strcmp_P(name, PSTR("closed")) == 0)
+              && args.number(values[0], 0, 255) && args.number(values[1], 0, 255) && args.number(values[2], 0, 255) )
+        {
+                Rgb & colour = name[0] == 'o' ? settings.openColour : settings.closedColour;
+                colour = { (uint8_t)values[0], (uint8_t)values[1], (uint8_t)values[2] };
+                valid = true;
+        }
+        else if( strcmp_P(name, PSTR("heater")) == 0 && args.number(values[0], 200, 400) && args.number(values[1], 1, 4032) )
+        {
+                settings.heaterCelsius = (uint16_t)values[0];
+                settings.heaterMs = (uint16_t)values[1];
+                valid = true;
+        }
+        else if( strcmp_P(name, PSTR("leds")) == 0 && args.number(values[0], 0, Hal::LedStrip::Count) )
+        {
+                settings.ledCount = (uint16_t)values[0];
+                valid = true;
+        }
+
+        if( !valid || args.word() != nullptr )
+        {
+                m_console.usage( Command_Set, out );
+                return;
+        }
+        applySettings( settings, Hal::millis() );
+        out.text_P( PSTR("ok") );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Cabinet::saveSettings( FieldWriter & out )
+{
+        if( !m_journal.append(Records::Type_Settings, &m_settings, sizeof(m_settings)) )
+        {
+                out.text_P( PSTR("? journal busy, try again") );
+                return;
+        }
+        m_journal.flush();
+        m_settingsSaved = true;
+        out.text_P( PSTR("saved") );
+}
+
+//------------------------------------------------------------------------------
+// The first event is the state found at boot, not a movement.
+//------------------------------------------------------------------------------
+void Cabinet::recordDoor()
+{
+        if( m_door.events() <= 1 )
+        {
+                return;
+        }
+
+        const Records::Door door = { (uint32_t)(Hal::millis() / 1000), m_environmentInfo.doorOpen };
+        m_journal.append( Records::Type_Door, &door, sizeof(door) );
+        if( door.open )
+        {
+                m_doorOpens++;
+        }
+}
+
+//------------------------------------------------------------------------------
+// Flushes the batch, door events included. The baseline decays by 1/256 a
+// period, (255/256)^96 or about 31% a day, so sensor drift does not leave it
+// stuck high.
+//------------------------------------------------------------------------------
+void Cabinet::recordSummary()
+{
+        if( m_periodEmpty )
+        {
+                return;
+        }
+
+        m_period.uptime = Hal::millis() / 1000;
+        m_period.boots = m_boots;
+        m_period.baselineOhms = m_baselineOhms;
+        m_journal.append( Records::Type_Summary, &m_period, sizeof(m_period) );
+        if( m_settingsSaved )
+        {
+                //again, so they outlive the record they were saved in.
+                m_journal.append( Records::Type_Settings, &m_settings, sizeof(m_settings) );
+        }
+        m_journal.flush();
+
+        m_peakTemperature = Max( m_peakTemperature, m_period.peakTemperature );
+        m_baselineOhms -= m_baselineOhms / 256;
+        m_periodEmpty = true;
+}
+
+//------------------------------------------------------------------------------
+// Replayed oldest first, so later records win.
+//------------------------------------------------------------------------------
+void Cabinet::restore( uint8_t type, const uint8_t * payload, uint8_t length, void * context )
+{
+        Cabinet & cabinet = *static_cast<Cabinet *>( context );
+        if( type == Records::Type_Boot && length == sizeof(Records::Boot) )
+        {
+                Records::Boot boot;
+                memcpy( &boot, payload, sizeof(boot) );
+                cabinet.m_boots = boot.boots;
+        }
+        else if( type == Records::Type_Door && length == sizeof(Records::Door) )
+        {
+                cabinet.m_doorOpens += payload[offsetof(Records::Door, open)] != 0 ? 1 : 0;
+        }
+        else if( type == Records::Type_Summary && length == sizeof(Records::Summary) )
+        {
+                Records::Summary summary;
+                memcpy( &summary, payload, sizeof(summary) );
+                cabinet.m_boots = summary.boots;
+                cabinet.m_baselineOhms = summary.baselineOhms;
+                cabinet.m_peakTemperature = Max( cabinet.m_peakTemperature, summary.peakTemperature );
+        }
+        else if( type == Records::Type_Settings && length == sizeof(Settings) )
+        {
+                //saved by a build that may have had a longer strip.
+                Settings & settings = cabinet.m_settings;
+                memcpy( &settings, payload, sizeof(settings) );
+                settings.refreshMs = Max<uint16_t>( settings.refreshMs, SENSOR_REFRESH_MIN_MS );
+                settings.ledCount = Min<uint16_t>( settings.ledCount, (uint16_t)Hal::LedStrip::Count );
+                cabinet.m_settingsSaved = true;
+        }
+}
+
+//------------------------------------------------------------------------------
+// Most readings fall inside the quiet band and cost two compares.
+//------------------------------------------------------------------------------
+void Cabinet::feedAlerts( AlertEngine::Signal signal, int16_t value, unsigned long now )
+{
+        if( m_alerts.update(signal, value, now) )
+        {
+                showAlert( now );
+        }
+        armAlerts( now );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Cabinet::showAlert( unsigned long now )
+{
+        const AlertEngine::Level level = m_alerts.level();
+        if( level == AlertEngine::Level_None )
+        {
+                m_effects.stopPulse();
+        }
+        else
+        {
+                AlertPulse pulse;
+                memcpy_P( &pulse, &ALERT_PULSES[level], sizeof(pulse) );
+                m_effects.pulse( pulse.colour, pulse.periodMs, now );
+        }
+        m_scheduler.runAfter( m_lightsTask, 0, now );
+
+        m_display.field<TempAndVocLayout::Alert>().text_P( m_alerts.text() );
+        m_display.draw();
+        publishRegisters();
+}
+
+//------------------------------------------------------------------------------
+// An alert task armed for a dwell that was since cancelled runs early and
+// finds nothing to do.
+//------------------------------------------------------------------------------
+void Cabinet::armAlerts( unsigned long now )
+{
+        const unsigned long next = m_alerts.nextDeadline( now );
+        if( next != Scheduler::NoDeadline )
+        {
+                m_scheduler.runAfter( m_alertTask, next, now );
+        }
+}
@@ -0,0 +1,308 @@
+/*------------------------------------------------------------------------------
+    ()      File: cabinet.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              The enclosure controller - sensor, panel, door lights, telemetry and
+              slave registers - run on devices handed to it.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include "hal.h"
+#include "pinconfig.h"
+#include "utility.h"
+#include "door.h"
+#include "history.h"
+#include "sampling.h"
+#include "telemetry.h"
+#include "i2cqueue.h"
+#include "lcdwriter.h"
+#include "effects.h"
+#include "slave.h"
+#include "layout.h"
+#include "journal.h"
+#include "alerts.h"
+#include "console.h"
+#include "memory.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// All of the firmware's state and logic. The board's devices are created and
+// begun by whoever owns them and handed in, so the Arduino sketch runs one
+// Cabinet from setup() and loop() and the native fleet runs hundreds, each on
+// simulated devices of its own.
+//------------------------------------------------------------------------------
+class Cabinet
+{
+public:
+#if defined(IS_BLUEPILL_BUILD)
+    enum Bus : uint8_t { LocalBus, GlobalBus, MaxBuses = 2 };
+#else
+    enum Bus : uint8_t { LocalBus, MaxBuses = 1 };
+#endif //defined(IS_BLUEPILL_BUILD)
+
+    static const uint8_t LcdAddress = 0x27;
+
+    // Up to GAS_SENSORS BME680s on the local bus, sensor n at 0x76 + n. The
+    // Blue Pill's global bus belongs to the master, each cabinet answering on
+    // it as a slave, so no sensors are fitted there.
+    static const uint8_t MaxSensors = GAS_SENSORS;
+    static uint8_t sensorAddress( uint8_t sensor ) { return 0x76 + sensor; }
+
+    // Consecutive failed transfers before a sensor is taken as gone. It is
+    // left out of the cycle from then on, until the next boot.
+    static const uint8_t MaxMisses = 3;
+
+    // The local bus, the panel and sensors are on it. Sensors that do not
+    // answer at begin() are left out.
+    struct Devices
+    {
+        Hal::I2CBus * bus;
+        Hal::GasSensor * gasSensors[MaxSensors];
+        Hal::Lcd * lcd;
+        Hal::LedStrip * leds;
+        Hal::Storage * storage;
+        uint8_t doorPin;
+    };
+
+    // What can be tuned while running, from the console or a master.
+    struct Settings
+    {
+        uint16_t refreshMs;             //fast sampling interval, steady air is read less often.
+        uint8_t brightness;
+        Rgb openColour;
+        Rgb closedColour;
+        uint16_t heaterCelsius;
+        uint16_t heaterMs;
+        uint16_t ledCount;              //lit from the start of the strip, at most LEDCOUNT.
+    } __attribute__((packed));
+
+    // What the journal keeps across resets, each type's payload is fixed.
+    // Settings are recorded as saved from the console.
+    struct Records
+    {
+        enum Type : uint8_t { Type_Boot = 1, Type_Door, Type_Summary, Type_Settings };
+
+        struct Boot
+        {
+            uint16_t boots;
+        } __attribute__((packed));
+
+        struct Door
+        {
+            uint32_t uptime;                //seconds since the boot before it.
+            uint8_t open;
+        } __attribute__((packed));
+
+        // The period since the last summary, the VOC baseline, and the boot
+        // count again so it outlives its boot record.
+        struct Summary
+        {
+            uint32_t uptime;
+            uint16_t boots;
+            int16_t peakTemperature;        //deci *C.
+            int16_t lowTemperature;
+            int16_t worstAirQuality;        //permille.
+            uint32_t baselineOhms;          //cleanest air seen, decaying slowly.
+        } __attribute__((packed));
+    };
+
+    explicit Cabinet( const Devices & devices );
+
+    void begin();
+    void loop();
+
+    // Milliseconds until loop() next has work, 0 while anything is in flight.
+    unsigned long idleMillis( unsigned long now ) const;
+
+    // Sleeps the core until then, or an interrupt. False if there was no time.
+    bool sleep();
+
+#if defined(SLAVE_ADDRESS)
+    // Slave handlers, interrupt context on hardware.
+    void slaveReceived( const uint8_t * data, uint8_t length ) { m_slave.received( data, length ); Hal::wake(); }
+    uint8_t slaveRequested( uint8_t * out, uint8_t capacity ) { return m_slave.requested( out, capacity ); }
+    SlaveRegisters & registers() { return m_slave; }
+#endif //defined(SLAVE_ADDRESS)
+
+    // Each sensor's conversion is started after the last one's reading is
+    // fetched rather than all overlapping, for comparison.
+    void setPipelined( bool pipelined ) { m_pipelined = pipelined; }
+
+    // The panel is written a character per transaction rather than in
+    // bursts, for comparison.
+    void setLcdBatched( bool batched ) { m_lcdWriter.setBatched( batched ); }
+    void setLcdBurstBytes( uint8_t bytes ) { m_lcdWriter.setBurstBytes( bytes ); }
+
+    //inspection.
+    const EnvironmentInfo & environment() const { return m_environmentInfo; }
+    const EnvironmentInfo & sensorEnvironment( uint8_t sensor ) const { return m_sensors[sensor].info; }
+    bool sensorFitted( uint8_t sensor ) const { return m_sensors[sensor].sensor != nullptr; }
+    uint8_t sensorCount() const { return m_sensorCount; }
+    unsigned long cycleMicros() const { return m_cycleMicros; }
+    const SensorHistory & history() const { return m_history; }
+    const TelemetryStream & telemetry() const { return m_telemetry; }
+    const DoorMonitor & door() const { return m_door; }
+    const LedEffects & effects() const { return m_effects; }
+    const AlertEngine & alerts() const { return m_alerts; }
+    const I2CQueue & queue() const { return m_queue; }
+    const char * panelText( uint8_t line ) const { return m_display.text( line ); }
+    const LcdWriter & lcdWriter() const { return m_lcdWriter; }
+    const Settings & settings() const { return m_settings; }
+    bool settingsSaved() const { return m_settingsSaved; }
+    const Console & console() const { return m_console; }
+    unsigned long sensorReadings() const { return m_sensorReadings; }
+    uint16_t idlePermille() const { return m_idlePermille; }
+    const Journal & journal() const { return m_journal; }
+    uint16_t boots() const { return m_boots; }
+    uint32_t baselineOhms() const { return m_baselineOhms; }
+    int16_t peakTemperature() const { return m_peakTemperature; }
+    unsigned long doorOpens() const { return m_doorOpens; }
+    AdaptiveSampler & sampler() { return m_sampler; }
+
+private:
+    // Higher runs first when several tasks are due together.
+    enum TaskPriority { Priority_Summary = 0, Priority_Sensor = 1, Priority_Lights = 2, Priority_Alerts = 3 };
+
+    static void sensorTask( void * context );
+    static void lightsTask( void * context );
+    static void summaryTask( void * context );
+    static void alertTask( void * context );
+    static void restore( uint8_t type, const uint8_t * payload, uint8_t length, void * context );
+    static bool beginGasReading( void * context );
+    static bool endGasReading( void * context );
+    static void sensorTransferDone( uint8_t status, void * context );
+    static void render( void * context, const char * run, uint8_t line, uint8_t column, uint8_t length );
+    static bool consoleCommand( void * context, uint8_t command, Console::Args & args, uint8_t line, FieldWriter & out );
+
+    struct SensorChannel;
+
+    void updateSensor();
+    bool submitSensorOperation( SensorChannel & channel, I2CTransaction::Operation operation );
+    void collectReadings();
+    void showReadings();
+    void updateLights();
+    void applySamplingProfile( unsigned long now );
+    void sendTelemetry();
+    void publishRegisters();
+    void applySlaveConfig();
+    void measureIdle();
+    void recordDoor();
+    void recordSummary();
+    void feedAlerts( AlertEngine::Signal signal, int16_t value, unsigned long now );
+    void showAlert( unsigned long now );
+    void armAlerts( unsigned long now );
+    void applySettings( const Settings & settings, unsigned long now );
+    void publishSettings();
+    bool writeStats( uint8_t line, FieldWriter & out ) const;
+    bool writeSettings( uint8_t line, FieldWriter & out ) const;
+    static bool writeMemory( uint8_t line, FieldWriter & out );
+    void changeSetting( Console::Args & args, FieldWriter & out );
+    void saveSettings( FieldWriter & out );
+
+    //devices.
+    Hal::Lcd & m_lcd;
+    Hal::LedStrip & m_leds;
+    uint8_t m_doorPin;
+    I2CQueue m_queue;
+
+    //tasks.
+    Scheduler m_scheduler;
+    uint8_t m_sensorTask = Scheduler::InvalidTask;
+    uint8_t m_lightsTask = Scheduler::InvalidTask;
+    uint8_t m_summaryTask = Scheduler::InvalidTask;
+    uint8_t m_alertTask = Scheduler::InvalidTask;
+
+    //gas sensors, and how far each is through the cycle.
+    struct SensorChannel
+    {
+        Cabinet * cabinet = nullptr;
+        Hal::GasSensor * sensor = nullptr;      //nullptr if none is fitted, or it has gone.
+        volatile uint8_t transfer = I2CTransaction::Idle;
+        uint8_t misses = 0;                     //failed transfers since its last reading.
+        bool collected = false;                 //done this cycle, read or missed.
+        bool profilePending = false;
+        bool heaterPending = false;
+        EnvironmentInfo info;                   //readings only, the door is in the aggregate.
+    } m_sensors[MaxSensors];
+
+    uint8_t m_sensorCount = 0;
+    bool m_pipelined = true;
+    bool m_cycleStarted = false;
+    unsigned long m_cycleStart = 0;
+    unsigned long m_cycleMicros = 0;
+    int16_t m_hottest = 0;                      //deci *C, what the alerts watch.
+    AdaptiveSampler m_sampler;
+
+    //panel.
+    LcdWriter m_lcdWriter;
+    Display<TempAndVocLayout> m_display;
+
+    //alerts, and the air quality label, each held until clearly crossed.
+    AlertEngine m_alerts;
+    uint8_t m_vocSeverity = VOCTable::MAX;
+
+    //state. Temperature, humidity and pressure are the mean over the sensors,
+    //air quality the worst of them.
+    EnvironmentInfo m_environmentInfo;
+    SensorHistory m_history;
+    unsigned long m_historyMs = 0;      //time the history accounts for.
+    unsigned long m_sensorReadings = 0;
+
+    //time asleep over the last whole window.
+    unsigned long m_idleWindowStart = 0;
+    unsigned long m_idleMicros = 0;
+    uint16_t m_idlePermille = 0;
+
+    //persistent log, and what it has told us.
+    Journal m_journal;
+    uint16_t m_boots = 0;
+    uint32_t m_baselineOhms = 0;
+    int16_t m_peakTemperature = INT16_MIN;
+    unsigned long m_doorOpens = 0;
+    Records::Summary m_period;
+    bool m_periodEmpty = true;
+
+    TelemetryStream m_telemetry;
+    DoorMonitor m_door;
+    LedEffects m_effects;
+
+    //tuning, and whether the journal holds what is in use.
+    Console m_console;
+    Settings m_settings;
+    bool m_settingsSaved = false;
+
+#if defined(SLAVE_ADDRESS)
+    SlaveRegisters m_slave;
+    uint8_t m_profileJob = 0;
+#endif //defined(SLAVE_ADDRESS)
+};
+
+#if defined(IS_NANO_BUILD)
+//the whole firmware's state, most of the Nano's 2KB, see MemoryBudget.
+static_assert( sizeof(Cabinet) <= MemoryBudget::Cabinet, "Cabinet is over its SRAM budget" );
+#endif //defined(IS_NANO_BUILD)
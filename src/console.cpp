@@ -0,0 +1,298 @@
+/*------------------------------------------------------------------------------
+    ()      File: console.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Line-oriented command console on the serial port.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdlib.h>
+#include <string.h>
+#include "console.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+static_assert( Console::ReplyLength + 2 + 1 + TelemetryPacket::FrameSize <= TelemetryStream::QueueSize,
+               "a reply line must fit the telemetry queue beside a frame" );
+
+namespace
+{
+        //------------------------------------------------------------------------------
+        // name is in flash, and unterminated when it fills the field.
+        //------------------------------------------------------------------------------
+        bool matches( const char * word, const char * name )
+        {
+                for( uint8_t i=0; i<Console::NameLength; i++ )
+                {
+                        const char c = (char)pgm_read_byte( &name[i] );
+                        if( c != word[i] )
+                        {
+                                return false;
+                        }
+                        if( c == '\0' )
+                        {
+                                return true;
+                        }
+                }
+                return word[Console::NameLength] == '\0';
+        }
+
+        void copyFromFlash( FieldWriter & out, const char * text, uint8_t length )
+        {
+                for( uint8_t i=0; i<length; i++ )
+                {
+                        const char c = (char)pgm_read_byte( &text[i] );
+                        if( c == '\0' )
+                        {
+                                break;
+                        }
+                        out.character( c );
+                }
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Console::Args
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+const char * Console::Args::word()
+{
+        while( m_cursor < m_end && *m_cursor == '\0' )
+        {
+                m_cursor++;
+        }
+        if( m_cursor >= m_end )
+        {
+                return nullptr;
+        }
+
+        const char * word = m_cursor;
+        while( m_cursor < m_end && *m_cursor != '\0' )
+        {
+                m_cursor++;
+        }
+        return word;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Console::Args::number( int32_t & value, int32_t min, int32_t max )
+{
+        const char * text = word();
+        if( text == nullptr )
+        {
+                return false;
+        }
+
+        char * end;
+        const long parsed = strtol( text, &end, 10 );
+        if( end == text || *end != '\0' || parsed < min || parsed > max )
+        {
+                return false;
+        }
+        value = (int32_t)parsed;
+        return true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Console
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+Console::Console( const Command * commands, uint8_t count, Handler handler, void * context, TelemetryStream & stream )
+        : m_commands( commands )
+        , m_count( count )
+        , m_handler( handler )
+        , m_context( context )
+        , m_stream( stream )
+{
+}
+
+//------------------------------------------------------------------------------
+// At most one line is taken per pass, anything after it stays in the UART's
+// buffer until the reply is out.
+//------------------------------------------------------------------------------
+void Console::service()
+{
+        if( m_replying )
+        {
+                reply();
+                return;
+        }
+
+        int c;
+        while( (c = Hal::serialRead()) >= 0 )
+        {
+                if( c == '\r' || c == '\n' )
+                {
+                        if( m_length != 0 || m_overflow )
+                        {
+                                execute();
+                                reply();
+                                return;
+                        }
+                        continue;
+                }
+
+                if( m_length < LineLength )
+                {
+                        m_line[m_length++] = (char)c;
+                }
+                else
+                {
+                        m_overflow = true;
+                }
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Console::usage( uint8_t command, FieldWriter & out ) const
+{
+        out.text_P( PSTR("? ") );
+        copyFromFlash( out, m_commands[command].name, NameLength );
+        out.character( ' ' );
+        copyFromFlash( out, m_commands[command].usage, UsageLength );
+}
+
+//------------------------------------------------------------------------------
+// Splits the line into words in place and finds the command.
+//------------------------------------------------------------------------------
+void Console::execute()
+{
+        m_line[m_length] = '\0';
+        for( uint8_t i=0; i<m_length; i++ )
+        {
+                if( m_line[i] == ' ' || m_line[i] == '\t' )
+                {
+                        m_line[i] = '\0';
+                }
+        }
+
+        Args words( m_line, m_line + m_length );
+        const char * name = words.word();
+        m_args = name == nullptr ? m_length : (uint8_t)(name - m_line + strlen(name));
+
+        m_command = Unknown;
+        if( m_overflow )
+        {
+                m_command = TooLong;
+        }
+        else if( name != nullptr && strcmp_P(name, PSTR("help")) == 0 )
+        {
+                m_command = Help;
+        }
+        else if( name != nullptr )
+        {
+                for( uint8_t i=0; i<m_count; i++ )
+                {
+                        if( matches(name, m_commands[i].name) )
+                        {
+                                m_command = i;
+                                break;
+                        }
+                }
+        }
+
+        if( m_command == Unknown || m_command == TooLong )
+        {
+                m_rejectedCount++;
+        }
+        else
+        {
+                m_commandCount++;
+        }
+
+        m_replying = true;
+        m_more = true;
+        m_replyLine = 0;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Console::format( uint8_t line, FieldWriter & out )
+{
+        switch( m_command )
+        {
+        case TooLong:
+                out.text_P( PSTR("? line too long") );
+                return false;
+
+        case Unknown:
+                out.text_P( PSTR("? unknown, try help") );
+                return false;
+
+        case Help:
+                copyFromFlash( out, m_commands[line].name, NameLength );
+                out.character( ' ' );
+                copyFromFlash( out, m_commands[line].usage, UsageLength );
+                return line + 1 < m_count;
+
+        default:
+        {
+                Args args( m_line + m_args, m_line + m_length );
+                return m_handler( m_context, m_command, args, line, out );
+        }
+        }
+}
+
+//------------------------------------------------------------------------------
+// Queues as many lines as the stream has room for, then picks up from there
+// on the next pass.
+//------------------------------------------------------------------------------
+void Console::reply()
+{
+        while( m_more )
+        {
+                if( !m_stream.roomForText(ReplyLength + 2) )
+                {
+                        return;
+                }
+
+                char reply[ReplyLength + 2];        //with its CR LF.
+                FieldWriter out( reply, ReplyLength );
+                m_more = format( m_replyLine++, out );
+                if( out.written() == 0 )
+                {
+                        out.character( ' ' );       //an empty line would read as a frame.
+                }
+                uint8_t length = out.written();
+                reply[length++] = '\r';
+                reply[length++] = '\n';
+                m_stream.sendText( reply, length );
+        }
+
+        m_replying = false;
+        m_length = 0;
+        m_overflow = false;
+}
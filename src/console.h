@@ -0,0 +1,123 @@
+/*------------------------------------------------------------------------------
+    ()      File: console.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Line-oriented command console on the serial port.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include "hal.h"
+#include "format.h"
+#include "telemetry.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Lines are read a byte at a time as they arrive, into a fixed buffer, so no
+// command ever waits on the UART. The first word is looked up in the owner's
+// command table, kept in flash, and the owner's handler runs with the rest.
+//
+// Replies are formatted a line at a time and queued on the telemetry stream,
+// so they never split a frame and a long one never holds loop() up. A line is
+// only formatted once the stream has room for it, on the stack, so none is
+// held here. Input waits in the UART's buffer until the reply is out.
+//------------------------------------------------------------------------------
+class Console
+{
+public:
+    static const uint8_t LineLength = 24;
+    static const uint8_t ReplyLength = 32;
+    static const uint8_t NameLength = 8;
+    static const uint8_t UsageLength = 24;
+
+    struct Command
+    {
+        char name[NameLength];
+        char usage[UsageLength];
+    };
+
+    // The words after the command, each terminated in place.
+    class Args
+    {
+    public:
+        explicit Args( const char * words, const char * end ) : m_cursor( words ), m_end( end ) {}
+
+        // nullptr once the words run out.
+        const char * word();
+
+        // False if the next word is missing, not a number or out of range.
+        bool number( int32_t & value, int32_t min, int32_t max );
+
+    private:
+        const char * m_cursor;
+        const char * m_end;
+    };
+
+    // Formats reply line n of command, returning whether another follows.
+    using Handler = bool (*)( void * context, uint8_t command, Args & args, uint8_t line, FieldWriter & out );
+
+    Console( const Command * commands, uint8_t count, Handler handler, void * context, TelemetryStream & stream );
+
+    // Takes what input has arrived, or carries on with a reply.
+    void service();
+    bool idle() const { return !m_replying && Hal::serialAvailable() == 0; }
+
+    // "? name usage", for a handler turning down its arguments.
+    void usage( uint8_t command, FieldWriter & out ) const;
+
+    //inspection.
+    unsigned long commands() const { return m_commandCount; }
+    unsigned long rejected() const { return m_rejectedCount; }
+
+private:
+    static const uint8_t TooLong = 0xFD;
+    static const uint8_t Help = 0xFE;
+    static const uint8_t Unknown = 0xFF;
+
+    void execute();
+    bool format( uint8_t line, FieldWriter & out );
+    void reply();
+
+    const Command * m_commands;
+    uint8_t m_count;
+    Handler m_handler;
+    void * m_context;
+    TelemetryStream & m_stream;
+
+    char m_line[LineLength + 1];
+    uint8_t m_length = 0;
+    uint8_t m_args = 0;             //where the arguments start.
+    bool m_overflow = false;
+
+    bool m_replying = false;
+    bool m_more = false;
+    uint8_t m_command = Unknown;
+    uint8_t m_replyLine = 0;
+
+    unsigned long m_commandCount = 0;
+    unsigned long m_rejectedCount = 0;
+};
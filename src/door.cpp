@@ -0,0 +1,159 @@
+/*------------------------------------------------------------------------------
+    ()      File: door.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Interrupt driven, debounced door switch.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include "door.h"
+#include "hal.h"
+#include "utility.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// The initial state is published as the first event so the lights are set up.
+//------------------------------------------------------------------------------
+void DoorMonitor::begin( uint8_t pin )
+{
+        m_pin = pin;
+        Hal::pinModeInputPullup( pin );
+        Hal::attachPinChange( pin, onEdge, this );
+
+        Hal::InterruptGuard guard;
+        m_open = !Hal::digitalRead( pin );
+        m_state = Settling;
+        m_edgePending = false;
+        m_lastEdgeMillis = Hal::millis() - DebounceMs;
+        m_firstEdgeMicros = Hal::micros();
+}
+
+//------------------------------------------------------------------------------
+// A pending edge needs poll() straight away, otherwise the switch has to stay
+// quiet for the rest of the debounce.
+//------------------------------------------------------------------------------
+unsigned long DoorMonitor::settleMillis( unsigned long now ) const
+{
+        unsigned long lastEdge;
+        {
+                Hal::InterruptGuard guard;
+                if( m_edgePending )
+                {
+                        return 0;
+                }
+                lastEdge = m_lastEdgeMillis;
+        }
+        const unsigned long quiet = now - lastEdge;
+        return quiet >= DebounceMs ? 0 : DebounceMs - quiet;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool DoorMonitor::poll( unsigned long now )
+{
+        if( m_state == Stable && !m_edgePending )
+        {
+                return false;
+        }
+
+        unsigned long lastEdge;
+        {
+                Hal::InterruptGuard guard;
+                lastEdge = m_lastEdgeMillis;
+                m_edgePending = false;
+        }
+        m_state = Settling;
+
+        //still bouncing.
+        if( (now - lastEdge) < DebounceMs )
+        {
+                return false;
+        }
+
+        bool open;
+        unsigned long firstEdge;
+        {
+                Hal::InterruptGuard guard;
+                if( m_edgePending )
+                {
+                        return false;
+                }
+                open = Hal::digitalRead( m_pin );
+                firstEdge = m_firstEdgeMicros;
+        }
+        m_state = Stable;
+
+        //bounced back to where it started.
+        if( open == m_open )
+        {
+                return false;
+        }
+
+        m_open = open;
+        m_eventMicros = firstEdge;
+        m_awaitingAck = true;
+        m_events++;
+        return true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void DoorMonitor::acknowledge( unsigned long nowMicros )
+{
+        if( !m_awaitingAck )
+        {
+                return;
+        }
+
+        m_awaitingAck = false;
+        m_lastLatency = nowMicros - m_eventMicros;
+        m_maxLatency = Max( m_maxLatency, m_lastLatency );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+unsigned long DoorMonitor::edges() const
+{
+        Hal::InterruptGuard guard;
+        return m_edges;
+}
+
+//------------------------------------------------------------------------------
+// Interrupt context. The first edge after a quiet period starts the latency
+// clock, every edge restarts the debounce window.
+//------------------------------------------------------------------------------
+void DoorMonitor::onEdge( void * context )
+{
+        DoorMonitor & door = *static_cast<DoorMonitor *>( context );
+        if( !door.m_edgePending && (Hal::millis() - door.m_lastEdgeMillis) >= DebounceMs )
+        {
+                door.m_firstEdgeMicros = Hal::micros();
+        }
+        door.m_lastEdgeMillis = Hal::millis();
+        door.m_edgePending = true;
+        door.m_edges++;
+}
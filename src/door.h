@@ -0,0 +1,87 @@
+/*------------------------------------------------------------------------------
+    ()      File: door.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Interrupt driven, debounced door switch.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// The pin interrupt only timestamps edges. The main loop runs the debounce:
+// once no edge has been seen for DebounceMs the pin is read a single time, and
+// if it differs from the last published state one event is raised. The pin is
+// never read while the switch is quiet.
+//
+// Edge timestamps are kept so the time from the first edge of a change to the
+// moment it was acted upon can be measured.
+//------------------------------------------------------------------------------
+class DoorMonitor
+{
+public:
+    static const unsigned long DebounceMs = 20;
+
+    void begin( uint8_t pin );
+
+    // Returns true once per debounced change of state.
+    bool poll( unsigned long now );
+    bool open() const { return m_open; }
+
+    // Call once the change has been acted on, records the edge-to-action time.
+    void acknowledge( unsigned long nowMicros );
+    unsigned long lastLatencyMicros() const { return m_lastLatency; }
+    unsigned long maxLatencyMicros() const { return m_maxLatency; }
+    unsigned long edges() const;
+    unsigned long events() const { return m_events; }
+
+    // Whether poll() still has edges to settle, and how long until it can.
+    bool settling() const { return m_state == Settling || m_edgePending; }
+    unsigned long settleMillis( unsigned long now ) const;
+
+private:
+    static void onEdge( void * context );
+
+    enum State : uint8_t { Stable, Settling };
+
+    uint8_t m_pin = 0;
+    State m_state = Stable;
+    bool m_open = false;
+    bool m_awaitingAck = false;
+
+    unsigned long m_eventMicros = 0;    //first edge of the published change.
+    unsigned long m_lastLatency = 0;
+    unsigned long m_maxLatency = 0;
+    unsigned long m_events = 0;
+
+    //written by the ISR.
+    volatile bool m_edgePending = false;
+    volatile unsigned long m_firstEdgeMicros = 0;
+    volatile unsigned long m_lastEdgeMillis = 0;
+    volatile unsigned long m_edges = 0;
+};
@@ -0,0 +1,314 @@
+/*------------------------------------------------------------------------------
+    ()      File: effects.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              LED effects - door state cross-fades, alert pulses and segments.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include "effects.h"
+#include "utility.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        //------------------------------------------------------------------------------
+        // Gamma 2.2, so fades look even to the eye rather than to the PWM.
+        //------------------------------------------------------------------------------
+        const uint8_t GAMMA[256] PROGMEM =
+        {
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+          3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+          6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+         12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+         20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+         30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+         42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+         56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+         73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+         91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+        113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+        137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+        163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+        192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+        223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+        };
+
+        const Rgb TEST_COLOURS[] PROGMEM = { {255,0,0}, {0,255,0}, {0,0,255}, {255,255,255} };
+        const uint8_t TEST_STEPS = sizeof(TEST_COLOURS) / sizeof(TEST_COLOURS[0]);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool LedEffects::addSegment( uint16_t first, uint16_t count, const Rgb & open, const Rgb & closed )
+{
+        if( m_segmentCount >= MaxSegments || first + count > Hal::LedStrip::Count )
+        {
+                return false;
+        }
+
+        Segment & segment = m_segments[m_segmentCount++];
+        segment.first = first;
+        segment.count = count;
+        segment.open = open;
+        segment.closed = closed;
+        segment.from = { 0, 0, 0 };
+        m_redraw = true;
+        return true;
+}
+
+//------------------------------------------------------------------------------
+// Fades from whatever the segment shows now.
+//------------------------------------------------------------------------------
+void LedEffects::setColours( uint8_t segment, const Rgb & open, const Rgb & closed, unsigned long now )
+{
+        if( segment >= m_segmentCount )
+        {
+                return;
+        }
+
+        setDoor( m_doorOpen, now );
+        m_segments[segment].open = open;
+        m_segments[segment].closed = closed;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void LedEffects::setBrightness( uint8_t brightness )
+{
+        m_brightness = brightness;
+        m_redraw = true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void LedEffects::setLength( uint8_t segment, uint16_t count )
+{
+        if( segment >= m_segmentCount )
+        {
+                return;
+        }
+
+        Segment & changed = m_segments[segment];
+        count = Min<uint16_t>( count, Hal::LedStrip::Count - changed.first );
+        for( uint16_t led=changed.first+count; led<changed.first+changed.count; led++ )
+        {
+                m_strip.setPixel( led, 0, 0, 0 );
+        }
+        changed.count = count;
+        m_redraw = true;
+}
+
+//------------------------------------------------------------------------------
+// A change part way through a fade starts the new one from wherever the old
+// one had got to.
+//------------------------------------------------------------------------------
+void LedEffects::setDoor( bool open, unsigned long now )
+{
+        const uint16_t fade = fadeLevel( now );
+        for( uint8_t i=0; i<m_segmentCount; i++ )
+        {
+                m_segments[i].from = colourAt( m_segments[i], fade );
+        }
+
+        m_doorOpen = open;
+        m_fading = true;
+        m_fadeStart = now;
+        m_redraw = true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void LedEffects::pulse( const Rgb & colour, uint16_t periodMs, unsigned long now )
+{
+        const uint16_t half = Max<uint16_t>( periodMs, 2 * PulseStepMs ) / 2;
+        m_pulseColour = colour;
+        m_pulseSteps = (uint8_t)Min<uint16_t>( half / PulseStepMs, PulseSteps );
+        m_pulseStepMs = half / m_pulseSteps;
+        m_pulseStart = now;
+        m_pulsing = true;
+        m_redraw = true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void LedEffects::stopPulse()
+{
+        m_redraw = m_redraw || m_pulsing;
+        m_pulsing = false;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void LedEffects::testPattern( unsigned long now )
+{
+        m_testing = true;
+        m_testStart = now;
+        m_redraw = true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+unsigned long LedEffects::render( unsigned long now )
+{
+        if( !m_redraw && !m_fading && !m_pulsing && !m_testing )
+        {
+                return Idle;
+        }
+
+        const unsigned long sinceFrame = now - m_lastFrame;
+        if( m_hasFrame && sinceFrame < FrameMs )
+        {
+                return FrameMs - sinceFrame;
+        }
+
+        HAL_PROBE("renderLights");
+        m_hasFrame = true;
+        m_lastFrame = now;
+        m_redraw = false;
+        m_frames++;
+
+        const uint16_t fade = fadeLevel( now );
+        m_fading = fade < 256;
+        const uint16_t pulse = pulseLevel( now );
+
+        const unsigned long testStep = (now - m_testStart) / TestStepMs;
+        m_testing = m_testing && testStep < TEST_STEPS;
+
+        for( uint8_t i=0; i<m_segmentCount; i++ )
+        {
+                const Segment & segment = m_segments[i];
+                Rgb colour = colourAt( segment, fade );
+                if( m_pulsing )
+                {
+                        colour = blend( colour, m_pulseColour, pulse );
+                }
+                if( m_testing )
+                {
+                        memcpy_P( &colour, &TEST_COLOURS[testStep], sizeof(colour) );
+                }
+
+                const uint8_t r = output( colour.r );
+                const uint8_t g = output( colour.g );
+                const uint8_t b = output( colour.b );
+                for( uint16_t led=segment.first; led<segment.first+segment.count; led++ )
+                {
+                        m_strip.setPixel( led, r, g, b );
+                }
+        }
+
+        if( m_strip.changed() )
+        {
+                if( m_strip.busy() )
+                {
+                        //the last frame is still going out, this one goes next frame.
+                        m_redraw = true;
+                }
+                else
+                {
+                        m_strip.show();
+                        m_pushes++;
+                }
+        }
+        unsigned long next = m_fading || m_redraw ? FrameMs : Idle;
+        if( m_pulsing )
+        {
+                next = Min( next, untilPulseStep(now) );
+        }
+        if( m_testing )
+        {
+                //the last step's end, or the next frame.
+                next = Min( next, TestStepMs - (now - m_testStart) % TestStepMs );
+        }
+        return next;
+}
+
+//------------------------------------------------------------------------------
+// 0 at the start of a fade to 256 at the end. Each frame shows where the fade
+// will be when the next is due, so a door change shows on its first frame.
+//------------------------------------------------------------------------------
+uint16_t LedEffects::fadeLevel( unsigned long now ) const
+{
+        const unsigned long elapsed = now - m_fadeStart + FrameMs;
+        if( !m_fading || elapsed >= FadeMs )
+        {
+                return 256;
+        }
+        return (uint16_t)(elapsed * 256 / FadeMs);
+}
+
+//------------------------------------------------------------------------------
+// Stepped triangle wave, 0 to 256 and back once per period. A single step
+// each way is a blink.
+//------------------------------------------------------------------------------
+uint16_t LedEffects::pulseLevel( unsigned long now ) const
+{
+        if( !m_pulsing )
+        {
+                return 0;
+        }
+
+        const uint8_t step = (uint8_t)((now - m_pulseStart) / m_pulseStepMs % (2 * m_pulseSteps));
+        const uint8_t rise = step <= m_pulseSteps ? step : 2 * m_pulseSteps - step;
+        return (uint16_t)((uint16_t)rise * 256 / m_pulseSteps);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+unsigned long LedEffects::untilPulseStep( unsigned long now ) const
+{
+        return m_pulseStepMs - (now - m_pulseStart) % m_pulseStepMs;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+Rgb LedEffects::colourAt( const Segment & segment, uint16_t fade ) const
+{
+        return blend( segment.from, m_doorOpen ? segment.open : segment.closed, fade );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint8_t LedEffects::output( uint8_t channel ) const
+{
+        const uint8_t scaled = (uint8_t)(((uint16_t)channel * (m_brightness + 1)) >> 8);
+        return pgm_read_byte( &GAMMA[scaled] );
+}
+
+//------------------------------------------------------------------------------
+// amount is 0..256, the products stay within 16 bits.
+//------------------------------------------------------------------------------
+Rgb LedEffects::blend( const Rgb & from, const Rgb & to, uint16_t amount )
+{
+        const uint16_t keep = 256 - amount;
+        Rgb mixed;
+        mixed.r = (uint8_t)(((uint16_t)from.r * keep + (uint16_t)to.r * amount) >> 8);
+        mixed.g = (uint8_t)(((uint16_t)from.g * keep + (uint16_t)to.g * amount) >> 8);
+        mixed.b = (uint8_t)(((uint16_t)from.b * keep + (uint16_t)to.b * amount) >> 8);
+        return mixed;
+}
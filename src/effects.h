@@ -0,0 +1,133 @@
+/*------------------------------------------------------------------------------
+    ()      File: effects.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              LED effects - door state cross-fades, alert pulses and segments.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include "hal.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+struct Rgb
+{
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+
+//------------------------------------------------------------------------------
+// Renders the strip from a little state rather than from whoever last called
+// setPixel. Each segment has a colour for the door open and one for it shut,
+// a door change cross-fades between them over FadeMs, and an alert pulse can
+// be laid over the top. All mixing is 8.8 fixed point, then the global
+// brightness and a gamma table in flash.
+//
+// Frames are rendered at most once per FrameMs and pushed only if a pixel
+// actually changed. A push holds interrupts off for about 1.5ms on the AVR,
+// so a steady strip costs nothing. An alert pulse moves in steps of at least
+// PulseStepMs, at most PulseSteps each way, and is only rendered when it
+// steps: a few pushes a second rather than one every frame.
+//------------------------------------------------------------------------------
+class LedEffects
+{
+public:
+    static const uint8_t MaxSegments = 2;
+    static const unsigned long FrameMs = 25;
+    static const unsigned long FadeMs = 400;
+    static const uint16_t PulseStepMs = 200;
+    static const uint8_t PulseSteps = 8;
+    static const unsigned long TestStepMs = 750;
+    static const unsigned long Idle = 0xFFFFFFFFUL;
+
+    explicit LedEffects( Hal::LedStrip & strip ) : m_strip( strip ) {}
+
+    bool addSegment( uint16_t first, uint16_t count, const Rgb & open, const Rgb & closed );
+    void setColours( uint8_t segment, const Rgb & open, const Rgb & closed, unsigned long now );
+    void setBrightness( uint8_t brightness );
+
+    // Shortens or lengthens a segment, pixels it gives up are left dark.
+    void setLength( uint8_t segment, uint16_t count );
+
+    void setDoor( bool open, unsigned long now );
+    void pulse( const Rgb & colour, uint16_t periodMs, unsigned long now );
+    void stopPulse();
+
+    // Every segment red, green, blue then white, TestStepMs each, then back
+    // to whatever it was showing.
+    void testPattern( unsigned long now );
+
+    // Renders and pushes a frame if one is due. Returns the ms until the next
+    // frame is wanted, or Idle once nothing is animating.
+    unsigned long render( unsigned long now );
+
+    unsigned long frames() const { return m_frames; }
+    unsigned long pushes() const { return m_pushes; }
+
+private:
+    struct Segment
+    {
+        uint16_t first;
+        uint16_t count;
+        Rgb open;
+        Rgb closed;
+        Rgb from;       //colour the current fade started at.
+    };
+
+    uint16_t fadeLevel( unsigned long now ) const;
+    uint16_t pulseLevel( unsigned long now ) const;
+    unsigned long untilPulseStep( unsigned long now ) const;
+    Rgb colourAt( const Segment & segment, uint16_t fade ) const;
+    uint8_t output( uint8_t channel ) const;
+
+    static Rgb blend( const Rgb & from, const Rgb & to, uint16_t amount );
+
+    Hal::LedStrip & m_strip;
+    Segment m_segments[MaxSegments];
+    uint8_t m_segmentCount = 0;
+    uint8_t m_brightness = 255;
+    bool m_doorOpen = false;
+    bool m_redraw = true;
+
+    bool m_fading = false;
+    unsigned long m_fadeStart = 0;
+
+    bool m_pulsing = false;
+    Rgb m_pulseColour = { 0, 0, 0 };
+    uint16_t m_pulseStepMs = 0;
+    uint8_t m_pulseSteps = 0;           //each way, from dark to the colour.
+    unsigned long m_pulseStart = 0;
+
+    bool m_testing = false;
+    unsigned long m_testStart = 0;
+
+    bool m_hasFrame = false;
+    unsigned long m_lastFrame = 0;
+    unsigned long m_frames = 0;
+    unsigned long m_pushes = 0;
+};
@@ -0,0 +1,141 @@
+/*------------------------------------------------------------------------------
+    ()      File: format.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Allocation free fixed-point text formatting.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include "format.h"
+#include "hal.h"
+#include "utility.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+FieldWriter::FieldWriter( char * begin, uint8_t length )
+        : m_begin( begin )
+        , m_cursor( begin )
+        , m_end( begin + length )
+{}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+FieldWriter & FieldWriter::text( const char * str )
+{
+        while( *str != '\0' && m_cursor < m_end )
+        {
+                *m_cursor++ = *str++;
+        }
+        return *this;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+FieldWriter & FieldWriter::text_P( const char * str )
+{
+        char c;
+        while( (c = (char)pgm_read_byte(str++)) != '\0' && m_cursor < m_end )
+        {
+                *m_cursor++ = c;
+        }
+        return *this;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+FieldWriter & FieldWriter::character( char c )
+{
+        if( m_cursor < m_end )
+        {
+                *m_cursor++ = c;
+        }
+        return *this;
+}
+
+//------------------------------------------------------------------------------
+// Digits are produced least significant first into a scratch buffer, then
+// copied out behind the sign and padding. Decimals beyond what the buffer
+// holds beside the point and a units digit are truncated.
+//------------------------------------------------------------------------------
+FieldWriter & FieldWriter::fixed( int32_t scaled, uint8_t decimals, uint8_t width, char pad )
+{
+        char digits[12];
+        uint8_t count = 0;
+        const uint8_t dropped = decimals - Min<uint8_t>( decimals, sizeof(digits) - 2 );
+
+        const bool negative = scaled < 0;
+        uint32_t magnitude = negative ? (uint32_t)0 - (uint32_t)scaled : (uint32_t)scaled;
+
+        for( uint8_t place=0; place<decimals; place++ )
+        {
+                if( place >= dropped )
+                {
+                        digits[count++] = '0' + (char)(magnitude % 10);
+                }
+                magnitude /= 10;
+        }
+        if( decimals != 0 )
+        {
+                digits[count++] = '.';
+        }
+        do
+        {
+                digits[count++] = '0' + (char)(magnitude % 10);
+                magnitude /= 10;
+        } while( magnitude != 0 && count < sizeof(digits) );
+
+        const uint8_t length = count + (negative ? 1 : 0);
+        uint8_t padding = width > length ? width - length : 0;
+
+        if( pad != '0' )
+        {
+                for( ; padding != 0; padding-- ) character( pad );
+        }
+        if( negative )
+        {
+                character( '-' );
+        }
+        for( ; padding != 0; padding-- ) character( '0' );
+
+        while( count != 0 )
+        {
+                character( digits[--count] );
+        }
+        return *this;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int32_t FieldWriter::toFixed( float value, uint8_t decimals )
+{
+        for( uint8_t place=0; place<decimals; place++ )
+        {
+                value *= 10.0f;
+        }
+        return (int32_t)(value < 0.0f ? value - 0.5f : value + 0.5f);
+}
@@ -0,0 +1,65 @@
+/*------------------------------------------------------------------------------
+    ()      File: format.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Allocation free fixed-point text formatting, writing straight
+              into a caller's buffer. Replaces sprintf for sensor readouts.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Fixed-point values are plain integers scaled by 10^decimals, so 23.45*C is
+// fixed(2345, 2, ...). Nothing is written past the end of the field and no
+// terminator is added; the field is expected to be pre-filled.
+//------------------------------------------------------------------------------
+class FieldWriter
+{
+public:
+    FieldWriter( char * begin, uint8_t length );
+
+    FieldWriter & text( const char * str );
+    FieldWriter & text_P( const char * str );       //str in flash, as PSTR().
+    FieldWriter & character( char c );
+
+    // Right-aligned in at least width characters, like printf's "%*.*f".
+    // A '0' pad goes after the sign, as with the 0 flag.
+    FieldWriter & fixed( int32_t scaled, uint8_t decimals, uint8_t width, char pad = ' ' );
+    FieldWriter & integer( int32_t value, uint8_t width, char pad = ' ' ) { return fixed(value, 0, width, pad); }
+
+    uint8_t written() const { return (uint8_t)(m_cursor - m_begin); }
+
+    // Rounds half away from zero, the one float step left for float sources.
+    static int32_t toFixed( float value, uint8_t decimals );
+
+private:
+    char * m_begin;
+    char * m_cursor;
+    char * m_end;
+};
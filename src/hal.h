@@ -0,0 +1,288 @@
+/*------------------------------------------------------------------------------
+    ()      File: hal.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Thin hardware abstraction layer. Maps the clock, GPIO, I2C, LED
+              strip, serial and peripheral drivers either onto the Arduino
+              framework or onto the simulated back-ends of the native build.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include "pinconfig.h"
+
+#if defined(IS_NATIVE_BUILD)
+#include "native/sim.h"
+#else
+#include <Arduino.h>
+#include <Wire.h>
+#include <Adafruit_BME680.h>
+#include <LiquidCrystal_I2C.h>
+#if defined(IS_BLUEPILL_BUILD)
+#include "ws2812.h"
+#elif defined(IS_NANO_BUILD)
+#include <FastLED.h>
+#endif //defined(IS_NANO_BUILD)
+#endif //defined(IS_NATIVE_BUILD)
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Native builds time each probed scope against the virtual clock. Builds with
+// PROFILING also feed the firmware's own counters, which can be read back
+// from a running cabinet. Without either the probe compiles away.
+//------------------------------------------------------------------------------
+#define HAL_PROBE_CONCAT_(a,b) a##b
+#define HAL_PROBE_CONCAT(a,b) HAL_PROBE_CONCAT_(a,b)
+
+#if defined(PROFILING)
+#include "profiler.h"
+#define HAL_PROFILE(name) Profiler::Scope HAL_PROBE_CONCAT(_halProfile, __LINE__)(name)
+#else
+#define HAL_PROFILE(name)
+#endif //defined(PROFILING)
+
+#if defined(IS_NATIVE_BUILD)
+#define HAL_PROBE(name) Sim::Probe HAL_PROBE_CONCAT(_halProbe, __LINE__)(name); HAL_PROFILE(name)
+#else
+#define HAL_PROBE(name) HAL_PROFILE(name)
+#endif //defined(IS_NATIVE_BUILD)
+
+//------------------------------------------------------------------------------
+// Flash - tables and literals the AVR keeps out of SRAM, read in place
+// elsewhere.
+//------------------------------------------------------------------------------
+#if defined(IS_NATIVE_BUILD)
+#define PROGMEM
+#define PSTR(str) (str)
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define memcpy_P(dest, src, n) memcpy((dest), (src), (n))
+#define strcmp_P(str, flashStr) strcmp((str), (flashStr))
+#endif //defined(IS_NATIVE_BUILD)
+
+namespace Hal
+{
+//------------------------------------------------------------------------------
+// Devices
+//------------------------------------------------------------------------------
+#if defined(IS_NATIVE_BUILD)
+    using I2CBus = Sim::I2CBus;
+    using GasSensor = Sim::BME680;
+    using Lcd = Sim::Lcd;
+#else
+    using I2CBus = TwoWire;
+    using GasSensor = Adafruit_BME680;
+    using Lcd = LiquidCrystal_I2C;
+#endif //defined(IS_NATIVE_BUILD)
+
+//------------------------------------------------------------------------------
+// Clock
+//------------------------------------------------------------------------------
+    unsigned long millis();
+    unsigned long micros();
+    void delay( unsigned long ms );
+
+//------------------------------------------------------------------------------
+// Sleep - idles the core for up to ms, returning early on the door interrupt,
+// serial input or a wake() from an ISR. The timers keep running so millis()
+// stays right across it: AVR idle mode with Timer0 ticking, WFI with SysTick
+// on the Blue Pill, the virtual clock up to the next pin edge natively. The
+// AVR's power-save mode would stop Timer0, the Nano has no 32kHz crystal to
+// keep time on Timer2.
+//------------------------------------------------------------------------------
+    void idle( unsigned long ms );
+    void wake();
+
+//------------------------------------------------------------------------------
+// Profiling Clock - the DWT cycle counter on the Blue Pill, micros() on the
+// Nano (4us steps) and the virtual clock natively. Ticks wrap, only ever
+// convert a difference.
+//------------------------------------------------------------------------------
+    void profileClockBegin();
+    uint32_t profileTicks();
+    uint32_t profileTicksToMicros( uint32_t ticks );
+
+//------------------------------------------------------------------------------
+// GPIO
+//------------------------------------------------------------------------------
+    void pinModeInputPullup( uint8_t pin );
+    bool digitalRead( uint8_t pin );
+
+//------------------------------------------------------------------------------
+// Interrupts - pin change on the Nano, EXTI on the Blue Pill. The handler runs
+// in interrupt context on both edges. One pin per board.
+//------------------------------------------------------------------------------
+    using PinChangeHandler = void (*)( void * context );
+    void attachPinChange( uint8_t pin, PinChangeHandler handler, void * context );
+
+    // Masks interrupts for its lifetime, for reading state an ISR writes.
+    class InterruptGuard
+    {
+    public:
+        InterruptGuard();
+        ~InterruptGuard();
+
+    private:
+#if defined(IS_NANO_BUILD)
+        uint8_t m_sreg;
+#endif //defined(IS_NANO_BUILD)
+    };
+
+//------------------------------------------------------------------------------
+// Serial
+//------------------------------------------------------------------------------
+    void serialBegin( unsigned long baud );
+    int serialAvailableForWrite();
+    size_t serialWrite( const uint8_t * data, size_t length );
+    int serialAvailable();
+    int serialRead();                                       //-1 when nothing has arrived.
+
+//------------------------------------------------------------------------------
+// Storage - non-volatile pages kept to flash rules on every board: erasing
+// sets a page to 0xFF, and programming only ever writes over erased bytes, in
+// whole ProgramUnits. EEPROM on the Nano, the top 4KB of flash on the Blue
+// Pill and a file natively.
+//
+// Nothing waits on the cells. While ready() is false a write is still in
+// progress, or on the Blue Pill an LED frame is going out; program() and
+// erase() each do what they can without waiting and return how far they got,
+// so the caller comes back on a later pass.
+//------------------------------------------------------------------------------
+#if defined(IS_NATIVE_BUILD)
+    using Storage = Sim::Storage;
+#else
+    class Storage
+    {
+    public:
+#if defined(IS_BLUEPILL_BUILD)
+        static const uint16_t PageSize = 1024;
+        static const uint8_t Pages = 4;
+        static const uint8_t ProgramUnit = 2;
+#elif defined(IS_NANO_BUILD)
+        static const uint16_t PageSize = 64;
+        static const uint8_t Pages = 16;
+        static const uint8_t ProgramUnit = 1;
+#endif //defined(IS_NANO_BUILD)
+
+        bool ready() const;
+        void read( uint8_t page, uint16_t offset, uint8_t * out, uint16_t length ) const;
+
+        // Return the bytes written, or the offset erased up to.
+        uint16_t program( uint8_t page, uint16_t offset, const uint8_t * data, uint16_t length );
+        uint16_t erase( uint8_t page, uint16_t offset );
+    };
+#endif //defined(IS_NATIVE_BUILD)
+
+//------------------------------------------------------------------------------
+// LED Strip - one API over FastLED (Nano), SPI driven by DMA (Blue Pill) and
+// the sim. Colours are always given as r, g, b, each back-end deals with wire
+// order.
+//
+// FastLED and the sim send the strip before show() returns. The Blue Pill
+// copies the pixels and returns at once, the DMA interrupt encoding them a few
+// LEDs at a time while loop() carries on; busy() until the latch is over, and
+// show() must not be called until then.
+//------------------------------------------------------------------------------
+    class LedStrip
+    {
+    public:
+        static const uint16_t Count = LEDCOUNT;
+
+        void begin();
+        void setPixel( uint16_t led, uint8_t r, uint8_t g, uint8_t b );
+        void show();
+
+        // Whether any pixel differs from what was last shown.
+        bool changed() const { return m_changed; }
+
+#if defined(IS_BLUEPILL_BUILD)
+        bool busy() const { return m_busy; }
+
+        // From the DMA interrupt, once the given half of the ring has gone.
+        void transferred( uint8_t half );
+#else
+        bool busy() const { return false; }
+#endif //defined(IS_BLUEPILL_BUILD)
+
+    private:
+        bool m_changed = true;
+
+#if defined(IS_BLUEPILL_BUILD)
+        uint8_t m_pixels[Count * 3];                        //g, r, b as sent.
+        uint8_t m_sending[Count * 3];
+        uint8_t m_ring[Ws2812Stream::RingSize];
+        Ws2812Stream m_stream;
+        volatile bool m_busy = false;
+#elif defined(IS_NANO_BUILD)
+        CRGB m_pixels[Count];
+#elif defined(IS_NATIVE_BUILD)
+        Sim::LedStrip m_strip = Sim::LedStrip(Count);
+#endif //defined(IS_NATIVE_BUILD)
+    };
+}
+
+//------------------------------------------------------------------------------
+// Clock, GPIO and serial are forwarded straight to the framework on hardware.
+//------------------------------------------------------------------------------
+#if !defined(IS_NATIVE_BUILD)
+inline unsigned long Hal::millis()                          { return ::millis(); }
+inline unsigned long Hal::micros()                          { return ::micros(); }
+inline void Hal::delay( unsigned long ms )                  { ::delay(ms); }
+inline void Hal::pinModeInputPullup( uint8_t pin )          { ::pinMode(pin, INPUT_PULLUP); }
+inline bool Hal::digitalRead( uint8_t pin )                 { return ::digitalRead(pin) != LOW; }
+inline void Hal::serialBegin( unsigned long baud )          { Serial.begin(baud); }
+inline int Hal::serialAvailableForWrite()                   { return Serial.availableForWrite(); }
+inline size_t Hal::serialWrite( const uint8_t * data, size_t length ) { return Serial.write(data, length); }
+inline int Hal::serialAvailable()                           { return Serial.available(); }
+inline int Hal::serialRead()                                { return Serial.read(); }
+#endif //!defined(IS_NATIVE_BUILD)
+
+#if defined(IS_BLUEPILL_BUILD)
+inline void Hal::profileClockBegin()
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+inline uint32_t Hal::profileTicks()                         { return DWT->CYCCNT; }
+inline uint32_t Hal::profileTicksToMicros( uint32_t ticks ) { return ticks / (F_CPU / 1000000); }
+#else
+inline void Hal::profileClockBegin()                        {}
+inline uint32_t Hal::profileTicks()                         { return (uint32_t)Hal::micros(); }
+inline uint32_t Hal::profileTicksToMicros( uint32_t ticks ) { return ticks; }
+#endif //defined(IS_BLUEPILL_BUILD)
+
+#if defined(IS_NANO_BUILD)
+inline Hal::InterruptGuard::InterruptGuard() : m_sreg( SREG ) { cli(); }
+inline Hal::InterruptGuard::~InterruptGuard()               { SREG = m_sreg; }
+#elif defined(IS_BLUEPILL_BUILD)
+inline Hal::InterruptGuard::InterruptGuard()                { noInterrupts(); }
+inline Hal::InterruptGuard::~InterruptGuard()               { interrupts(); }
+#elif defined(IS_NATIVE_BUILD)
+inline Hal::InterruptGuard::InterruptGuard()                {}
+inline Hal::InterruptGuard::~InterruptGuard()               {}
+#endif //defined(IS_NATIVE_BUILD)
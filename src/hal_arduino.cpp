@@ -0,0 +1,380 @@
+/*------------------------------------------------------------------------------
+    ()      File: hal_arduino.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Arduino framework implementation of the hardware abstraction
+              layer. Not compiled into the native build.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include "hal.h"
+#if defined(IS_NANO_BUILD)
+#include <avr/sleep.h>
+#include <avr/eeprom.h>
+#endif //defined(IS_NANO_BUILD)
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Sleep
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+namespace
+{
+        volatile bool s_woken = false;
+}
+
+//------------------------------------------------------------------------------
+// Every interrupt wakes the core, Timer0 or SysTick once a millisecond, and
+// only those that set s_woken or bring serial input end the idle. The flag is
+// tested with interrupts masked: on the AVR the instruction after sei always
+// runs, and WFI wakes on a pending interrupt even while masked, so a wake
+// landing between the test and the sleep is never lost.
+//------------------------------------------------------------------------------
+void Hal::idle( unsigned long ms )
+{
+        const unsigned long start = ::millis();
+        s_woken = false;
+#if defined(IS_NANO_BUILD)
+        set_sleep_mode( SLEEP_MODE_IDLE );
+#endif //defined(IS_NANO_BUILD)
+
+        while( ::millis() - start < ms && Serial.available() == 0 )
+        {
+                noInterrupts();
+                if( s_woken )
+                {
+                        interrupts();
+                        break;
+                }
+#if defined(IS_NANO_BUILD)
+                sleep_enable();
+                interrupts();
+                sleep_cpu();
+                sleep_disable();
+#elif defined(IS_BLUEPILL_BUILD)
+                __WFI();
+                interrupts();
+#endif //defined(IS_BLUEPILL_BUILD)
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Hal::wake()
+{
+        s_woken = true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Interrupts
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// The board has a single pin change user, kept with the context it gave.
+//------------------------------------------------------------------------------
+namespace
+{
+        volatile Hal::PinChangeHandler s_pinChangeHandler = nullptr;
+        void * volatile s_pinChangeContext = nullptr;
+
+        void onPinChange()
+        {
+                if( s_pinChangeHandler ) s_pinChangeHandler( s_pinChangeContext );
+                Hal::wake();
+        }
+}
+
+#if defined(IS_NANO_BUILD)
+//------------------------------------------------------------------------------
+// attachInterrupt only reaches pins 2 and 3 on the 328, so use the pin change
+// group the pin belongs to. Only one pin is ever enabled, so every group
+// vector can share the handler.
+//------------------------------------------------------------------------------
+void Hal::attachPinChange( uint8_t pin, PinChangeHandler handler, void * context )
+{
+        InterruptGuard guard;
+        s_pinChangeHandler = handler;
+        s_pinChangeContext = context;
+        *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+        PCIFR = _BV(digitalPinToPCICRbit(pin));
+        PCICR |= _BV(digitalPinToPCICRbit(pin));
+}
+
+ISR(PCINT0_vect) { onPinChange(); }
+ISR(PCINT1_vect, ISR_ALIASOF(PCINT0_vect));
+ISR(PCINT2_vect, ISR_ALIASOF(PCINT0_vect));
+
+#elif defined(IS_BLUEPILL_BUILD)
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Hal::attachPinChange( uint8_t pin, PinChangeHandler handler, void * context )
+{
+        {
+                InterruptGuard guard;
+                s_pinChangeHandler = handler;
+                s_pinChangeContext = context;
+        }
+        attachInterrupt(digitalPinToInterrupt(pin), onPinChange, CHANGE);
+}
+#endif //defined(IS_BLUEPILL_BUILD)
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Storage
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#if defined(IS_NANO_BUILD)
+//------------------------------------------------------------------------------
+// An EEPROM byte takes 3.3ms to write, so one is started per call and the
+// hardware finishes it while loop() carries on. Bytes already holding the
+// value cost nothing and are passed over in the same call.
+//------------------------------------------------------------------------------
+bool Hal::Storage::ready() const
+{
+        return eeprom_is_ready();
+}
+
+void Hal::Storage::read( uint8_t page, uint16_t offset, uint8_t * out, uint16_t length ) const
+{
+        eeprom_read_block( out, (const void *)(page * PageSize + offset), length );
+}
+
+uint16_t Hal::Storage::program( uint8_t page, uint16_t offset, const uint8_t * data, uint16_t length )
+{
+        uint8_t * address = (uint8_t *)(page * PageSize + offset);
+        for( uint16_t i=0; i<length; i++ )
+        {
+                if( eeprom_read_byte(address + i) != data[i] )
+                {
+                        eeprom_write_byte( address + i, data[i] );
+                        return i + 1;
+                }
+        }
+        return length;
+}
+
+uint16_t Hal::Storage::erase( uint8_t page, uint16_t offset )
+{
+        uint8_t * address = (uint8_t *)(page * PageSize);
+        while( offset < PageSize && eeprom_read_byte(address + offset) == 0xFF )
+        {
+                offset++;
+        }
+        if( offset < PageSize )
+        {
+                eeprom_write_byte( address + offset++, 0xFF );
+        }
+        return offset;
+}
+
+#elif defined(IS_BLUEPILL_BUILD)
+//------------------------------------------------------------------------------
+// Flash is memory mapped for reading. A halfword programs in about 50us and a
+// page erases in about 20ms, both stall the core, so they are simply done.
+// The core's HAL does the unlocking and waits for each to finish.
+//
+// Nothing else runs meanwhile, the LED strip's DMA interrupt included, and
+// its ring needs refilling every 256us. So the flash waits out any frame
+// that is going out, and no frame can start until the flash is done.
+//------------------------------------------------------------------------------
+namespace
+{
+        //the last pages of the 64KB part, 0x0800F000. The image is kept below
+        //them by board_upload.maximum_size in platformio.ini.
+        const uint32_t STORAGE_BASE = 0x08010000 - Hal::Storage::Pages * Hal::Storage::PageSize;
+        static_assert( STORAGE_BASE == 0x0800F000, "platformio.ini caps the image at 0x0800F000, move both together" );
+
+        Hal::LedStrip * volatile s_ledStrip = nullptr;     //set by its begin().
+}
+
+bool Hal::Storage::ready() const
+{
+        return s_ledStrip == nullptr || !s_ledStrip->busy();
+}
+
+void Hal::Storage::read( uint8_t page, uint16_t offset, uint8_t * out, uint16_t length ) const
+{
+        memcpy( out, (const void *)(STORAGE_BASE + page * PageSize + offset), length );
+}
+
+uint16_t Hal::Storage::program( uint8_t page, uint16_t offset, const uint8_t * data, uint16_t length )
+{
+        const uint32_t address = STORAGE_BASE + page * PageSize + offset;
+        HAL_FLASH_Unlock();
+        for( uint16_t i=0; i<length; i+=2 )
+        {
+                //an odd last byte is paired with an erased one, so it is still written.
+                const uint8_t high = i + 1 < length ? data[i+1] : 0xFF;
+                HAL_FLASH_Program( FLASH_TYPEPROGRAM_HALFWORD, address + i, (uint16_t)(data[i] | (high << 8)) );
+        }
+        HAL_FLASH_Lock();
+        return length;
+}
+
+uint16_t Hal::Storage::erase( uint8_t page, uint16_t offset )
+{
+        (void)offset;
+        FLASH_EraseInitTypeDef pages = {};
+        pages.TypeErase = FLASH_TYPEERASE_PAGES;
+        pages.PageAddress = STORAGE_BASE + page * PageSize;
+        pages.NbPages = 1;
+
+        uint32_t failedPage;
+        HAL_FLASH_Unlock();
+        HAL_FLASHEx_Erase( &pages, &failedPage );
+        HAL_FLASH_Lock();
+        return PageSize;
+}
+#endif //defined(IS_BLUEPILL_BUILD)
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// LED Strip
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#if defined(IS_BLUEPILL_BUILD)
+//------------------------------------------------------------------------------
+// SPI1 sends on PA7 at 72MHz / 32 = Ws2812Stream::SpiHz, fed by DMA1 channel 3 running round the
+// ring in circular mode. Its half and full transfer interrupts each hand back
+// the half just sent for refilling, about every 256us while a frame is out.
+//------------------------------------------------------------------------------
+extern "C" void DMA1_Channel3_IRQHandler()
+{
+        const uint32_t flags = DMA1->ISR;
+        DMA1->IFCR = DMA_IFCR_CGIF3;
+        if( flags & DMA_ISR_HTIF3 ) s_ledStrip->transferred( 0 );
+        if( flags & DMA_ISR_TCIF3 ) s_ledStrip->transferred( 1 );
+}
+
+void Hal::LedStrip::begin()
+{
+        s_ledStrip = this;
+        memset( m_pixels, 0, sizeof(m_pixels) );
+
+        RCC->APB2ENR |= RCC_APB2ENR_SPI1EN | RCC_APB2ENR_IOPAEN;
+        RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+
+        //PA7 alternate function push-pull.
+        GPIOA->CRL = (GPIOA->CRL & ~(0xFu << 28)) | (0xBu << 28);
+
+        //transmit only master, software slave select, clock / 32.
+        SPI1->CR1 = SPI_CR1_BIDIMODE | SPI_CR1_BIDIOE | SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI | SPI_CR1_BR_2;
+        SPI1->CR2 = SPI_CR2_TXDMAEN;
+        SPI1->CR1 |= SPI_CR1_SPE;
+
+        DMA1_Channel3->CCR = 0;
+        DMA1_Channel3->CPAR = (uint32_t)&SPI1->DR;
+        DMA1_Channel3->CMAR = (uint32_t)m_ring;
+        DMA1_Channel3->CCR = DMA_CCR_PL_1 | DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_DIR | DMA_CCR_HTIE | DMA_CCR_TCIE;
+        NVIC_SetPriority( DMA1_Channel3_IRQn, 2 );
+        NVIC_EnableIRQ( DMA1_Channel3_IRQn );
+
+        show();
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Hal::LedStrip::setPixel( uint16_t led, uint8_t r, uint8_t g, uint8_t b )
+{
+        uint8_t * pixel = &m_pixels[led * 3];
+        if( pixel[0] != g || pixel[1] != r || pixel[2] != b )
+        {
+                pixel[0] = g;
+                pixel[1] = r;
+                pixel[2] = b;
+                m_changed = true;
+        }
+}
+
+//------------------------------------------------------------------------------
+// The copy lets setPixel() carry on while the frame goes out, and is the only
+// part of the send that grows with the strip, about 3us per hundred LEDs.
+//------------------------------------------------------------------------------
+void Hal::LedStrip::show()
+{
+        if( m_busy )
+        {
+                return;
+        }
+
+        memcpy( m_sending, m_pixels, sizeof(m_sending) );
+        m_stream.start( m_sending, Count, m_ring );
+        m_changed = false;
+        m_busy = true;
+
+        DMA1->IFCR = DMA_IFCR_CGIF3;
+        DMA1_Channel3->CNDTR = sizeof(m_ring);
+        DMA1_Channel3->CCR |= DMA_CCR_EN;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Hal::LedStrip::transferred( uint8_t half )
+{
+        if( !m_busy )
+        {
+                return;
+        }
+
+        if( !m_stream.refill(&m_ring[half * Ws2812Stream::HalfSize]) )
+        {
+                DMA1_Channel3->CCR &= ~DMA_CCR_EN;
+                m_busy = false;
+        }
+}
+
+#elif defined(IS_NANO_BUILD)
+//------------------------------------------------------------------------------
+// FastLED bit-bangs the strip with interrupts off, 30us per LED.
+//------------------------------------------------------------------------------
+void Hal::LedStrip::begin()
+{
+        FastLED.addLeds<NEOPIXEL, LEDPIN>(m_pixels, Count);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Hal::LedStrip::setPixel( uint16_t led, uint8_t r, uint8_t g, uint8_t b )
+{
+        const CRGB colour(r,g,b);
+        if( m_pixels[led] != colour )
+        {
+                m_pixels[led] = colour;
+                m_changed = true;
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Hal::LedStrip::show()
+{
+        FastLED.show();
+        m_changed = false;
+}
+#endif //defined(IS_NANO_BUILD)
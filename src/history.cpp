@@ -0,0 +1,180 @@
+/*------------------------------------------------------------------------------
+    ()      File: history.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Compact sensor history with rolling window statistics.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include "history.h"
+#include "utility.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        //------------------------------------------------------------------------------
+        // Signed division rounding half away from zero.
+        //------------------------------------------------------------------------------
+        int32_t divideRounded( int32_t numerator, int32_t denominator )
+        {
+                if( denominator < 0 )
+                {
+                        numerator = -numerator;
+                        denominator = -denominator;
+                }
+                return (numerator >= 0 ? numerator + denominator / 2 : numerator - denominator / 2) / denominator;
+        }
+
+        //------------------------------------------------------------------------------
+        // Buckets per window are fixed, so the window length sets the bucket size.
+        //------------------------------------------------------------------------------
+        const uint16_t WINDOW_SECONDS[SensorHistory::MAX_WINDOW] = { 60, 600 };
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// TrendWindow
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void TrendWindow::add( int16_t value, uint16_t seconds )
+{
+        //a sample held across a bucket boundary counts towards both buckets.
+        do
+        {
+                if( m_seconds == 0 )
+                {
+                        m_bucketMin = value;
+                        m_bucketMax = value;
+                }
+                else
+                {
+                        m_bucketMin = Min( m_bucketMin, value );
+                        m_bucketMax = Max( m_bucketMax, value );
+                }
+
+                const uint16_t taken = Min<uint16_t>( seconds, m_bucketSeconds - m_seconds );
+                m_sum += (int32_t)value * taken;
+                m_seconds += taken;
+                seconds -= taken;
+                if( m_seconds >= m_bucketSeconds )
+                {
+                        closeBucket();
+                }
+        }
+        while( seconds != 0 );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void TrendWindow::closeBucket()
+{
+        if( m_count == Buckets )
+        {
+                m_oldest = (m_oldest + 1) % Buckets;
+                m_count--;
+        }
+
+        Bucket & bucket = m_buckets[(m_oldest + m_count) % Buckets];
+        bucket.mean = (int16_t)divideRounded( m_sum, m_seconds );
+        bucket.min = m_bucketMin;
+        bucket.max = m_bucketMax;
+        m_count++;
+
+        m_sum = 0;
+        m_seconds = 0;
+}
+
+//------------------------------------------------------------------------------
+// Least squares over the bucket means, x in buckets, scaled to per minute.
+// The extremes take the open bucket in as it fills.
+//------------------------------------------------------------------------------
+TrendStats TrendWindow::stats() const
+{
+        int32_t sumY = 0;
+        int32_t sumXY = 0;
+        int16_t low = m_seconds != 0 ? m_bucketMin : INT16_MAX;
+        int16_t high = m_seconds != 0 ? m_bucketMax : INT16_MIN;
+        for( uint8_t x=0; x<m_count; x++ )
+        {
+                const Bucket & bucket = m_buckets[(m_oldest + x) % Buckets];
+                sumY += bucket.mean;
+                sumXY += (int32_t)x * bucket.mean;
+                low = Min( low, bucket.min );
+                high = Max( high, bucket.max );
+        }
+
+        const int32_t n = m_count;
+        const int32_t sumX = n * (n - 1) / 2;
+        const int32_t sumXX = (n - 1) * n * (2 * n - 1) / 6;
+        const int32_t denominator = n * sumXX - sumX * sumX;
+
+        TrendStats stats;
+        if( m_count == 0 && m_seconds == 0 )
+        {
+                return stats;
+        }
+        stats.buckets = m_count;
+        stats.mean = m_count == 0 ? 0 : (int16_t)divideRounded( sumY, n );
+        stats.min = low;
+        stats.max = high;
+        stats.slopePerMinute = denominator == 0 ? 0
+                : (int16_t)divideRounded( (n * sumXY - sumX * sumY) * 60, denominator * m_bucketSeconds );
+        return stats;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// SensorHistory
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+SensorHistory::SensorHistory()
+{
+        for( uint8_t series=0; series<MAX_SERIES; series++ )
+        {
+                for( uint8_t window=0; window<MAX_WINDOW; window++ )
+                {
+                        m_windows[series][window].configure( WINDOW_SECONDS[window] / TrendWindow::Buckets );
+                }
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void SensorHistory::add( int16_t deciDegrees, int16_t airQualityPermille, uint16_t seconds )
+{
+        for( uint8_t window=0; window<MAX_WINDOW; window++ )
+        {
+                m_windows[Temperature][window].add( deciDegrees, seconds );
+                m_windows[AirQuality][window].add( airQualityPermille, seconds );
+        }
+}
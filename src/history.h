@@ -0,0 +1,111 @@
+/*------------------------------------------------------------------------------
+    ()      File: history.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Compact sensor history with rolling min/max/mean/slope over the
+              last minute, ten minutes and hour.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Window statistics, in the units of the series (deci-degrees, permille).
+//------------------------------------------------------------------------------
+struct TrendStats
+{
+    int16_t min = 0;
+    int16_t max = 0;
+    int16_t mean = 0;
+    int16_t slopePerMinute = 0;
+    uint8_t buckets = 0;        //completed buckets the mean and slope cover.
+};
+
+//------------------------------------------------------------------------------
+// A window of Buckets consecutive buckets, each summarising bucketSeconds of
+// samples as its mean, min and max, kept whole so a jump is never clipped.
+// The mean and slope are over the completed buckets and move once a bucket
+// closes, the window's whole length behind at most a bucket. Min and max
+// also take in the bucket being filled, so a spike shows as soon as it is
+// read. Nothing is cached, stats() scans the few buckets that are kept.
+//------------------------------------------------------------------------------
+class TrendWindow
+{
+public:
+    static const uint8_t Buckets = 4;
+
+    // Each sample is weighted by the seconds it stands for, so a bucket always
+    // spans bucketSeconds however often the sensor is read.
+    void configure( uint16_t bucketSeconds ) { m_bucketSeconds = bucketSeconds; }
+
+    void add( int16_t value, uint16_t seconds );
+    TrendStats stats() const;
+
+private:
+    struct Bucket
+    {
+        int16_t mean;
+        int16_t min;
+        int16_t max;
+    };
+
+    void closeBucket();
+
+    uint16_t m_bucketSeconds = 1;
+
+    //bucket being filled, the sum is weighted by seconds.
+    int32_t m_sum = 0;
+    int16_t m_bucketMin = 0;
+    int16_t m_bucketMax = 0;
+    uint16_t m_seconds = 0;
+
+    //completed buckets, a ring from the oldest.
+    Bucket m_buckets[Buckets];
+    uint8_t m_oldest = 0;
+    uint8_t m_count = 0;
+};
+
+//------------------------------------------------------------------------------
+// History for every tracked series over every window, fed once per completed
+// sensor reading with the seconds since the one before.
+//------------------------------------------------------------------------------
+class SensorHistory
+{
+public:
+    enum Series { Temperature, AirQuality, MAX_SERIES };
+    enum Window { LastMinute, LastTenMinutes, MAX_WINDOW };
+
+    SensorHistory();
+
+    // Temperature in deci-degrees C, air quality in permille of Good.
+    void add( int16_t deciDegrees, int16_t airQualityPermille, uint16_t seconds );
+    TrendStats stats( Series series, Window window ) const { return m_windows[series][window].stats(); }
+
+private:
+    TrendWindow m_windows[MAX_SERIES][MAX_WINDOW];
+};
@@ -0,0 +1,93 @@
+/*------------------------------------------------------------------------------
+    ()      File: i2cqueue.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Queued I2C transactions shared by every device on a bus.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include "i2cqueue.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool I2CQueue::submit( const I2CTransaction & transaction )
+{
+        if( m_count >= Depth || transaction.operation == nullptr )
+        {
+                return false;
+        }
+
+        m_ring[(m_head + m_count) % Depth] = transaction;
+        m_count++;
+        if( m_count > m_peak )
+        {
+                m_peak = m_count;
+        }
+
+        if( transaction.flag != nullptr )
+        {
+                *transaction.flag = I2CTransaction::Queued;
+        }
+        return true;
+}
+
+//------------------------------------------------------------------------------
+// The transaction is taken off the queue before it runs, so its completion
+// can submit the next one.
+//------------------------------------------------------------------------------
+void I2CQueue::service()
+{
+        if( m_count == 0 )
+        {
+                return;
+        }
+
+        HAL_PROBE("i2cService");
+        const I2CTransaction transaction = m_ring[m_head];
+        m_head = (m_head + 1) % Depth;
+        m_count--;
+
+        const uint8_t status = transaction.operation( transaction.context ) ? I2CTransaction::Done : I2CTransaction::Failed;
+        if( status == I2CTransaction::Done )
+        {
+                m_completed++;
+        }
+        else
+        {
+                m_failed++;
+        }
+
+        if( transaction.flag != nullptr )
+        {
+                *transaction.flag = status;
+        }
+        if( transaction.done != nullptr )
+        {
+                transaction.done( status, transaction.context );
+        }
+}
@@ -0,0 +1,93 @@
+/*------------------------------------------------------------------------------
+    ()      File: i2cqueue.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Queued I2C transactions shared by every device on a bus.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include "hal.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// One unit of bus work: an operation that makes its own Wire calls, as the
+// BME680 driver and the panel's bursts do, and returns whether they went
+// through. Completion is reported through the callback, the flag, or both.
+//------------------------------------------------------------------------------
+struct I2CTransaction
+{
+    enum Status : uint8_t { Idle, Queued, Done, Failed };
+
+    using Operation = bool (*)( void * context );
+    using Completion = void (*)( uint8_t status, void * context );
+
+    Operation operation = nullptr;
+    Completion done = nullptr;
+    void * context = nullptr;
+    volatile uint8_t * flag = nullptr;      //set to Queued, then Done or Failed.
+};
+
+//------------------------------------------------------------------------------
+// Serialises transactions from any number of clients onto one bus. Clients
+// submit and carry on, service() runs the oldest transaction and reports it.
+//
+// The Wire library owns the TWI interrupt on the AVR, and the BME680 and LCD
+// drivers are built on Wire, so transactions are run from loop() one per
+// service() call rather than from the interrupt, and each one blocks until
+// Wire returns. A redraw or sensor read is split into short transactions and
+// door handling and scheduled work run between them instead of waiting for
+// the whole thing. Only the local bus is queued, the Blue Pill's global bus
+// answers the master from its own interrupt.
+//------------------------------------------------------------------------------
+class I2CQueue
+{
+public:
+    static const uint8_t Depth = 1 + GAS_SENSORS;   //the panel's burst and a read per sensor, one each at a time.
+
+    // False when the queue is full or there is no operation, the
+    // transaction is not taken.
+    bool submit( const I2CTransaction & transaction );
+
+    // Runs at most one transaction.
+    void service();
+
+    uint8_t space() const { return Depth - m_count; }
+    bool idle() const { return m_count == 0; }
+
+    unsigned long completed() const { return m_completed; }
+    unsigned long failed() const { return m_failed; }
+    uint8_t peak() const { return m_peak; }
+
+private:
+    I2CTransaction m_ring[Depth];
+    uint8_t m_head = 0;
+    uint8_t m_count = 0;
+    uint8_t m_peak = 0;
+    unsigned long m_completed = 0;
+    unsigned long m_failed = 0;
+};
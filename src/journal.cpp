@@ -0,0 +1,307 @@
+/*------------------------------------------------------------------------------
+    ()      File: journal.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Append-only log of records kept in non-volatile storage.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <string.h>
+#include "journal.h"
+#include "utility.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+Journal::Journal( Hal::Storage & storage )
+        : m_storage( storage )
+{
+}
+
+//------------------------------------------------------------------------------
+// Page 0 and the pages after it up to the head carry consecutive sequence
+// numbers, so the head is the last page where that still holds. If page 0 is
+// no good the log has just wrapped onto it, and the head is the last page.
+//------------------------------------------------------------------------------
+bool Journal::begin()
+{
+        m_recoveryReads = 0;
+
+        uint16_t first;
+        uint16_t sequence;
+        uint8_t head;
+        if( readHeader(0, first) )
+        {
+                uint8_t low = 0;
+                uint8_t high = Hal::Storage::Pages;
+                while( high - low > 1 )
+                {
+                        const uint8_t middle = (low + high) / 2;
+                        uint16_t found;
+                        if( readHeader(middle, found) && found == (uint16_t)(first + middle) )
+                        {
+                                low = middle;
+                        }
+                        else
+                        {
+                                high = middle;
+                        }
+                }
+                head = low;
+                sequence = first + low;
+        }
+        else if( readHeader(Hal::Storage::Pages - 1, sequence) )
+        {
+                head = Hal::Storage::Pages - 1;
+        }
+        else
+        {
+                return false;
+        }
+
+        bool torn;
+        m_page = head;
+        m_sequence = sequence;
+        m_empty = false;
+        m_offset = scanPage( head, nullptr, nullptr, torn );
+        if( torn )
+        {
+                m_offset = Hal::Storage::PageSize;
+        }
+        return true;
+}
+
+//------------------------------------------------------------------------------
+// Starts at the page after the head, the oldest, and skips any that are not
+// part of the current lap.
+//------------------------------------------------------------------------------
+void Journal::replay( Visitor visit, void * context ) const
+{
+        if( m_empty )
+        {
+                return;
+        }
+
+        for( uint8_t i=1; i<=Hal::Storage::Pages; i++ )
+        {
+                const uint8_t page = (m_page + i) % Hal::Storage::Pages;
+                uint16_t sequence;
+                if( readHeader(page, sequence) && sequence == (uint16_t)(m_sequence - (Hal::Storage::Pages - i)) )
+                {
+                        bool torn;
+                        scanPage( page, visit, context, torn );
+                }
+        }
+}
+
+//------------------------------------------------------------------------------
+// The type must not be 0xFF, that marks the end of a page. Once the batch
+// could not take a record of any size it is flushed.
+//------------------------------------------------------------------------------
+bool Journal::append( uint8_t type, const void * payload, uint8_t length )
+{
+        const uint8_t size = recordSize( length );
+        if( length > MaxPayload || m_length + size > BatchSize )
+        {
+                m_dropped++;
+                return false;
+        }
+
+        uint8_t * record = &m_batch[m_length];
+        record[0] = type;
+        record[1] = length;
+        memcpy( &record[2], payload, length );
+        record[2 + length] = crc8( record, 2 + length );
+        memset( &record[3 + length], Erased, size - 3 - length );
+        m_length += size;
+        m_appended++;
+        m_appendedBytes += length;
+
+        if( m_length > BatchSize - recordSize(MaxPayload) )
+        {
+                flush();
+        }
+        return true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Journal::flush()
+{
+        m_flushEnd = m_length;
+}
+
+//------------------------------------------------------------------------------
+// One step per call: part of an erase, part of a header, or part of a record.
+// A record only starts where all of it fits, otherwise the next page is
+// opened first.
+//------------------------------------------------------------------------------
+void Journal::service()
+{
+        if( !busy() || !m_storage.ready() )
+        {
+                return;
+        }
+
+        if( m_erased < Hal::Storage::PageSize )
+        {
+                m_erased = m_storage.erase( m_page, m_erased );
+                return;
+        }
+
+        if( m_stamped < HeaderSize )
+        {
+                m_stamped += m_storage.program( m_page, m_stamped, &m_header[m_stamped], HeaderSize - m_stamped );
+                return;
+        }
+
+        if( m_recordLeft == 0 )
+        {
+                const uint8_t size = recordSize( m_batch[m_flushed + 1] );
+                if( m_offset + size > Hal::Storage::PageSize )
+                {
+                        openPage();
+                        return;
+                }
+                m_recordLeft = size;
+        }
+
+        const uint16_t written = m_storage.program( m_page, m_offset, &m_batch[m_flushed], m_recordLeft );
+        m_offset += written;
+        m_flushed += written;
+        m_recordLeft -= written;
+
+        //written out, anything appended since moves to the front.
+        if( m_flushed == m_flushEnd )
+        {
+                memmove( m_batch, &m_batch[m_flushed], m_length - m_flushed );
+                m_length -= m_flushed;
+                m_flushed = 0;
+                m_flushEnd = 0;
+        }
+}
+
+//------------------------------------------------------------------------------
+// CRC-8, polynomial 0x07, bitwise as the CRC-16 of the telemetry is.
+//------------------------------------------------------------------------------
+uint8_t Journal::crc8( const uint8_t * data, uint8_t length, uint8_t crc )
+{
+        while( length-- != 0 )
+        {
+                crc ^= *data++;
+                for( uint8_t bit=0; bit<8; bit++ )
+                {
+                        crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+                }
+        }
+        return crc;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint8_t Journal::recordSize( uint8_t payloadLength )
+{
+        const uint8_t unit = Hal::Storage::ProgramUnit;
+        return (uint8_t)((payloadLength + 3 + unit - 1) / unit * unit);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Journal::readHeader( uint8_t page, uint16_t & sequence ) const
+{
+        uint8_t header[HeaderSize];
+        m_storage.read( page, 0, header, HeaderSize );
+        m_recoveryReads++;
+        if( header[2] != Magic || header[3] != crc8(header, 3) )
+        {
+                return false;
+        }
+        sequence = (uint16_t)(header[0] | (header[1] << 8));
+        return true;
+}
+
+//------------------------------------------------------------------------------
+// Returns the offset after the last good record. A record that runs off the
+// page or fails its CRC was torn, nothing after it is trusted.
+//------------------------------------------------------------------------------
+uint16_t Journal::scanPage( uint8_t page, Visitor visit, void * context, bool & torn ) const
+{
+        uint16_t offset = HeaderSize;
+        torn = false;
+
+        while( offset + 2 <= Hal::Storage::PageSize )
+        {
+                uint8_t record[MaxPayload + 3];
+                m_storage.read( page, offset, record, 2 );
+                m_recoveryReads++;
+                if( record[0] == Erased )
+                {
+                        break;
+                }
+
+                const uint8_t length = record[1];
+                if( length > MaxPayload || offset + recordSize(length) > Hal::Storage::PageSize )
+                {
+                        torn = true;
+                        break;
+                }
+
+                m_storage.read( page, offset + 2, &record[2], length + 1 );
+                m_recoveryReads++;
+                if( record[2 + length] != crc8(record, 2 + length) )
+                {
+                        torn = true;
+                        break;
+                }
+
+                if( visit )
+                {
+                        visit( record[0], &record[2], length, context );
+                }
+                offset += recordSize( length );
+        }
+        return offset;
+}
+
+//------------------------------------------------------------------------------
+// The next page in the ring holds the oldest records, they go as it is erased.
+//------------------------------------------------------------------------------
+void Journal::openPage()
+{
+        m_page = (m_page + 1) % Hal::Storage::Pages;
+        m_sequence++;
+        m_empty = false;
+        m_erased = 0;
+        m_stamped = 0;
+        m_offset = HeaderSize;
+        m_pagesOpened++;
+
+        m_header[0] = (uint8_t)m_sequence;
+        m_header[1] = (uint8_t)(m_sequence >> 8);
+        m_header[2] = Magic;
+        m_header[3] = crc8( m_header, 3 );
+}
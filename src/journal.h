@@ -0,0 +1,133 @@
+/*------------------------------------------------------------------------------
+    ()      File: journal.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Append-only log of records kept in non-volatile storage, wear
+                            levelled across its pages and written in batches.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include "hal.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// The storage pages form a ring and the log runs around it, so every page is
+// erased as often as every other. Each page starts with a header:
+//
+//   | sequence u16 | 0x4A | CRC-8 of the three before |
+//
+// then records, each padded to the storage's program unit, until the first
+// erased byte:
+//
+//   | type u8 | length u8 | payload | CRC-8 of type, length and payload |
+//
+// A page's sequence is one more than the page before it in the ring, so the
+// head is found by binary search over the headers rather than reading every
+// page: page 0 and those after it up to the head carry consecutive numbers,
+// the pages beyond are from the previous lap or never written. Only the head
+// page is then scanned. A record torn by a reset fails its CRC and ends the
+// page; the next write opens a fresh one.
+//
+// Records are appended to a RAM batch and reach storage only on flush(), or
+// when the batch fills, and then a byte or so per service() so loop() never
+// waits on the cells. Anything not yet written is lost at a reset.
+//------------------------------------------------------------------------------
+class Journal
+{
+public:
+    static const uint8_t BatchSize = 40;    //two records of MaxPayload.
+    static const uint8_t MaxPayload = 16;
+    static const uint8_t HeaderSize = 4;
+
+    using Visitor = void (*)( uint8_t type, const uint8_t * payload, uint8_t length, void * context );
+
+    explicit Journal( Hal::Storage & storage );
+
+    // Finds the head of the log. False if there was none, the first write
+    // then starts one.
+    bool begin();
+
+    // Calls visit for every record in storage, oldest first.
+    void replay( Visitor visit, void * context ) const;
+
+    // False, and counted, if the batch has no room for the record.
+    bool append( uint8_t type, const void * payload, uint8_t length );
+    void flush();
+    void service();
+
+    // Whether service() has writing still to do, and can do some now.
+    bool busy() const { return m_flushed != m_flushEnd; }
+    bool ready() const { return m_storage.ready(); }
+
+    //inspection.
+    uint8_t headPage() const { return m_page; }
+    uint16_t sequence() const { return m_sequence; }
+    unsigned long recoveryReads() const { return m_recoveryReads; }
+    unsigned long pagesOpened() const { return m_pagesOpened; }
+    unsigned long appended() const { return m_appended; }
+    unsigned long appendedBytes() const { return m_appendedBytes; }
+    unsigned long dropped() const { return m_dropped; }
+
+    static uint8_t crc8( const uint8_t * data, uint8_t length, uint8_t crc = 0 );
+
+private:
+    static const uint8_t Magic = 0x4A;
+    static const uint8_t Erased = 0xFF;
+
+    static uint8_t recordSize( uint8_t payloadLength );
+
+    bool readHeader( uint8_t page, uint16_t & sequence ) const;
+    uint16_t scanPage( uint8_t page, Visitor visit, void * context, bool & torn ) const;
+    void openPage();
+
+    Hal::Storage & m_storage;
+
+    //where the next record goes.
+    uint8_t m_page = Hal::Storage::Pages - 1;
+    uint16_t m_sequence = 0xFFFF;
+    uint16_t m_offset = Hal::Storage::PageSize;
+    bool m_empty = true;
+
+    //opening a page: erase it, then stamp its header.
+    uint16_t m_erased = Hal::Storage::PageSize;
+    uint8_t m_stamped = HeaderSize;
+    uint8_t m_header[HeaderSize];
+
+    //the batch, bytes before m_flushed are in storage.
+    uint8_t m_batch[BatchSize];
+    uint8_t m_length = 0;
+    uint8_t m_flushed = 0;
+    uint8_t m_flushEnd = 0;
+    uint8_t m_recordLeft = 0;
+
+    mutable unsigned long m_recoveryReads = 0;
+    unsigned long m_pagesOpened = 0;
+    unsigned long m_appended = 0;
+    unsigned long m_appendedBytes = 0;      //payloads, the data worth keeping.
+    unsigned long m_dropped = 0;
+};
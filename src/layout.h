@@ -0,0 +1,64 @@
+/*------------------------------------------------------------------------------
+    ()      File: layout.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Compile time layouts for the character panel.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include "utility.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// 16 by 2.
+// x - temp, format 4sf, at least 1 decimal.
+// t - ten minute temperature trend, ^ rising, v falling, = steady.
+// y - air quality, as a percentage of resistance on the BME680
+// z - air quality hint from lookup table.
+// a - the alert raised, if any.
+// | 00| 01| 02| 03| 04| 05| 06| 07| 08| 09| 10| 11| 12| 13| 14| 15|
+//0| T | e | m | p | _ | x | x | x | x | x | * | C | a | a | a | t |
+//1| V | O | C | _ | y | y | y | % | _  |z | z | z | z | z | z | z |
+//------------------------------------------------------------------------------
+struct TempAndVocLayout
+{
+    enum Field { Temp, VOC, VOCSeverity, TempTrend, Alert, Count };
+
+    static const uint8_t Width = 16;
+    static const uint8_t Height = 2;
+
+    static constexpr DisplayField fields[Count] =
+    {
+        //                  line  begin  end
+        /* Temp */        { 0,    0,     11,   DisplayField::Left },
+        /* VOC */         { 1,    0,     7,    DisplayField::Left },
+        /* VOCSeverity */ { 1,    9,     15,   DisplayField::Left },
+        /* TempTrend */   { 0,    15,    15,   DisplayField::Left },
+        /* Alert */       { 0,    12,    14,   DisplayField::Left },
+    };
+};
@@ -0,0 +1,207 @@
+/*------------------------------------------------------------------------------
+    ()      File: lcdwriter.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Non-blocking writer for the HD44780 panel on its PCF8574 backpack.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <string.h>
+#include "lcdwriter.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        //backpack wiring, as LiquidCrystal_I2C.
+        const uint8_t LCD_BACKLIGHT = 0x08;
+        const uint8_t LCD_EN = 0x04;
+        const uint8_t LCD_RS = 0x01;
+        const uint8_t LCD_SETDDRAMADDR = 0x80;
+        const uint8_t ROW_OFFSETS[] PROGMEM = { 0x00, 0x40, 0x14, 0x54 };
+
+        //------------------------------------------------------------------------------
+        // The panel latches the data pins as enable falls, so a nibble is two
+        // expander bytes, strobe high then low, with the data already on the
+        // pins. RS must settle before enable rises, so when it changes the
+        // nibble is presented first.
+        //------------------------------------------------------------------------------
+        uint8_t * encodeNibble( uint8_t * out, uint8_t bits, bool present )
+        {
+                if( present )
+                {
+                        *out++ = bits;
+                }
+                *out++ = bits | LCD_EN;
+                *out++ = bits & ~LCD_EN;
+                return out;
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+LcdWriter::LcdWriter( I2CQueue & queue, Hal::I2CBus * bus, uint8_t address )
+        : m_queue( queue )
+        , m_bus( bus )
+        , m_address( address )
+{
+}
+
+//------------------------------------------------------------------------------
+// The panel's address counter moves on by one with each character, so a run
+// carrying on from the last is sent without its cursor move.
+//------------------------------------------------------------------------------
+void LcdWriter::write( uint8_t column, uint8_t line, const char * run, uint8_t length )
+{
+        if( m_lost )
+        {
+                return;
+        }
+        if( idle() )
+        {
+                m_refreshes++;
+        }
+
+        const uint8_t address = column + pgm_read_byte( &ROW_OFFSETS[line & 0x3] );
+        const bool move = !m_batched || address != m_cursor;
+        if( length + (move ? 1 : 0) > Capacity - m_count )
+        {
+                drop();
+                return;
+        }
+
+        if( move )
+        {
+                push( LCD_SETDDRAMADDR | address, Command );
+        }
+        for( uint8_t i=0; i<length; i++ )
+        {
+                push( (uint8_t)run[i], Data );
+        }
+        m_cursor = address + length;
+}
+
+//------------------------------------------------------------------------------
+// One burst is on the queue at a time. It takes whatever is buffered when it
+// runs, so characters written while it waits go out with it.
+//------------------------------------------------------------------------------
+void LcdWriter::pump()
+{
+        if( m_count == 0 || m_transfer == I2CTransaction::Queued || m_queue.space() == 0 )
+        {
+                return;
+        }
+
+        I2CTransaction transaction;
+        transaction.operation = sendBurst;
+        transaction.context = this;
+        transaction.flag = &m_transfer;
+        m_queue.submit( transaction );
+}
+
+//------------------------------------------------------------------------------
+// Instructions and characters each need 37us once their second nibble is
+// latched. The next latch is at least two expander bytes later, 45us even at
+// 400kHz, so the burst needs no pauses.
+//------------------------------------------------------------------------------
+bool LcdWriter::sendBurst( void * context )
+{
+        LcdWriter & writer = *static_cast<LcdWriter *>( context );
+
+        uint8_t burst[MaxBurstBytes];
+        uint8_t length = 0;
+        while( writer.m_count != 0 )
+        {
+                uint8_t encoded[6];
+                const uint8_t size = (uint8_t)(writer.encode( encoded, writer.m_values[writer.m_head], writer.modeAt(writer.m_head) ) - encoded);
+                if( length + size > writer.m_burstBytes )
+                {
+                        break;
+                }
+
+                memcpy( &burst[length], encoded, size );
+                length += size;
+                writer.m_pins = encoded[size - 1];
+                writer.m_head = (writer.m_head + 1) % Capacity;
+                writer.m_count--;
+
+                if( !writer.m_batched )
+                {
+                        break;
+                }
+        }
+
+        if( length == 0 )
+        {
+                //dropped while the burst waited.
+                return true;
+        }
+
+        writer.m_bus->beginTransmission( writer.m_address );
+        writer.m_bus->write( burst, length );
+        if( writer.m_bus->endTransmission() != 0 )
+        {
+                //the panel may have seen part of it, and what is still
+                //buffered carries on from an address it may not have reached.
+                writer.m_pins = Unknown;
+                writer.drop();
+                return false;
+        }
+        return true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint8_t * LcdWriter::encode( uint8_t * out, uint8_t value, Mode mode )
+{
+        const uint8_t control = (mode == Data ? LCD_RS : 0) | LCD_BACKLIGHT;
+        const bool present = !m_batched || m_pins == Unknown || (m_pins & LCD_RS) != (control & LCD_RS);
+
+        out = encodeNibble( out, (value & 0xF0) | control, present );
+        return encodeNibble( out, ((value << 4) & 0xF0) | control, !m_batched );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void LcdWriter::push( uint8_t value, Mode mode )
+{
+        const uint8_t tail = (m_head + m_count) % Capacity;
+        const uint8_t bit = (uint8_t)(1 << (tail & 7));
+        m_values[tail] = value;
+        m_modes[tail >> 3] = mode == Data ? (m_modes[tail >> 3] | bit) : (m_modes[tail >> 3] & ~bit);
+        m_count++;
+}
+
+//------------------------------------------------------------------------------
+// Forgets everything buffered. The next run is addressed, whatever the panel
+// made of the last.
+//------------------------------------------------------------------------------
+void LcdWriter::drop()
+{
+        m_count = 0;
+        m_cursor = Unknown;
+        m_lost = true;
+}
@@ -0,0 +1,113 @@
+/*------------------------------------------------------------------------------
+    ()      File: lcdwriter.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Non-blocking writer for the HD44780 panel on its PCF8574 backpack.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include "hal.h"
+#include "i2cqueue.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Cursor moves and characters are buffered, then encoded into the enable-
+// strobed nibbles the backpack expects and written to the panel in bursts,
+// each burst one operation on the bus queue. A burst holds loop() for as long
+// as it is on the bus, so it is kept to about a millisecond: two characters
+// at 100kHz, Wire's whole buffer at 400kHz with FAST_LOCAL_BUS.
+// A run that starts where the last one left off needs no cursor move.
+// Initialisation and the backlight are still left to the library in setup().
+//
+// A run that will not fit, or a burst the bus refuses, drops everything
+// buffered rather than stall the loop or let later runs land at the wrong
+// address, and the writer reports itself lost until the owner redraws.
+//------------------------------------------------------------------------------
+class LcdWriter
+{
+public:
+    static const uint8_t Capacity = 34;     //pending commands and characters, a whole 16x2 redraw.
+    static const uint8_t MaxBurstBytes = 32;    //Wire's transmit buffer.
+#if defined(FAST_LOCAL_BUS)
+    static const uint8_t BurstBytes = MaxBurstBytes;
+#else
+    static const uint8_t BurstBytes = 8;
+#endif //defined(FAST_LOCAL_BUS)
+
+    LcdWriter( I2CQueue & queue, Hal::I2CBus * bus, uint8_t address );
+
+    // Cursor addressed, so a run can rewrite part of a line.
+    void write( uint8_t column, uint8_t line, const char * run, uint8_t length );
+
+    // Moves buffered work into the bus queue as space allows.
+    void pump();
+    bool idle() const { return m_count == 0; }
+
+    // The panel no longer shows what the Display last drew. Runs are ignored
+    // until the owner clears it and redraws every cell.
+    bool lost() const { return m_lost; }
+    void clearLost() { m_lost = false; }
+
+    // One character per transaction, each nibble presented before its
+    // strobe and every run addressed, as the panel was driven before. For
+    // comparison.
+    void setBatched( bool batched ) { m_batched = batched; }
+
+    // Bursts of up to this many bytes, for comparison at other clocks.
+    void setBurstBytes( uint8_t bytes ) { m_burstBytes = bytes < MaxBurstBytes ? bytes : MaxBurstBytes; }
+
+    // Runs that arrive while the writer is idle start a refresh.
+    unsigned long refreshes() const { return m_refreshes; }
+
+private:
+    enum Mode : uint8_t { Command = 0, Data = 1 };
+    static const uint8_t Unknown = 0xFF;
+
+    static bool sendBurst( void * context );
+
+    Mode modeAt( uint8_t index ) const { return (Mode)((m_modes[index >> 3] >> (index & 7)) & 1); }
+    void push( uint8_t value, Mode mode );
+    void drop();
+    uint8_t * encode( uint8_t * out, uint8_t value, Mode mode );
+
+    I2CQueue & m_queue;
+    Hal::I2CBus * m_bus;
+    uint8_t m_address;
+    uint8_t m_values[Capacity];
+    uint8_t m_modes[(Capacity + 7) / 8];    //a bit per entry, set for Data.
+    uint8_t m_head = 0;
+    uint8_t m_count = 0;
+    volatile uint8_t m_transfer = I2CTransaction::Idle;
+
+    bool m_batched = true;
+    uint8_t m_burstBytes = BurstBytes;
+    bool m_lost = false;
+    uint8_t m_cursor = Unknown;             //DDRAM address the panel will write next.
+    uint8_t m_pins = Unknown;               //expander output after the last burst.
+    unsigned long m_refreshes = 0;
+};
@@ -29,90 +29,66 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
-#include <Arduino.h>
-#include <Wire.h>
-#include <Adafruit_BME680.h>
-#include <LiquidCrystal_I2C.h>
-#include <FastLED.h>
+#include "hal.h"
 #include "pinconfig.h"
-#include "utility.h"
-
-#if defined(IS_NANO_BUILD)
-// AVR LIBC sprintf is godawful.
-#include <printf.h>
-#endif //defined(IS_NANO_BUILD)
+#include "cabinet.h"
+#include "memory.h"
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
 // Forwards
 //------------------------------------------------------------------------------
-void periodicTasks();
-void updateSensor();
-void updateLights();
-void tempAndVocRender( const char* ptrtolines, int width, int height );
-
-//------------------------------------------------------------------------------
-// Enums
-//------------------------------------------------------------------------------
-struct Enums
-{
 #if defined(IS_BLUEPILL_BUILD)
-  enum I2C_BusEnum { LocalBus, GlobalBus, I2C_MAX_WIRES = 2 };
-#elif defined(IS_NANO_BUILD)
-  enum I2C_BusEnum { LocalBus, I2C_MAX_WIRES = 1 };
-#endif //defined(IS_NANO_BUILD)
-
-  enum DisplayReadoutSlot { DisplayTemp=0, DisplayVOC=1, DisplayVOCSeverity=2, MAX_DISPLAY_SLOT=3 };
-
-  enum Jobs
-  {
-    Job_None          = 0x0,
-    Job_SensorRefresh = 0x1 << 1,
-    Job_LightsRefresh = 0x1 << 2,
-  }; 
-};
+void onSlaveReceive( int count );
+void onSlaveRequest();
+#endif //defined(IS_BLUEPILL_BUILD)
 
 //------------------------------------------------------------------------------
 // Global
 //------------------------------------------------------------------------------
 // i2c Busses
 #if defined( IS_BLUEPILL_BUILD )
-TwoWire g_i2cBus[Enums::I2C_MAX_WIRES] = 
+//I2C1 on PB7/PB6 and I2C2 on PB11/PB10, sda then scl.
+Hal::I2CBus g_i2cBus[Cabinet::MaxBuses] = 
 { 
-  TwoWire(1, I2C_FAST_MODE),
-  TwoWire(2, I2C_FAST_MODE)
+  TwoWire(PB7, PB6),
+  TwoWire(PB11, PB10)
 };
+Hal::I2CBus & g_localBus = g_i2cBus[Cabinet::LocalBus];
 #elif defined(IS_NANO_BUILD)
-TwoWire g_i2cBus[Enums::I2C_MAX_WIRES] = 
+//the core's own Wire, which is linked in anyway. A second TwoWire would
+//only share its buffers.
+Hal::I2CBus & g_localBus = Wire;
+#elif defined(IS_NATIVE_BUILD)
+Hal::I2CBus g_i2cBus[Cabinet::MaxBuses] = 
 {
-  TwoWire()
+  Hal::I2CBus()
 };
-#endif //defined( IS_NANO_BUILD)
-
-//Jobs
-int g_jobs = Enums::Job_None;
-
-// Periodic Tasks
-Timer g_sensorRefreshTimer( 1000, g_jobs, Enums::Job_SensorRefresh );
+Hal::I2CBus & g_localBus = g_i2cBus[Cabinet::LocalBus];
+#endif //defined(IS_NATIVE_BUILD)
 
-//Gas Sensor
-Adafruit_BME680 g_gasSensor(&g_i2cBus[Enums::LocalBus]);
-
-//LCD Panel
-LiquidCrystal_I2C g_lcd(0x27, 16, 2, LCD_5x8DOTS, g_i2cBus[Enums::LocalBus]);
-Display<16,2,Enums::MAX_DISPLAY_SLOT> g_displayHelper(tempAndVocRender);
-
-//State
-EnvironmentInfo g_environmentInfo;
+//Devices, a sensor at each address the board allows on the local bus, those not fitted drop out at begin.
+Hal::GasSensor g_gasSensors[Cabinet::MaxSensors] =
+{
+  Hal::GasSensor(&g_localBus),
+#if GAS_SENSORS > 1
+  Hal::GasSensor(&g_localBus)
+#endif //GAS_SENSORS > 1
+};
+Hal::Lcd g_lcd(Cabinet::LcdAddress, 16, 2, LCD_5x8DOTS, g_localBus);
+Hal::LedStrip g_leds;
+Hal::Storage g_storage;
 
-//Door LEDs
-const unsigned int LED_COUNT = LEDCOUNT;
-#if defined( IS_BLUEPILL_BUILD )
-WS2812B g_leds = WS2812B(LED_COUNT);
-#elif defined(IS_NANO_BUILD)
-CRGB g_leds[LED_COUNT];
-#endif //defined( IS_NANO_BUILD)
+//The firmware proper
+#if GAS_SENSORS > 1
+const Cabinet::Devices DEVICES = { &g_localBus, { &g_gasSensors[0], &g_gasSensors[1] },
+                                   &g_lcd, &g_leds, &g_storage, DOORPIN };
+#else
+const Cabinet::Devices DEVICES = { &g_localBus, { &g_gasSensors[0] },
+                                   &g_lcd, &g_leds, &g_storage, DOORPIN };
+#endif //GAS_SENSORS > 1
+Cabinet g_cabinet(DEVICES);
 
 
 //------------------------------------------------------------------------------
@@ -120,45 +96,28 @@ CRGB g_leds[LED_COUNT];
 //------------------------------------------------------------------------------
 void setup() 
 {
-  g_i2cBus[Enums::LocalBus].begin();
-#if defined( IS_BLUEPILLL_BUILD )
-  g_i2cBus[Enums::GlobalBus].begin();
-#endif //defined( IS_BLUEPILLL_BUILD )
-  Serial.begin(9600);
+  MemoryMonitor::begin();
 
-  // Set up oversampling and filter initialization
-  g_gasSensor.begin(0x76, true);
-  g_gasSensor.setTemperatureOversampling(BME680_OS_8X);
-  g_gasSensor.setHumidityOversampling(BME680_OS_2X);
-  g_gasSensor.setPressureOversampling(BME680_OS_4X);
-  g_gasSensor.setIIRFilterSize(BME680_FILTER_SIZE_3);
-  g_gasSensor.setGasHeater(320, 150); // 320*C for 150 ms
+#if defined(PROFILING)
+  Profiler::begin();
+#endif //defined(PROFILING)
 
-  //display
-  g_lcd.begin();
-	g_lcd.backlight();
+  g_localBus.begin();
+  Hal::serialBegin(TELEMETRY_BAUD);
 
-  // Bit Alocation. 16 by 2.
-  // x - temp, format 4sf, at least 1 decimal.
-  // y - air quality, as a percentage of resistance on the BME680
-  // z - air quality hint from lookup table.
-  // | 00| 01| 02| 03| 04| 05| 06| 07| 08| 09| 10| 11| 12| 13| 14| 15|
-  //0| T | e | m | p | _ | x | x | x | x | x | * | C | _ | _ | _ | _ |
-  //1| V | O | C | _ | y | y | y | % | _  |z | z | z | z | z | z | z |
-  g_displayHelper.reserve(Enums::DisplayTemp, 0, 0, 15);
-  g_displayHelper.reserve(Enums::DisplayVOC, 1, 0, 7);
-  g_displayHelper.reserve(Enums::DisplayVOCSeverity, 1, 9, 15);
-  
-  //LEDS
-#if defined( IS_BLUEPILL_BUILD )
-  g_leds.begin();
-  g_leds.show();
-#elif defined(IS_NANO_BUILD)
-  FastLED.addLeds<NEOPIXEL, LEDPIN>(g_leds, LED_COUNT);
-#endif //defined( IS_NANO_BUILD)
+  g_cabinet.begin();
+
+#if defined(FAST_LOCAL_BUS)
+  //after the panel's begin(), the library may restart Wire at 100kHz.
+  g_localBus.setClock(400000);
+#endif //defined(FAST_LOCAL_BUS)
 
-  pinMode(DOORPIN, INPUT_PULLUP);
-  g_jobs |= Enums::Job_LightsRefresh;
+#if defined(IS_BLUEPILL_BUILD)
+  //the global bus is the master's, the cabinet only ever answers on it.
+  g_i2cBus[Cabinet::GlobalBus].begin(SLAVE_ADDRESS);
+  g_i2cBus[Cabinet::GlobalBus].onReceive(onSlaveReceive);
+  g_i2cBus[Cabinet::GlobalBus].onRequest(onSlaveRequest);
+#endif //defined(IS_BLUEPILL_BUILD)
 }
 
 //------------------------------------------------------------------------------
@@ -166,120 +125,31 @@ void setup()
 //------------------------------------------------------------------------------
 void loop()
 {
-  //timers.
-  unsigned long runtime = millis();
-  g_sensorRefreshTimer.tick( runtime );
-
-  const bool doorOpen = digitalRead(DOORPIN);
-  if( g_environmentInfo.doorOpen != doorOpen )
-  {
-     g_environmentInfo.doorOpen = doorOpen;
-     g_jobs |= Enums::Job_LightsRefresh;
-  }
-
-  periodicTasks();
-}
-
-//------------------------------------------------------------------------------
-// For Periodic Tasks, once a timer for a task has elapsed, it raises a flag. 
-// The periodic task will then be allowed to process, it must clear the flag to
-// stop processing and reset the timer.
-//------------------------------------------------------------------------------
-void periodicTasks()
-{
-  //jobs. 
-
-  if( (g_jobs & Enums::Job_LightsRefresh) != 0 )
-  {
-    updateLights();
-    delay(30);
-  }
-
-  if( (g_jobs & Enums::Job_SensorRefresh) != 0 )
-  {
-    updateSensor();
-    return;
-  }
+  g_cabinet.loop();
+  MemoryMonitor::sample();
+  g_cabinet.sleep();
 }
 
-
+#if defined(IS_BLUEPILL_BUILD)
 //------------------------------------------------------------------------------
+// Wire slave handlers, interrupt context.
 //------------------------------------------------------------------------------
-void updateSensor()
+void onSlaveReceive( int count )
 {
-  const int readingTime = g_gasSensor.remainingReadingMillis();
-
-  if( readingTime == Adafruit_BME680::reading_not_started )
-  {
-    g_gasSensor.beginReading();
-  }
-  else if( readingTime == Adafruit_BME680::reading_complete )
+  uint8_t data[32];
+  uint8_t length = 0;
+  while( g_i2cBus[Cabinet::GlobalBus].available() && length < sizeof(data) )
   {
-    // update info.
-    g_gasSensor.endReading();
-    g_environmentInfo.temperature = g_gasSensor.temperature;
-    g_environmentInfo.voc = g_gasSensor.gas_resistance;
-
-    char str[16];
-    // display temperature.
-    sprintf(&str[0], "Temp %5.2f*C", (double)g_gasSensor.temperature );
-    g_displayHelper.update(Enums::DisplayTemp, str );
-
-    // display air quality.
-    float airQuality = ((float)g_gasSensor.gas_resistance/(float)VOCTable::_table[VOCTable::Good])*100.0f;
-    airQuality = Min( airQuality, 100.0f );
-
-    sprintf(&str[0], "VOC %03.0f%%", airQuality );
-    g_displayHelper.update(Enums::DisplayVOC, str );
-
-    // display severity hint.
-    for( int severity = VOCTable::Good; severity < VOCTable::MAX; severity++ )
-    {
-      if( g_gasSensor.gas_resistance > VOCTable::_table[severity] )
-      {
-        g_displayHelper.update(Enums::DisplayVOCSeverity, VOCTable::_asString[severity] );
-        break;
-      }
-    }
-    
-    g_displayHelper.draw();
-    g_jobs &= ~Enums::Job_SensorRefresh;
+    data[length++] = (uint8_t)g_i2cBus[Cabinet::GlobalBus].read();
   }
+  (void)count;
+  g_cabinet.slaveReceived( data, length );
 }
 
-//------------------------------------------------------------------------------
-//------------------------------------------------------------------------------
-void updateLights()
+void onSlaveRequest()
 {
-#if defined(IS_BLUEPILL_BUILD)
-  const uint32_t colours[] = { WS2812B::Color(255,0,0), WS2812B::Color(255,255,255) };
-  
-  for( unsigned int led=0; led<LED_COUNT; led++)
-  {
-    g_leds.setPixelColor(colours[g_environmentInfo.doorOpen? 0 : 1], led);
-  }
-  g_leds.show();
-#elif defined(IS_NANO_BUILD)
-  const CRGB colours[] = { CRGB(255,255,255), CRGB(255,0,0) }; 
-  const CRGB& colour = colours[g_environmentInfo.doorOpen? 0 : 1];
-
-  for( unsigned int i=0; i<LED_COUNT; i++ )
-  {   
-      g_leds[i] = colour;
-  }
-  FastLED.show(); 
-#endif //defined(IS_NANO_BUILD)
-
-  g_jobs &= ~Enums::Job_LightsRefresh;
+  uint8_t data[32];
+  const uint8_t length = g_cabinet.slaveRequested( data, sizeof(data) );
+  g_i2cBus[Cabinet::GlobalBus].write( data, length );
 }
-//------------------------------------------------------------------------------
-//------------------------------------------------------------------------------
-void tempAndVocRender( const char * ptrtolines, int width, int height )
-{
-  g_lcd.clear();
-  for(int line=0; line<height; line++)
-  {
-    g_lcd.setCursor(0,line);
-    g_lcd.printstr(&ptrtolines[line*(width+1)]);
-  }
-}
\ No newline at end of file
+#endif //defined(IS_BLUEPILL_BUILD)
@@ -0,0 +1,132 @@
+/*------------------------------------------------------------------------------
+    ()      File: memory.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              SRAM watermarks.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <string.h>
+#include "memory.h"
+#include "hal.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+uint16_t MemoryMonitor::s_freeLowest = 0;
+
+#if !defined(IS_NATIVE_BUILD)
+//------------------------------------------------------------------------------
+// From the linker: where .data starts, where the heap starts after .bss, and
+// where it has grown to.
+//------------------------------------------------------------------------------
+#if defined(IS_NANO_BUILD)
+extern uint8_t __data_start;
+extern uint8_t __heap_start;
+extern uint8_t * __brkval;
+#elif defined(IS_BLUEPILL_BUILD)
+extern uint8_t _sdata;
+extern uint8_t _end;
+extern "C" void * _sbrk( int increment );
+#endif //defined(IS_BLUEPILL_BUILD)
+
+namespace
+{
+#if defined(IS_NANO_BUILD)
+        uint8_t * ramStart()            { return &__data_start; }
+        uint8_t * heapStart()           { return &__heap_start; }
+        uint8_t * heapTop()             { return __brkval != nullptr ? __brkval : &__heap_start; }
+        uint8_t * stackPointer()        { return (uint8_t *)SP; }
+#elif defined(IS_BLUEPILL_BUILD)
+        uint8_t * ramStart()            { return &_sdata; }
+        uint8_t * heapStart()           { return &_end; }
+        uint8_t * heapTop()             { return (uint8_t *)_sbrk( 0 ); }
+        uint8_t * stackPointer()        { return (uint8_t *)__get_MSP(); }
+#endif //defined(IS_BLUEPILL_BUILD)
+}
+
+//------------------------------------------------------------------------------
+// Interrupts may land while painting, their frames sit below the stack
+// pointer only while they run, so painting over them afterwards is harmless.
+//------------------------------------------------------------------------------
+void MemoryMonitor::begin()
+{
+        uint8_t * const bottom = heapTop();
+        uint8_t * const top = stackPointer() - StackMargin;
+        if( top > bottom )
+        {
+                memset( bottom, Paint, top - bottom );
+        }
+        s_freeLowest = freeNow();
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void MemoryMonitor::sample()
+{
+        const uint16_t free = freeNow();
+        if( free < s_freeLowest )
+        {
+                s_freeLowest = free;
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint16_t MemoryMonitor::staticBytes()
+{
+        return (uint16_t)(heapStart() - ramStart());
+}
+
+uint16_t MemoryMonitor::freeNow()
+{
+        return (uint16_t)(stackPointer() - heapTop());
+}
+
+//------------------------------------------------------------------------------
+// Counts up from the heap to the first byte the stack has written. Heap given
+// back below its old top leaves unpainted bytes, which only ever reads low.
+//------------------------------------------------------------------------------
+uint16_t MemoryMonitor::stackHeadroom()
+{
+        const uint8_t * cell = heapTop();
+        const uint8_t * const top = stackPointer();
+        uint16_t headroom = 0;
+        while( cell < top && *cell++ == Paint )
+        {
+                headroom++;
+        }
+        return headroom;
+}
+
+#else
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void MemoryMonitor::begin()                 {}
+void MemoryMonitor::sample()                {}
+uint16_t MemoryMonitor::staticBytes()       { return 0; }
+uint16_t MemoryMonitor::freeNow()           { return 0; }
+uint16_t MemoryMonitor::stackHeadroom()     { return 0; }
+#endif //!defined(IS_NATIVE_BUILD)
@@ -0,0 +1,124 @@
+/*------------------------------------------------------------------------------
+    ()      File: memory.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              SRAM watermarks and static footprint budgets.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// begin() paints the gap between the heap and the stack, so how deep the
+// stack has ever reached is read back later from the paint it left behind.
+// sample(), once a loop pass, keeps the least free RAM seen between the top of
+// the heap and the stack pointer. Not measured natively, the host's stack says
+// nothing about the boards'.
+//------------------------------------------------------------------------------
+class MemoryMonitor
+{
+public:
+#if defined(IS_NATIVE_BUILD)
+    static const bool Measured = false;
+#else
+    static const bool Measured = true;
+#endif //defined(IS_NATIVE_BUILD)
+
+    static const uint8_t Paint = 0xC5;
+    static const uint8_t StackMargin = 32;      //left unpainted below begin()'s frame.
+
+    // First thing in setup(), before anything allocates.
+    static void begin();
+    static void sample();
+
+    // .data and .bss, fixed at link time.
+    static uint16_t staticBytes();
+    static uint16_t freeNow();
+    static uint16_t freeLowest() { return s_freeLowest; }
+
+    // Painted bytes the stack has never reached.
+    static uint16_t stackHeadroom();
+
+private:
+    static uint16_t s_freeLowest;
+};
+
+//------------------------------------------------------------------------------
+// Static footprint budgets in bytes, for the Nano, whose 2KB is the one that
+// runs out.
+//
+// Each of the firmware's objects is budgeted its size as the AVR lays it out,
+// two byte ints and pointers, four byte longs and no padding, and the Nano's
+// build holds it there: the Cabinet in cabinet.h, its members in cabinet.cpp. What a configuration grows is held on
+// every build, from its counts: the strip's pixels by LEDCOUNT and the panel's
+// buffers by its size.
+//
+// The libraries' objects and buffers, tables left in SRAM and the stack are
+// estimated. The memory tool sums the lot against Sram, and check_ram.py
+// measures the linked firmware's .data and .bss after every Nano build.
+//------------------------------------------------------------------------------
+struct MemoryBudget
+{
+#if defined(IS_BLUEPILL_BUILD)
+    static const uint16_t Sram = 20480;
+    static const uint8_t PixelBytes = 6;        //the pixels and the copy being sent.
+    static const uint16_t LedPixels = 6144;
+    static const uint16_t Panel = 512;
+#else
+    static const uint16_t Sram = 2048;
+    static const uint8_t PixelBytes = 3;
+    static const uint16_t LedPixels = 300;      //100 LEDs.
+    static const uint16_t Panel = 100;          //up to 24x2.
+#endif //defined(IS_BLUEPILL_BUILD)
+
+    //the firmware's objects.
+    static const uint16_t Cabinet = 904;
+    static const uint16_t History = 152;
+    static const uint16_t Scheduler = 80;
+    static const uint16_t BusQueue = 32;
+    static const uint16_t Effects = 72;
+    static const uint16_t Console = 56;
+    static const uint16_t Journal = 80;
+    static const uint16_t Alerts = 64;
+    static const uint16_t LcdWriter = 56;
+    static const uint16_t Door = 40;
+    static const uint16_t Telemetry = 72;
+    static const uint16_t Sampler = 32;
+    static const uint16_t Devices = 12;
+
+    //the rest of the Nano's, estimated.
+    static const uint8_t GasSensors = 1;        //the Nano's GAS_SENSORS.
+    static const uint16_t GasSensor = 128;      //a driver and the I2C device it allocates.
+    static const uint16_t Lcd = 16;
+    static const uint16_t SerialPort = 80;      //HardwareSerial, rings cut to 32 and 16 in platformio.ini.
+    static const uint16_t WireBuffers = 208;    //Wire, the firmware's bus, and its and twi's 32 byte buffers.
+    static const uint16_t FastLed = 40;
+    static const uint16_t Core = 96;            //millis, malloc and vtables, kept in .data.
+    static const uint16_t Tables = 144;         //the BME680 driver's gas range tables, ours are in PROGMEM.
+    static const uint16_t Stack = 256;
+};
@@ -0,0 +1,210 @@
+/*------------------------------------------------------------------------------
+    ()      File: alerts_tool.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Runs the alert engine against a scripted enclosure that sits on its
+              thresholds, and counts the flips hysteresis and dwell times saved.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../hal.h"
+#include "../pinconfig.h"
+#include "../cabinet.h"
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+extern Hal::Lcd g_lcd;
+extern Cabinet g_cabinet;
+
+namespace
+{
+        const char * LEVELS[] = { "none", "notice", "warning", "critical" };
+
+        struct Sample
+        {
+                int16_t deciDegrees;
+                uint32_t resistance;
+        };
+
+        //every reading the firmware took, for the naive comparison.
+        std::vector<Sample> s_samples;
+
+        //------------------------------------------------------------------------------
+        // Repeatable noise, -1 to 1.
+        //------------------------------------------------------------------------------
+        float noise( unsigned long timeMs, uint32_t salt )
+        {
+                uint32_t x = (uint32_t)(timeMs / 250) * 2654435761u ^ salt;
+                x ^= x >> 15;
+                x *= 2246822519u;
+                x ^= x >> 13;
+                return (float)(x % 2001) / 1000.0f - 1.0f;
+        }
+
+        //------------------------------------------------------------------------------
+        // Ten minutes warming to 38 *C, then hovering on the warning threshold
+        // and leaving it after twenty. The air sits on the Average/Subpar
+        // boundary throughout, with a spell of Bad air from minute 31.
+        //------------------------------------------------------------------------------
+        Sim::Reading scriptedReading( unsigned long timeMs )
+        {
+                const float minutes = timeMs / 60000.0f;
+                float temperature = 30.0f;
+                if( minutes >= 10.0f && minutes < 30.0f )
+                {
+                        temperature = 38.0f;
+                }
+                else if( minutes >= 5.0f && minutes < 10.0f )
+                {
+                        temperature = 30.0f + (minutes - 5.0f) * 1.6f;
+                }
+                temperature += 0.4f * noise( timeMs, 0x1234 );
+
+                float resistance = 213212.0f;
+                if( minutes >= 31.0f && minutes < 34.0f )
+                {
+                        resistance = 52000.0f;
+                }
+                resistance *= 1.0f + 0.025f * noise( timeMs, 0x9876 );
+
+                Sim::Reading reading;
+                reading.temperature = temperature;
+                reading.humidity = 40.0f;
+                reading.pressure = 101325;
+                reading.gas_resistance = (uint32_t)resistance;
+                s_samples.push_back( { (int16_t)FieldWriter::toFixed(temperature, 1), reading.gas_resistance } );
+                return reading;
+        }
+
+        //------------------------------------------------------------------------------
+        // What the old linear scan would have labelled the reading.
+        //------------------------------------------------------------------------------
+        int scannedSeverity( uint32_t resistance, int previous )
+        {
+                for( int severity = VOCTable::Good; severity < VOCTable::MAX; severity++ )
+                {
+                        if( resistance > VOCTable::_table[severity] )
+                        {
+                                return severity;
+                        }
+                }
+                return previous;
+        }
+
+        //------------------------------------------------------------------------------
+        // Each rule as a bare threshold on every reading, no band or dwell.
+        //------------------------------------------------------------------------------
+        unsigned long naiveFlips( AlertEngine::Signal signal, unsigned long doorEvents )
+        {
+                if( signal == AlertEngine::Signal_Door )
+                {
+                        return doorEvents;
+                }
+
+                unsigned long flips = 0;
+                for( uint8_t i=0; i<AlertEngine::ruleCount(); i++ )
+                {
+                        const AlertEngine::Rule rule = AlertEngine::rule( i );
+                        if( rule.signal != signal )
+                        {
+                                continue;
+                        }
+
+                        bool raised = false;
+                        for( const Sample & sample : s_samples )
+                        {
+                                const int16_t value = signal == AlertEngine::Signal_Temperature ? sample.deciDegrees
+                                                    : (int16_t)VOCTable::permilleOfGood( sample.resistance );
+                                const bool past = rule.enter > rule.exit ? value >= rule.enter : value <= rule.enter;
+                                flips += past != raised ? 1 : 0;
+                                raised = past;
+                        }
+                }
+                return flips;
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int alertsMain( int argc, char ** argv )
+{
+        const unsigned long minutes = argc > 0 ? strtoul(argv[0], nullptr, 10) : 40;
+        const uint64_t endMicros = (uint64_t)minutes * 60000000;
+
+        //the door opens at minute 2 and is left for six.
+        Sim::schedulePin( 120000000ull, DOORPIN, true );
+        Sim::schedulePin( 480000000ull, DOORPIN, false );
+        Sim::BME680::setSource( scriptedReading );
+
+        setup();
+        const unsigned long pushesAtStart = Sim::LedStrip::pushes();
+        uint8_t shown = AlertEngine::NoRule;
+        while( Sim::nowMicros() < endMicros )
+        {
+                loop();
+                const AlertEngine & alerts = g_cabinet.alerts();
+                if( alerts.current() != shown )
+                {
+                        shown = alerts.current();
+                        printf( "  %7.1f s  %-8s |%s|\n", Sim::nowMicros() / 1e6, LEVELS[alerts.level()], g_cabinet.panelText(0) );
+                }
+        }
+
+        int scanned = VOCTable::MAX;
+        uint8_t banded = VOCTable::MAX;
+        unsigned long scannedChanges = 0;
+        unsigned long bandedChanges = 0;
+        for( const Sample & sample : s_samples )
+        {
+                const int nextScanned = scannedSeverity( sample.resistance, scanned );
+                const uint8_t nextBanded = VOCTable::severity( sample.resistance, banded );
+                scannedChanges += nextScanned != scanned ? 1 : 0;
+                bandedChanges += nextBanded != banded ? 1 : 0;
+                scanned = nextScanned;
+                banded = nextBanded;
+        }
+
+        const AlertEngine & alerts = g_cabinet.alerts();
+        const unsigned long naive = naiveFlips( AlertEngine::Signal_Temperature, 0 )
+                                  + naiveFlips( AlertEngine::Signal_AirQuality, 0 )
+                                  + naiveFlips( AlertEngine::Signal_Door, g_cabinet.door().events() );
+        printf( "alerts: %zu readings over %lu min\n", s_samples.size(), minutes );
+        printf( "alerts: VOC label changed %lu times, %lu by bare thresholds\n", bandedChanges, scannedChanges );
+        printf( "alerts: alert shown changed %lu times, rules on bare thresholds flip %lu\n", alerts.changes(), naive );
+        printf( "alerts: %lu updates, %lu crossed a band and walked the rules\n", alerts.updates(), alerts.crossings() );
+        printf( "alerts: %lu panel characters written, %lu strip pushes\n",
+                g_lcd.characterWrites(), Sim::LedStrip::pushes() - pushesAtStart );
+
+        //the scripted excursions must still raise alerts, and the hysteresis
+        //hold back what bare thresholds flap on.
+        const bool held = alerts.changes() != 0 && alerts.changes() < naive && bandedChanges < scannedChanges;
+        printf( "alerts: hysteresis %s\n", held ? "holds" : "FAILED to hold" );
+        return held ? 0 : 2;
+}
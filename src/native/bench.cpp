@@ -0,0 +1,250 @@
+/*------------------------------------------------------------------------------
+    ()      File: bench.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Loop latency benchmark. Runs the firmware against the simulated
+              devices on the virtual clock, toggling the door periodically, and
+              reports loop() latency percentiles, time per job and I2C traffic.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "../hal.h"
+#include "../cabinet.h"
+#include "../profiler.h"
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+extern Hal::I2CBus g_i2cBus[];
+extern Hal::Lcd g_lcd;
+extern Hal::GasSensor g_gasSensors[Cabinet::MaxSensors];
+extern Cabinet g_cabinet;
+
+namespace
+{
+        //time charged for the loop's own bookkeeping on each pass.
+        const uint64_t LOOP_OVERHEAD_US = 20;
+
+        //reed switch contact bounce after each door movement.
+        const uint32_t BOUNCE_US[] = { 0, 600, 1100, 2500, 4000 };
+        const int BOUNCE_EDGES = sizeof(BOUNCE_US) / sizeof(BOUNCE_US[0]);
+
+        struct Samples
+        {
+                std::vector<uint32_t> virtualMicros;
+                std::vector<uint32_t> hostNanos;
+        };
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        uint32_t percentile( std::vector<uint32_t> & sorted, double pct )
+        {
+                if( sorted.empty() )
+                {
+                        return 0;
+                }
+                const size_t index = (size_t)(pct / 100.0 * (double)(sorted.size() - 1) + 0.5);
+                return sorted[index];
+        }
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        void printPercentiles( const char * label, const char * unit, std::vector<uint32_t> & values )
+        {
+                std::sort( values.begin(), values.end() );
+                printf( "  %-10s p50 %8u  p90 %8u  p99 %8u  p99.9 %8u  max %8u %s\n",
+                        label,
+                        percentile(values, 50.0), percentile(values, 90.0),
+                        percentile(values, 99.0), percentile(values, 99.9),
+                        values.empty() ? 0u : values.back(), unit );
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int benchMain( int argc, char ** argv )
+{
+        const unsigned long seconds = argc > 0 ? strtoul(argv[0], nullptr, 10) : 600;
+        const unsigned long doorPeriodMs = argc > 1 ? strtoul(argv[1], nullptr, 10) : 15000;
+        const bool adaptive = argc > 2 ? strcmp(argv[2], "fixed") != 0 : true;
+        const uint64_t endMicros = (uint64_t)seconds * 1000000;
+
+        setup();
+        g_cabinet.sampler().setAdaptive( adaptive );
+        Sim::Probe::resetAll();
+#if defined(PROFILING)
+        Profiler::reset();
+#endif //defined(PROFILING)
+        g_i2cBus[0].resetStats();
+        const unsigned long pushesAtStart = Sim::LedStrip::pushes();
+        const unsigned long readingsAtStart = g_gasSensors[0].readingsTaken();
+        const uint64_t sensorBusAtStart = g_gasSensors[0].busMicros();
+        const uint64_t chargeAtStart = g_gasSensors[0].chargePicocoulombs();
+        const uint64_t beginMicros = Sim::nowMicros();
+
+        Samples samples;
+        bool doorOpen = false;
+        uint64_t nextDoorToggle = beginMicros + (uint64_t)doorPeriodMs * 1000;
+        std::vector<uint32_t> doorLatencies;
+        unsigned long doorEvents = g_cabinet.door().events();
+
+        while( Sim::nowMicros() - beginMicros < endMicros )
+        {
+                //queue the next movement ahead of time so its edges land mid-loop.
+                if( doorPeriodMs != 0 && Sim::nowMicros() + 10000 >= nextDoorToggle )
+                {
+                        doorOpen = !doorOpen;
+                        for( int edge=0; edge<BOUNCE_EDGES; edge++ )
+                        {
+                                const bool level = (edge % 2 == 0) ? doorOpen : !doorOpen;
+                                Sim::schedulePin( nextDoorToggle + BOUNCE_US[edge], DOORPIN, level );
+                        }
+                        nextDoorToggle += (uint64_t)doorPeriodMs * 1000;
+                }
+
+                const uint64_t virtualBegin = Sim::nowMicros();
+                const uint64_t hostBegin = Sim::Probe::hostNanos();
+                g_cabinet.loop();
+                samples.hostNanos.push_back( (uint32_t)(Sim::Probe::hostNanos() - hostBegin) );
+                samples.virtualMicros.push_back( (uint32_t)(Sim::nowMicros() - virtualBegin) );
+
+                if( g_cabinet.door().events() != doorEvents && g_cabinet.door().lastLatencyMicros() != 0 )
+                {
+                        doorEvents = g_cabinet.door().events();
+                        doorLatencies.push_back( (uint32_t)g_cabinet.door().lastLatencyMicros() );
+                }
+
+                Sim::advanceMicros( LOOP_OVERHEAD_US );
+        }
+
+        const double elapsedSeconds = (double)(Sim::nowMicros() - beginMicros) / 1000000.0;
+        const Hal::I2CBus::Stats & bus = g_i2cBus[0].stats();
+
+        printf( "bench: %.0f s simulated, %zu loop iterations, door period %lu ms\n",
+                elapsedSeconds, samples.virtualMicros.size(), doorPeriodMs );
+
+        printf( "\nloop() latency\n" );
+        std::vector<uint32_t> busyMicros;
+        for( uint32_t us : samples.virtualMicros )
+        {
+                if( us != 0 )
+                {
+                        busyMicros.push_back( us );
+                }
+        }
+        printPercentiles( "virtual", "us", samples.virtualMicros );
+        printPercentiles( "busy", "us", busyMicros );
+        printPercentiles( "host", "ns", samples.hostNanos );
+        printf( "  %zu of %zu iterations did blocking work\n", busyMicros.size(), samples.virtualMicros.size() );
+
+        printf( "\njobs %22s %10s %10s %12s %12s\n", "calls", "mean us", "max us", "mean host ns", "max host ns" );
+        for( uint8_t index=0; index<Sim::Probe::MaxProbes; index++ )
+        {
+                const Sim::ProbeStats * stats = Sim::Probe::stats( index );
+                if( stats == nullptr )
+                {
+                        break;
+                }
+                printf( "  %-20s %8lu %10llu %10llu %12llu %12llu\n",
+                        stats->name, stats->count,
+                        (unsigned long long)(stats->count ? stats->virtualMicros / stats->count : 0),
+                        (unsigned long long)stats->virtualMaxMicros,
+                        (unsigned long long)(stats->count ? stats->hostNanos / stats->count : 0),
+                        (unsigned long long)stats->hostMaxNanos );
+        }
+
+#if defined(PROFILING)
+        printf( "\nfirmware profile, log2 buckets from 8 us\n" );
+        for( uint8_t job=0; job<Profiler::jobs(); job++ )
+        {
+                const ProfileStats & stats = *Profiler::stats( job );
+                printf( "  %-20s %8lu %10lu %10lu  |", stats.name, (unsigned long)stats.count,
+                        (unsigned long)stats.meanMicros(), (unsigned long)stats.maxMicros );
+                for( uint8_t bucket=0; bucket<ProfileStats::Buckets; bucket++ )
+                {
+                        printf( " %5u", stats.buckets[bucket] );
+                }
+                printf( "\n" );
+        }
+#endif //defined(PROFILING)
+
+        printf( "\ni2c local bus\n" );
+        printf( "  transactions %10lu  (%.1f /s)\n", bus.transactions, bus.transactions / elapsedSeconds );
+        printf( "  bytes        %10lu  (%.1f /s)\n", bus.bytes, bus.bytes / elapsedSeconds );
+        printf( "  busy         %10.1f ms (%.2f %%)\n", bus.busMicros / 1000.0, bus.busMicros / 10000.0 / elapsedSeconds );
+        printf( "  queued       %10lu  (%lu failed, peak depth %u of %u)\n",
+                g_cabinet.queue().completed(), g_cabinet.queue().failed(), g_cabinet.queue().peak(), I2CQueue::Depth );
+
+        const unsigned long readings = g_gasSensors[0].readingsTaken() - readingsAtStart;
+        const double sensorBusMs = (g_gasSensors[0].busMicros() - sensorBusAtStart) / 1000.0;
+        const double chargeMicrocoulombs = (g_gasSensors[0].chargePicocoulombs() - chargeAtStart) / 1000000.0
+                                         + Hal::GasSensor::SleepMicroamps * elapsedSeconds;
+        printf( "\nbme680, %s sampling\n", adaptive ? "adaptive" : "fixed" );
+        printf( "  samples      %10lu  (%.2f /s)\n", readings, readings / elapsedSeconds );
+        printf( "  bus          %10.1f ms (%.3f %%)\n", sensorBusMs, sensorBusMs / 10.0 / elapsedSeconds );
+        printf( "  supply       %10.1f uA average (%.1f mC)\n", chargeMicrocoulombs / elapsedSeconds, chargeMicrocoulombs / 1000.0 );
+        printf( "  modes        %10lu fast, %lu steady, %lu slow readings, %lu changes\n",
+                g_cabinet.sampler().readings(AdaptiveSampler::Fast), g_cabinet.sampler().readings(AdaptiveSampler::Steady),
+                g_cabinet.sampler().readings(AdaptiveSampler::Slow), g_cabinet.sampler().transitions() );
+
+        printf( "\npanel\n" );
+        printf( "  |%s|\n  |%s|\n", g_lcd.line(0), g_lcd.line(1) );
+
+        printf( "\ndoor\n" );
+        printf( "  edges        %10lu\n", g_cabinet.door().edges() );
+        printf( "  events       %10zu\n", doorLatencies.size() );
+        printPercentiles( "to light", "us", doorLatencies );
+
+        printf( "\nhistory %8s %8s %8s %10s %8s\n", "min", "max", "mean", "slope/min", "buckets" );
+        static const char * const SERIES[] = { "temp dC", "aq pm" };
+        static const char * const WINDOWS[] = { "1m", "10m", "1h" };
+        for( uint8_t series=0; series<SensorHistory::MAX_SERIES; series++ )
+        {
+                for( uint8_t window=0; window<SensorHistory::MAX_WINDOW; window++ )
+                {
+                        const TrendStats stats = g_cabinet.history().stats( (SensorHistory::Series)series, (SensorHistory::Window)window );
+                        printf( "  %-7s %-3s %6d %8d %8d %10d %8u\n", SERIES[series], WINDOWS[window],
+                                stats.min, stats.max, stats.mean, stats.slopePerMinute, stats.buckets );
+                }
+        }
+        printf( "  %zu bytes\n", sizeof(SensorHistory) );
+
+        printf( "\nled strip\n" );
+        printf( "  frames       %10lu\n", g_cabinet.effects().frames() );
+        printf( "  pushes       %10lu\n", Sim::LedStrip::pushes() - pushesAtStart );
+
+        printf( "\ntelemetry\n" );
+        printf( "  frames       %10u\n", g_cabinet.telemetry().sent() );
+        printf( "  dropped      %10u\n", g_cabinet.telemetry().dropped() );
+        printf( "  bytes        %10zu\n", Sim::serialTransmittedSize() );
+        printf( "  blocked      %10llu us\n", (unsigned long long)Sim::serialBlockedMicros() );
+        return 0;
+}
@@ -0,0 +1,147 @@
+/*------------------------------------------------------------------------------
+    ()      File: bench_format.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Compares the fixed-point sensor readout formatting against the
+              sprintf/float path it replaced, for output and for speed.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../hal.h"
+#include "../utility.h"
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        const uint8_t FIELD = 16;
+
+        struct Sample
+        {
+                float temperature;
+                uint32_t resistance;
+        };
+
+        //------------------------------------------------------------------------------
+        // The pre-FieldWriter updateSensor() formatting.
+        //------------------------------------------------------------------------------
+        void legacy( const Sample & sample, char * temp, char * voc )
+        {
+                char str[16];
+                sprintf(&str[0], "Temp %5.2f*C", (double)sample.temperature );
+                memset( temp, ' ', FIELD );
+                memcpy( temp, str, strlen(str) );
+
+                float airQuality = ((float)sample.resistance/(float)VOCTable::_table[VOCTable::Good])*100.0f;
+                airQuality = Min( airQuality, 100.0f );
+                sprintf(&str[0], "VOC %03.0f%%", airQuality );
+                memset( voc, ' ', FIELD );
+                memcpy( voc, str, strlen(str) );
+        }
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        void fixedPoint( const Sample & sample, char * temp, char * voc )
+        {
+                memset( temp, ' ', FIELD );
+                FieldWriter(temp, FIELD).text("Temp ").fixed(FieldWriter::toFixed(sample.temperature, 2), 2, 5).text("*C");
+
+                memset( voc, ' ', FIELD );
+                FieldWriter(voc, FIELD).text("VOC ").integer(VOCTable::percentOfGood(sample.resistance), 3, '0').character('%');
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int benchFormatMain( int argc, char ** argv )
+{
+        const unsigned long iterations = argc > 0 ? strtoul(argv[0], nullptr, 10) : 2000000;
+
+        //a sweep over the readings an enclosure sees.
+        const int SAMPLES = 4096;
+        static Sample samples[SAMPLES];
+        for( int i=0; i<SAMPLES; i++ )
+        {
+                samples[i].temperature = -10.0f + (float)i * (70.0f / SAMPLES);
+                samples[i].resistance = (uint32_t)i * (500000u / SAMPLES);
+        }
+
+        //outputs. printf rounds exact binary ties (20.625) to even and keeps
+        //the sign of -0.00, fixed point rounds half away from zero; those are
+        //counted apart from real mismatches.
+        unsigned long mismatches = 0;
+        unsigned long ties = 0;
+        for( int i=0; i<SAMPLES; i++ )
+        {
+                char a[2][FIELD], b[2][FIELD];
+                legacy( samples[i], a[0], a[1] );
+                fixedPoint( samples[i], b[0], b[1] );
+                if( memcmp(a, b, sizeof(a)) == 0 )
+                {
+                        continue;
+                }
+
+                const double scaled = (double)samples[i].temperature * 100.0;
+                if( scaled - floor(scaled) == 0.5 || FieldWriter::toFixed(samples[i].temperature, 2) == 0 )
+                {
+                        ties++;
+                }
+                else if( mismatches++ < 5 )
+                {
+                        printf( "  differs: '%.16s' '%.16s' vs '%.16s' '%.16s'\n", a[0], a[1], b[0], b[1] );
+                }
+        }
+
+        char temp[FIELD], voc[FIELD];
+        volatile char sink = 0;
+
+        uint64_t begin = Sim::Probe::hostNanos();
+        for( unsigned long i=0; i<iterations; i++ )
+        {
+                legacy( samples[i % SAMPLES], temp, voc );
+                sink = sink + temp[7] + voc[5];
+        }
+        const uint64_t legacyNanos = Sim::Probe::hostNanos() - begin;
+
+        begin = Sim::Probe::hostNanos();
+        for( unsigned long i=0; i<iterations; i++ )
+        {
+                fixedPoint( samples[i % SAMPLES], temp, voc );
+                sink = sink + temp[7] + voc[5];
+        }
+        const uint64_t fixedNanos = Sim::Probe::hostNanos() - begin;
+
+        printf( "bench-format: %lu iterations, %lu/%d outputs differ, %lu rounding ties\n", iterations, mismatches, SAMPLES, ties );
+        printf( "  sprintf + float   %8.1f ns/refresh\n", (double)legacyNanos / iterations );
+        printf( "  FieldWriter       %8.1f ns/refresh\n", (double)fixedNanos / iterations );
+        printf( "  speedup           %8.1fx\n", (double)legacyNanos / (double)fixedNanos );
+        return mismatches == 0 ? 0 : 1;
+}
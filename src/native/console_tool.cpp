@@ -0,0 +1,202 @@
+/*------------------------------------------------------------------------------
+    ()      File: console_tool.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Types commands into a simulated cabinet's serial console and prints the
+              replies, then boots it again on the same EEPROM to show what was saved.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../hal.h"
+#include "../pinconfig.h"
+#include "../cabinet.h"
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        const char * DEFAULT_SCRIPT[] =
+        {
+                "help",
+                "stats",
+                "display",
+                "profile",
+                "set refresh 500",
+                "set open 0 0 255",
+                "set leds 40",
+                "set heater 300 100",
+                "set bright 999",
+                "set closed 255 255 255 255 255",
+                "frobnicate",
+                "save",
+                "test",
+                "get",
+        };
+
+        //------------------------------------------------------------------------------
+        // A board with one sensor, on EEPROM that outlives it.
+        //------------------------------------------------------------------------------
+        struct Instance
+        {
+                explicit Instance( Hal::Storage & storage )
+                        : gasSensor( &bus )
+                        , lcd( Cabinet::LcdAddress, 16, 2, LCD_5x8DOTS, bus )
+                        , cabinet( devices(storage) )
+                {
+                }
+
+                Cabinet::Devices devices( Hal::Storage & storage )
+                {
+                        const Cabinet::Devices devices = { &bus, { &gasSensor, nullptr }, &lcd, &leds, &storage, DOORPIN };
+                        return devices;
+                }
+
+                Hal::I2CBus bus;
+                Hal::GasSensor gasSensor;
+                Hal::Lcd lcd;
+                Hal::LedStrip leds;
+                Cabinet cabinet;
+        };
+
+        void run( Cabinet & cabinet, uint64_t micros )
+        {
+                const uint64_t endMicros = Sim::nowMicros() + micros;
+                while( Sim::nowMicros() < endMicros )
+                {
+                        cabinet.loop();
+                        Sim::advanceMicros( idleMicros(cabinet, endMicros - Sim::nowMicros()) );
+                }
+        }
+
+        //------------------------------------------------------------------------------
+        // Types the line, runs until the reply is on the wire and prints the
+        // console lines found in what was transmitted meanwhile.
+        //------------------------------------------------------------------------------
+        void type( Cabinet & cabinet, const char * line )
+        {
+                const size_t from = Sim::serialTransmittedSize();
+                const uint64_t start = Sim::nowMicros();
+                const std::string typed = std::string( line ) + "\n";
+                if( Sim::serialReceive(typed.c_str()) != typed.size() )
+                {
+                        printf( "> %s\n  (RX buffer overrun)\n", line );
+                }
+
+                unsigned long passes = 0;
+                do
+                {
+                        cabinet.loop();
+                        passes++;
+                        Sim::advanceMicros( idleMicros(cabinet, 1000000) );
+                }
+                while( !cabinet.console().idle() || !cabinet.telemetry().idle() );
+                const uint64_t took = Sim::nowMicros() - start;
+
+                printf( "> %-30s (%lu passes, %.1f ms)\n", line, passes, took / 1000.0 );
+                const uint8_t * stream = Sim::serialTransmitted();
+                size_t begin = from;
+                for( size_t i=from; i<Sim::serialTransmittedSize(); i++ )
+                {
+                        if( stream[i] != 0 )
+                        {
+                                continue;
+                        }
+                        if( TelemetryCodec::isText(&stream[begin], i - begin) )
+                        {
+                                std::string text( (const char *)&stream[begin], i - begin );
+                                while( !text.empty() && (text.back() == '\n' || text.back() == '\r') )
+                                {
+                                        text.pop_back();
+                                }
+                                printf( "  %s\n", text.c_str() );
+                        }
+                        begin = i + 1;
+                }
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int consoleMain( int argc, char ** argv )
+{
+        const size_t defaults = sizeof(DEFAULT_SCRIPT) / sizeof(DEFAULT_SCRIPT[0]);
+        const std::vector<const char *> script = argc > 0
+                ? std::vector<const char *>( argv, argv + argc )
+                : std::vector<const char *>( DEFAULT_SCRIPT, DEFAULT_SCRIPT + defaults );
+
+        Sim::World * world = Sim::createWorld();
+        Sim::enterWorld( world );
+        Hal::serialBegin( TELEMETRY_BAUD );
+
+        bool saved = false;
+        bool kept = false;
+        bool dark = false;
+        {
+                Hal::Storage storage;
+                Cabinet::Settings settings;
+                {
+                        Instance instance( storage );
+                        instance.bus.begin();
+                        instance.cabinet.begin();
+                        run( instance.cabinet, 5000000 );
+
+                        for( const char * line : script )
+                        {
+                                type( instance.cabinet, line );
+                        }
+                        run( instance.cabinet, 5000000 );
+
+                        settings = instance.cabinet.settings();
+                        saved = instance.cabinet.settingsSaved();
+                        dark = settings.ledCount >= Hal::LedStrip::Count || Sim::LedStrip::pixel( settings.ledCount ) == 0;
+                }
+
+                printf( "-- reboot --\n" );
+                Instance instance( storage );
+                instance.bus.begin();
+                instance.cabinet.begin();
+                run( instance.cabinet, 2000000 );
+                type( instance.cabinet, "get" );
+                kept = memcmp( &settings, &instance.cabinet.settings(), sizeof(settings) ) == 0;
+        }
+
+        const std::vector<uint8_t> stream( Sim::serialTransmitted(), Sim::serialTransmitted() + Sim::serialTransmittedSize() );
+        const DecodeStats stats = decodeStream( stream, nullptr, nullptr );
+        Sim::enterWorld( nullptr );
+        Sim::destroyWorld( world );
+
+        printf( "console: %lu frames, %lu valid, %lu corrupt, %lu console lines on the same port\n",
+                stats.frames, stats.valid, stats.corrupt, stats.text );
+        printf( "console: LEDs past the strip length %s, settings %s\n",
+                dark ? "dark" : "STILL LIT",
+                !saved ? "not saved" : kept ? "survived the reboot" : "LOST across the reboot" );
+        return stats.corrupt == 0 && dark && (kept || !saved) ? 0 : 2;
+}
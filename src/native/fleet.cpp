@@ -0,0 +1,266 @@
+/*------------------------------------------------------------------------------
+    ()      File: fleet.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Runs a fleet of simulated cabinets, each a Cabinet on devices and
+                            a virtual clock of its own, across host threads. Reports the host
+                            cost per cabinet and the fleet's combined telemetry.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "../hal.h"
+#include "../pinconfig.h"
+#include "../cabinet.h"
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        //time charged for the loop's own bookkeeping on each pass.
+        const uint64_t LOOP_OVERHEAD_US = 20;
+
+        //virtual time each cabinet runs for before its thread moves on.
+        const uint64_t SLICE_US = 100000;
+
+        //------------------------------------------------------------------------------
+        // One board. Everything is built inside its world so the devices charge
+        // their time to its clock.
+        //------------------------------------------------------------------------------
+        struct Instance
+        {
+                Instance()
+                        : gasSensor( &bus )
+                        , lcd( Cabinet::LcdAddress, 16, 2, LCD_5x8DOTS, bus )
+                        , cabinet( devices() )
+                {
+                }
+
+                Cabinet::Devices devices()
+                {
+                        const Cabinet::Devices devices = { &bus, { &gasSensor, nullptr }, &lcd, &leds, &storage, DOORPIN };
+                        return devices;
+                }
+
+                Hal::I2CBus bus;
+                Hal::GasSensor gasSensor;
+                Hal::Lcd lcd;
+                Hal::LedStrip leds;
+                Hal::Storage storage;
+                Cabinet cabinet;
+        };
+
+        struct Board
+        {
+                Sim::World * world = nullptr;
+                std::unique_ptr<Instance> instance;
+                uint64_t endMicros = 0;
+                unsigned long passes = 0;
+                uint64_t hostNanos = 0;
+        };
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        uint64_t threadNanos()
+        {
+                timespec now;
+                clock_gettime( CLOCK_THREAD_CPUTIME_ID, &now );
+                return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+        }
+
+        //------------------------------------------------------------------------------
+        // Builds the board in a world of its own, starting a little after the
+        // last so their sensor and telemetry periods do not line up. The door is
+        // opened and closed on a period of its own per board.
+        //------------------------------------------------------------------------------
+        void build( Board & board, int index, unsigned long seconds )
+        {
+                const uint64_t startMicros = (uint64_t)index * 7919;
+                board.world = Sim::createWorld( startMicros );
+                board.endMicros = startMicros + (uint64_t)seconds * 1000000;
+                Sim::enterWorld( board.world );
+
+                const uint64_t doorPeriod = (10 + index % 23) * 1000000ull;
+                for( uint64_t at = startMicros + doorPeriod; at < board.endMicros; at += doorPeriod )
+                {
+                        Sim::schedulePin( at, DOORPIN, ((at - startMicros) / doorPeriod) % 2 == 1 );
+                }
+
+                Hal::serialBegin( TELEMETRY_BAUD );
+                board.instance.reset( new Instance() );
+                board.instance->bus.begin();
+                board.instance->cabinet.begin();
+                Sim::enterWorld( nullptr );
+        }
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        void step( Board & board )
+        {
+                Sim::enterWorld( board.world );
+                Cabinet & cabinet = board.instance->cabinet;
+                const uint64_t sliceEnd = Min( Sim::nowMicros() + SLICE_US, board.endMicros );
+                const uint64_t hostBegin = threadNanos();
+
+                while( Sim::nowMicros() < sliceEnd )
+                {
+                        cabinet.loop();
+                        board.passes++;
+                        if( !cabinet.sleep() )
+                        {
+                                Sim::advanceMicros( LOOP_OVERHEAD_US );
+                        }
+                }
+
+                board.hostNanos += threadNanos() - hostBegin;
+                Sim::enterWorld( nullptr );
+        }
+
+        //------------------------------------------------------------------------------
+        // Each thread owns a stripe of the boards and round-robins them a slice
+        // at a time, so every clock moves forward at about the same rate.
+        //------------------------------------------------------------------------------
+        void runStripe( std::vector<Board> * boards, int first, int stride, int count, unsigned long seconds )
+        {
+#if defined(PROFILING)
+                Profiler::begin();
+#endif //defined(PROFILING)
+                for( int i=first; i<count; i+=stride )
+                {
+                        build( (*boards)[i], i, seconds );
+                }
+
+                bool running = true;
+                while( running )
+                {
+                        running = false;
+                        for( int i=first; i<count; i+=stride )
+                        {
+                                Board & board = (*boards)[i];
+                                Sim::enterWorld( board.world );
+                                const bool finished = Sim::nowMicros() >= board.endMicros;
+                                Sim::enterWorld( nullptr );
+                                if( !finished )
+                                {
+                                        step( board );
+                                        running = true;
+                                }
+                        }
+                }
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint64_t idleMicros( const Cabinet & cabinet, uint64_t limitMicros )
+{
+        const uint64_t now = Sim::nowMicros();
+        uint64_t idle = Min<uint64_t>( (uint64_t)cabinet.idleMillis( Hal::millis() ) * 1000, limitMicros );
+        const uint64_t edge = Sim::nextPinEventMicros();
+        if( edge != Sim::NoEvent && edge > now )
+        {
+                idle = Min( idle, edge - now );
+        }
+        return Max( idle, LOOP_OVERHEAD_US );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int fleetMain( int argc, char ** argv )
+{
+        const int count = argc > 0 ? atoi(argv[0]) : 100;
+        const unsigned long seconds = argc > 1 ? strtoul(argv[1], nullptr, 10) : 60;
+        const unsigned int hardware = std::thread::hardware_concurrency();
+        const int threads = Max( 1, Min( count, argc > 2 ? atoi(argv[2]) : (int)(hardware != 0 ? hardware : 1) ) );
+
+        if( count < 1 )
+        {
+                fprintf( stderr, "fleet: at least one cabinet\n" );
+                return 1;
+        }
+
+        std::vector<Board> boards( count );
+        timespec wallBegin;
+        clock_gettime( CLOCK_MONOTONIC, &wallBegin );
+
+        std::vector<std::thread> workers;
+        for( int thread=0; thread<threads; thread++ )
+        {
+                workers.emplace_back( runStripe, &boards, thread, threads, count, seconds );
+        }
+        for( std::thread & worker : workers )
+        {
+                worker.join();
+        }
+
+        timespec wallEnd;
+        clock_gettime( CLOCK_MONOTONIC, &wallEnd );
+        const double wallSeconds = (wallEnd.tv_sec - wallBegin.tv_sec) + (wallEnd.tv_nsec - wallBegin.tv_nsec) / 1e9;
+
+        unsigned long valid = 0;
+        unsigned long corrupt = 0;
+        unsigned long readings = 0;
+        unsigned long doorEvents = 0;
+        unsigned long passes = 0;
+        unsigned long idlePermille = 0;
+        uint64_t hostNanos = 0;
+        for( Board & board : boards )
+        {
+                Sim::enterWorld( board.world );
+                const std::vector<uint8_t> stream( Sim::serialTransmitted(), Sim::serialTransmitted() + Sim::serialTransmittedSize() );
+                const DecodeStats stats = decodeStream( stream, nullptr, nullptr );
+                valid += stats.valid;
+                corrupt += stats.corrupt;
+                readings += board.instance->cabinet.sensorReadings();
+                doorEvents += board.instance->cabinet.door().events();
+                passes += board.passes;
+                idlePermille += board.instance->cabinet.idlePermille();
+                hostNanos += board.hostNanos;
+                board.instance.reset();
+                Sim::enterWorld( nullptr );
+                Sim::destroyWorld( board.world );
+        }
+
+        const double simulatedSeconds = (double)count * seconds;
+        printf( "fleet: %d cabinets, %lu s each, %d threads, %.2f s wall\n", count, seconds, threads, wallSeconds );
+        printf( "  sizeof(Cabinet) %zu bytes, with its sim devices %zu bytes\n", sizeof(Cabinet), sizeof(Instance) );
+        printf( "  host cpu       %10.1f us per simulated second per cabinet\n", hostNanos / 1000.0 / simulatedSeconds );
+        printf( "  speed          %10.0f x real time, fleet total\n", simulatedSeconds / wallSeconds );
+        printf( "  loop passes    %10lu, %.0f per simulated second per cabinet\n", passes, passes / simulatedSeconds );
+        printf( "  idle           %10.1f %%, mean over the fleet's last windows\n", idlePermille / 10.0 / count );
+        printf( "\ntelemetry\n" );
+        printf( "  frames         %10lu, %.2f per second fleet wide\n", valid, valid / (double)seconds );
+        printf( "  corrupt        %10lu\n", corrupt );
+        printf( "  readings       %10lu\n", readings );
+        printf( "  door events    %10lu\n", doorEvents );
+        return corrupt == 0 ? 0 : 2;
+}
@@ -0,0 +1,134 @@
+/*------------------------------------------------------------------------------
+    ()      File: hal_native.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Native implementation of the hardware abstraction layer, backed
+              by the simulated devices.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include "../hal.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Clock
+//------------------------------------------------------------------------------
+unsigned long Hal::millis()
+{
+        return (unsigned long)(Sim::nowMicros() / 1000);
+}
+
+unsigned long Hal::micros()
+{
+        return (unsigned long)Sim::nowMicros();
+}
+
+void Hal::delay( unsigned long ms )
+{
+        Sim::advanceMicros( (uint64_t)ms * 1000 );
+}
+
+void Hal::idle( unsigned long ms )
+{
+        Sim::sleepMicros( (uint64_t)ms * 1000 );
+}
+
+void Hal::wake()
+{
+}
+
+//------------------------------------------------------------------------------
+// GPIO
+//------------------------------------------------------------------------------
+void Hal::pinModeInputPullup( uint8_t pin )
+{
+        (void)pin;
+}
+
+bool Hal::digitalRead( uint8_t pin )
+{
+        return Sim::getPin( pin );
+}
+
+//------------------------------------------------------------------------------
+// Interrupts - simulated pin edges call the handler straight away.
+//------------------------------------------------------------------------------
+void Hal::attachPinChange( uint8_t pin, PinChangeHandler handler, void * context )
+{
+        Sim::attachPinChange( pin, handler, context );
+}
+
+//------------------------------------------------------------------------------
+// Serial
+//------------------------------------------------------------------------------
+void Hal::serialBegin( unsigned long baud )
+{
+        Sim::serialBegin( baud );
+}
+
+int Hal::serialAvailableForWrite()
+{
+        return Sim::serialAvailableForWrite();
+}
+
+size_t Hal::serialWrite( const uint8_t * data, size_t length )
+{
+        return Sim::serialWrite( data, length );
+}
+
+int Hal::serialAvailable()
+{
+        return Sim::serialAvailable();
+}
+
+int Hal::serialRead()
+{
+        return Sim::serialRead();
+}
+
+//------------------------------------------------------------------------------
+// LED Strip
+//------------------------------------------------------------------------------
+void Hal::LedStrip::begin()
+{
+}
+
+void Hal::LedStrip::setPixel( uint16_t led, uint8_t r, uint8_t g, uint8_t b )
+{
+        const uint32_t colour = ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+        if( Sim::LedStrip::pixel(led) != colour )
+        {
+                m_strip.setPixel( led, r, g, b );
+                m_changed = true;
+        }
+}
+
+void Hal::LedStrip::show()
+{
+        m_strip.show();
+        m_changed = false;
+}
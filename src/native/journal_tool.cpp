@@ -0,0 +1,243 @@
+/*------------------------------------------------------------------------------
+    ()      File: journal_tool.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Runs the firmware's persistent log on simulated EEPROM: wear and write
+              amplification over a long run, the cost of recovery at boot, and
+              resets cut into the middle of writes.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../hal.h"
+#include "../pinconfig.h"
+#include "../cabinet.h"
+#include "../journal.h"
+#include "../utility.h"
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+extern Hal::Storage g_storage;
+extern Cabinet g_cabinet;
+
+namespace
+{
+        //datasheet endurance of the ATmega328P's EEPROM.
+        const double ENDURANCE_CYCLES = 100000.0;
+
+        //the torn-write trials: records laid down first, so the ring has
+        //wrapped, then the records a reset cuts into.
+        const uint16_t TORN_COMMITTED = 100;
+        const uint16_t TORN_PENDING = 6;
+        const uint8_t TORN_TYPE = 1;
+        const uint8_t TORN_PAYLOAD = 6;
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        struct Tally
+        {
+                unsigned long records = 0;
+                unsigned long boots = 0;
+                unsigned long doors = 0;
+                unsigned long summaries = 0;
+        };
+
+        void countRecord( uint8_t type, const uint8_t *, uint8_t, void * context )
+        {
+                Tally & tally = *static_cast<Tally *>( context );
+                tally.records++;
+                tally.boots += type == Cabinet::Records::Type_Boot ? 1 : 0;
+                tally.doors += type == Cabinet::Records::Type_Door ? 1 : 0;
+                tally.summaries += type == Cabinet::Records::Type_Summary ? 1 : 0;
+        }
+
+        //------------------------------------------------------------------------------
+        // Numbered records, checked to come back as an unbroken run.
+        //------------------------------------------------------------------------------
+        struct Run
+        {
+                bool started = false;
+                bool broken = false;
+                uint16_t next = 0;
+        };
+
+        void checkRecord( uint8_t type, const uint8_t * payload, uint8_t length, void * context )
+        {
+                Run & run = *static_cast<Run *>( context );
+                uint16_t number;
+                memcpy( &number, payload, sizeof(number) );
+                if( !run.started )
+                {
+                        run.started = true;
+                        run.next = number;
+                }
+                run.broken |= type != TORN_TYPE || length != TORN_PAYLOAD || number != run.next;
+                run.next++;
+        }
+
+        void appendNumbered( Journal & journal, uint16_t number )
+        {
+                uint8_t payload[TORN_PAYLOAD] = {};
+                memcpy( payload, &number, sizeof(number) );
+                journal.append( TORN_TYPE, payload, sizeof(payload) );
+                journal.flush();
+        }
+
+        // Runs the cells' timing on the virtual clock until the batch is out.
+        void drain( Journal & journal )
+        {
+                while( journal.busy() )
+                {
+                        journal.service();
+                        Sim::advanceMicros( Sim::Storage::WriteMicros );
+                }
+        }
+
+        //------------------------------------------------------------------------------
+        // What is recovered must be an unbroken run ending no earlier than the
+        // last committed record, and the log must carry on from it.
+        //------------------------------------------------------------------------------
+        bool tornTrial( unsigned long cut, uint16_t & recovered )
+        {
+                Sim::Storage storage;
+                Journal before( storage );
+                before.begin();
+                for( uint16_t number=0; number<TORN_COMMITTED; number++ )
+                {
+                        appendNumbered( before, number );
+                        drain( before );
+                }
+
+                storage.cutAfter( cut );
+                for( uint16_t number=TORN_COMMITTED; number<TORN_COMMITTED + TORN_PENDING; number++ )
+                {
+                        appendNumbered( before, number );
+                        drain( before );
+                }
+                //the cut writes counted nothing real.
+                storage.reconnect();
+                storage.resetStats();
+
+                Journal after( storage );
+                Run run;
+                after.begin();
+                after.replay( checkRecord, &run );
+                recovered = run.next - TORN_COMMITTED;
+
+                appendNumbered( after, run.next );
+                drain( after );
+
+                Journal again( storage );
+                Run rerun;
+                again.begin();
+                again.replay( checkRecord, &rerun );
+                return !run.broken && !rerun.broken && run.next >= TORN_COMMITTED
+                    && rerun.next == run.next + 1 && storage.stats().violations == 0;
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int journalMain( int argc, char ** argv )
+{
+        const unsigned long hours = argc > 0 ? strtoul(argv[0], nullptr, 10) : 48;
+        const unsigned long doorSeconds = argc > 1 ? strtoul(argv[1], nullptr, 10) : 600;
+        if( argc > 2 && !g_storage.open(argv[2]) )
+        {
+                fprintf( stderr, "journal: cannot open %s\n", argv[2] );
+                return 1;
+        }
+
+        //the long run, the firmware sleeping between its work.
+        const uint64_t endMicros = (uint64_t)hours * 3600 * 1000000;
+        const uint64_t doorMicros = (uint64_t)Max<unsigned long>( doorSeconds, 1 ) * 1000000;
+        for( uint64_t at = doorMicros; at < endMicros; at += doorMicros )
+        {
+                Sim::schedulePin( at, DOORPIN, (at / doorMicros) % 2 == 1 );
+        }
+
+        setup();
+        while( Sim::nowMicros() < endMicros )
+        {
+                loop();
+        }
+
+        const Journal & journal = g_cabinet.journal();
+        const Sim::Storage::Stats & stats = g_storage.stats();
+        const unsigned long written = stats.bytesProgrammed + stats.bytesErased;
+        unsigned long minWrites = ~0UL;
+        unsigned long maxWrites = 0;
+        for( uint8_t page=0; page<Sim::Storage::Pages; page++ )
+        {
+                minWrites = Min( minWrites, g_storage.pageWrites(page) );
+                maxWrites = Max( maxWrites, g_storage.pageWrites(page) );
+        }
+        const double cellWritesPerDay = (double)maxWrites / Sim::Storage::PageSize * 24.0 / Max<unsigned long>( hours, 1 );
+
+        printf( "journal: boot %u, %lu h, %lu records of %lu payload bytes, %lu dropped\n",
+                g_cabinet.boots(), hours, journal.appended(), journal.appendedBytes(), journal.dropped() );
+        printf( "journal: %lu bytes programmed, %lu erased, write amplification %.2f\n",
+                stats.bytesProgrammed, stats.bytesErased, journal.appendedBytes() == 0 ? 0.0 : (double)written / journal.appendedBytes() );
+        printf( "journal: %lu pages opened, cell writes per page %lu..%lu, worst cell %.2f a day, %.0f years to %.0fk cycles\n",
+                journal.pagesOpened(), minWrites, maxWrites, cellWritesPerDay,
+                cellWritesPerDay == 0.0 ? 0.0 : ENDURANCE_CYCLES / cellWritesPerDay / 365.0, ENDURANCE_CYCLES / 1000.0 );
+        printf( "journal: %lu door opens logged, baseline %lu ohms, peak %.1f *C\n",
+                g_cabinet.doorOpens(), (unsigned long)g_cabinet.baselineOhms(), g_cabinet.peakTemperature() / 10.0 );
+
+        //a reset now: what finding the head and reading the log back costs.
+        g_storage.resetStats();
+        Journal rebooted( g_storage );
+        const bool found = rebooted.begin();
+        const unsigned long findReads = g_storage.stats().reads;
+        const unsigned long findBytes = g_storage.stats().bytesRead;
+        Tally tally;
+        rebooted.replay( countRecord, &tally );
+        printf( "journal: recovery %s head page %u, %lu reads of %lu bytes to find it, a full scan is %u bytes\n",
+                found && rebooted.headPage() == journal.headPage() && rebooted.sequence() == journal.sequence() ? "found" : "MISSED",
+                rebooted.headPage(), findReads, findBytes, Sim::Storage::Pages * Sim::Storage::PageSize );
+        printf( "journal: %lu records kept, %lu boots, %lu door events, %lu summaries\n",
+                tally.records, tally.boots, tally.doors, tally.summaries );
+
+        //resets at every point while the last records are going out.
+        const unsigned long CUTS = 160;
+        unsigned long failed = 0;
+        unsigned long torn = 0;
+        for( unsigned long cut=0; cut<CUTS; cut++ )
+        {
+                uint16_t recovered = 0;
+                if( !tornTrial(cut, recovered) )
+                {
+                        failed++;
+                        printf( "journal: reset after %lu bytes lost committed records or the log\n", cut );
+                }
+                torn += recovered < TORN_PENDING ? 1 : 0;
+        }
+        printf( "journal: %lu reset points, %lu lost some of the pending records, %lu failed\n", CUTS, torn, failed );
+        return failed == 0 && found ? 0 : 2;
+}
@@ -0,0 +1,171 @@
+/*------------------------------------------------------------------------------
+    ()      File: layout_check.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Host side check of the display layouts. Draws every field of each
+              layout and confirms the panel shows exactly the cells it owns.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include "../layout.h"
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        // A layout exercising right alignment, not used by the firmware.
+        struct AlignedLayout
+        {
+                enum Field { Left, Right, Count };
+                static const uint8_t Width = 8;
+                static const uint8_t Height = 1;
+                static constexpr DisplayField fields[Count] =
+                {
+                        { 0, 0, 2, DisplayField::Left },
+                        { 0, 3, 7, DisplayField::Right },
+                };
+        };
+
+        // Should be refused by the compile time checks.
+        const DisplayField OVERLAPPING[] = { { 0, 0, 5, DisplayField::Left }, { 0, 5, 9, DisplayField::Left } };
+        const DisplayField OUTSIDE[] = { { 0, 10, 16, DisplayField::Left } };
+        const DisplayField BACKWARDS[] = { { 1, 8, 4, DisplayField::Left } };
+        const DisplayField WRONG_LINE[] = { { 2, 0, 3, DisplayField::Left } };
+
+        char s_panel[4][41];
+
+        void capture( void * context, const char * run, uint8_t line, uint8_t column, uint8_t length )
+        {
+                (void)context;
+                memcpy( &s_panel[line][column], run, length );
+        }
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        template<uint8_t Id, typename Layout>
+        struct FillFields
+        {
+                static void fill( Display<Layout> & display )
+                {
+                        FillFields<Id - 1, Layout>::fill( display );
+                        display.template update<Id - 1>( "################################" );
+                }
+        };
+
+        template<typename Layout>
+        struct FillFields<0, Layout>
+        {
+                static void fill( Display<Layout> & ) {}
+        };
+
+        //------------------------------------------------------------------------------
+        // Fills every field to overflowing, draws, and compares each cell with
+        // what the layout says owns it.
+        //------------------------------------------------------------------------------
+        template<typename Layout>
+        int check( const char * name )
+        {
+                int failures = 0;
+                memset( s_panel, ' ', sizeof(s_panel) );
+
+                Display<Layout> display( capture, nullptr );
+                FillFields<Layout::Count, Layout>::fill( display );
+                display.draw();
+
+                printf( "%s, %ux%u, %u fields, Display is %zu bytes\n", name, Layout::Width, Layout::Height, Layout::Count, sizeof(display) );
+                for( uint8_t line=0; line<Layout::Height; line++ )
+                {
+                        char owners[41];
+                        memset( owners, '.', Layout::Width );
+                        owners[Layout::Width] = '\0';
+                        for( uint8_t id=0; id<Layout::Count; id++ )
+                        {
+                                const DisplayField & field = Layout::fields[id];
+                                if( field.line == line )
+                                {
+                                        memset( &owners[field.begin], 'a' + id, field.length() );
+                                }
+                        }
+
+                        for( uint8_t column=0; column<Layout::Width; column++ )
+                        {
+                                const char expected = owners[column] == '.' ? ' ' : '#';
+                                if( s_panel[line][column] != expected )
+                                {
+                                        printf( "  line %u column %u shows '%c', expected '%c'\n", line, column, s_panel[line][column], expected );
+                                        failures++;
+                                }
+                        }
+                        printf( "  |%s|\n", owners );
+                }
+                return failures;
+        }
+}
+
+constexpr DisplayField AlignedLayout::fields[];
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int layoutMain( int argc, char ** argv )
+{
+        (void)argc;
+        (void)argv;
+
+        int failures = check<TempAndVocLayout>( "TempAndVocLayout" );
+        failures += check<AlignedLayout>( "AlignedLayout" );
+
+        //alignment and fixed length copies.
+        memset( s_panel, ' ', sizeof(s_panel) );
+        Display<AlignedLayout> aligned( capture, nullptr );
+        aligned.update<AlignedLayout::Left>( "ab" );
+        aligned.update<AlignedLayout::Right>( "xy" );
+        aligned.draw();
+        if( memcmp(s_panel[0], "ab    xy", 8) != 0 )
+        {
+                printf( "  alignment: |%.8s|, expected |ab    xy|\n", s_panel[0] );
+                failures++;
+        }
+
+        //the checks the Display static_asserts on.
+        struct Case { const char * name; bool valid; } cases[] =
+        {
+                { "overlapping fields", DisplayLayout::disjoint(OVERLAPPING, 2) },
+                { "field past the last column", DisplayLayout::inBounds(OUTSIDE, 1, 16, 2) },
+                { "field ending before it begins", DisplayLayout::inBounds(BACKWARDS, 1, 16, 2) },
+                { "field below the last line", DisplayLayout::inBounds(WRONG_LINE, 1, 16, 2) },
+        };
+        for( const Case & c : cases )
+        {
+                printf( "%-32s %s\n", c.name, c.valid ? "ACCEPTED" : "rejected" );
+                failures += c.valid ? 1 : 0;
+        }
+
+        printf( "%s\n", failures == 0 ? "ok" : "FAILED" );
+        return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,236 @@
+/*------------------------------------------------------------------------------
+    ()      File: lcd_tool.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Counts the bus traffic each panel refresh costs, written a character
+              per transaction and in bursts, at 100kHz and 400kHz, and the longest a
+              single burst holds the bus.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../hal.h"
+#include "../pinconfig.h"
+#include "../cabinet.h"
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        //------------------------------------------------------------------------------
+        // A board with one sensor, built inside its own world.
+        //------------------------------------------------------------------------------
+        struct Instance
+        {
+                Instance()
+                        : gasSensor( &bus )
+                        , lcd( Cabinet::LcdAddress, 16, 2, LCD_5x8DOTS, bus )
+                        , cabinet( devices() )
+                {
+                }
+
+                Cabinet::Devices devices()
+                {
+                        const Cabinet::Devices devices = { &bus, { &gasSensor, nullptr }, &lcd, &leds, &storage, DOORPIN };
+                        return devices;
+                }
+
+                Hal::I2CBus bus;
+                Hal::GasSensor gasSensor;
+                Hal::Lcd lcd;
+                Hal::LedStrip leds;
+                Hal::Storage storage;
+                Cabinet cabinet;
+        };
+
+        struct Traffic
+        {
+                unsigned long refreshes = 0;
+                unsigned long characters = 0;
+                unsigned long transactions = 0;
+                unsigned long bytes = 0;
+        };
+
+        struct Result
+        {
+                uint32_t clockHz = 0;
+                size_t longest = 0;         //bytes in the longest transaction.
+                Traffic first;              //the whole panel, drawn over blank.
+                Traffic after;              //only what changed.
+                bool matches = false;
+        };
+
+        Traffic sample( Instance & instance )
+        {
+                Traffic traffic;
+                traffic.refreshes = instance.cabinet.lcdWriter().refreshes();
+                traffic.characters = instance.lcd.characterWrites();
+                traffic.transactions = instance.lcd.transactions();
+                traffic.bytes = instance.lcd.bytes();
+                return traffic;
+        }
+
+        Traffic operator-( const Traffic & a, const Traffic & b )
+        {
+                Traffic traffic;
+                traffic.refreshes = a.refreshes - b.refreshes;
+                traffic.characters = a.characters - b.characters;
+                traffic.transactions = a.transactions - b.transactions;
+                traffic.bytes = a.bytes - b.bytes;
+                return traffic;
+        }
+
+        //------------------------------------------------------------------------------
+        // The door is opened and shut every 7 s so the alert field is redrawn
+        // as well as the readings.
+        //------------------------------------------------------------------------------
+        Result run( bool batched, uint8_t burstBytes, uint32_t clockHz, unsigned long seconds )
+        {
+                Sim::World * world = Sim::createWorld();
+                Sim::enterWorld( world );
+                Hal::serialBegin( TELEMETRY_BAUD );
+
+                const uint64_t endMicros = (uint64_t)seconds * 1000000;
+                for( uint64_t at = 7000000; at < endMicros; at += 7000000 )
+                {
+                        Sim::schedulePin( at, DOORPIN, (at / 7000000) % 2 == 1 );
+                }
+
+                Result result;
+                result.clockHz = clockHz;
+                {
+                        Instance instance;
+                        Cabinet & cabinet = instance.cabinet;
+                        instance.bus.begin();
+                        cabinet.setLcdBatched( batched );
+                        cabinet.setLcdBurstBytes( burstBytes );
+                        cabinet.begin();
+                        instance.bus.setClock( clockHz );
+
+                        //the library's own initialisation is not counted.
+                        const Traffic start = sample( instance );
+                        Traffic drawn = start;
+                        bool firstDone = false;
+
+                        while( Sim::nowMicros() < endMicros || !cabinet.lcdWriter().idle() )
+                        {
+                                cabinet.loop();
+                                if( !firstDone && cabinet.lcdWriter().refreshes() == 1 && cabinet.lcdWriter().idle() )
+                                {
+                                        firstDone = true;
+                                        drawn = sample( instance );
+                                }
+                                Sim::advanceMicros( idleMicros(cabinet, endMicros > Sim::nowMicros() ? endMicros - Sim::nowMicros() : 0) );
+                        }
+
+                        result.first = drawn - start;
+                        result.after = sample( instance ) - drawn;
+                        result.longest = instance.lcd.longestTransaction();
+                        result.matches = strcmp( instance.lcd.line(0), cabinet.panelText(0) ) == 0
+                                      && strcmp( instance.lcd.line(1), cabinet.panelText(1) ) == 0;
+                }
+
+                Sim::enterWorld( nullptr );
+                Sim::destroyWorld( world );
+                return result;
+        }
+
+        //------------------------------------------------------------------------------
+        // 9 clocks a byte, plus start and stop.
+        //------------------------------------------------------------------------------
+        double busMillis( const Traffic & traffic, uint32_t clockHz )
+        {
+                const double refreshes = traffic.refreshes == 0 ? 1.0 : (double)traffic.refreshes;
+                return (traffic.bytes * 9.0 + traffic.transactions * 2.0) * 1000.0 / clockHz / refreshes;
+        }
+
+        double longestMillis( const Result & result )
+        {
+                return (result.longest * 9.0 + 2.0) * 1000.0 / result.clockHz;
+        }
+
+        void print( const char * name, const Traffic & traffic, uint32_t clockHz )
+        {
+                const double refreshes = traffic.refreshes == 0 ? 1.0 : (double)traffic.refreshes;
+                printf( "    %-24s %4lu kHz  %6lu  %8.1f  %8.1f  %8.2f ms\n", name, (unsigned long)(clockHz / 1000), traffic.refreshes,
+                        traffic.transactions / refreshes, traffic.bytes / refreshes, busMillis(traffic, clockHz) );
+        }
+
+        //------------------------------------------------------------------------------
+        // LiquidCrystal_I2C sends every expander byte as its own transaction,
+        // six for each character or instruction the per character run sent.
+        //------------------------------------------------------------------------------
+        Traffic library( const Traffic & single )
+        {
+                Traffic traffic = single;
+                traffic.transactions = single.transactions * 6;
+                traffic.bytes = single.transactions * 12;
+                return traffic;
+        }
+
+        void report( const char * name, Traffic Result::* part, const Result & single, const Result & batched, const Result & fast )
+        {
+                const Traffic & b = batched.*part;
+                printf( "  %s, %.1f characters a refresh\n", name, b.refreshes == 0 ? 0.0 : (double)b.characters / b.refreshes );
+                print( "library, byte at a time", library(single.*part), single.clockHz );
+                print( "a character at a time", single.*part, single.clockHz );
+                print( "bursts", batched.*part, batched.clockHz );
+                print( "bursts", fast.*part, fast.clockHz );
+                printf( "    bursts take %.2fx the bus time of a character at a time, %.2fx at 400kHz\n",
+                        busMillis(b, batched.clockHz) / busMillis(single.*part, single.clockHz),
+                        busMillis(fast.*part, fast.clockHz) / busMillis(single.*part, single.clockHz) );
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int lcdMain( int argc, char ** argv )
+{
+        const unsigned long seconds = argc > 0 ? strtoul(argv[0], nullptr, 10) : 60;
+
+        const Result single = run( false, LcdWriter::BurstBytes, 100000, seconds );
+        const Result batched = run( true, 8, 100000, seconds );
+        const Result fast = run( true, LcdWriter::MaxBurstBytes, 400000, seconds );
+
+        printf( "lcd: %lu s, bus traffic per panel refresh\n", seconds );
+        printf( "    %-24s %8s  %6s  %8s  %8s  %11s\n", "", "clock", "n", "trans", "bytes", "bus" );
+        report( "first draw", &Result::first, single, batched, fast );
+        report( "changes only", &Result::after, single, batched, fast );
+
+        printf( "lcd: longest burst %.2f ms at 100kHz, %.2f ms at 400kHz\n", longestMillis(batched), longestMillis(fast) );
+
+        const bool matches = single.matches && batched.matches && fast.matches;
+        printf( "lcd: panel %s the display buffer\n", matches ? "matches" : "DIFFERS from" );
+        if( !matches )
+        {
+                return 2;
+        }
+        //a burst should hold the bus no longer than about a millisecond.
+        return longestMillis(batched) <= 1.0 && longestMillis(fast) <= 1.0 ? 0 : 3;
+}
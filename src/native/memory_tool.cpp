@@ -0,0 +1,151 @@
+/*------------------------------------------------------------------------------
+    ()      File: memory_tool.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Reports each subsystem's static footprint against its budget, and how
+              the strip and the panel grow with LEDCOUNT and the panel's size.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include "../hal.h"
+#include "../cabinet.h"
+#include "../memory.h"
+#include "../ws2812.h"
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        //------------------------------------------------------------------------------
+        // A panel of any size with a single field, for sizing Display.
+        //------------------------------------------------------------------------------
+        template<uint8_t W, uint8_t H>
+        struct GridLayout
+        {
+                enum Field { Line, Count };
+                static const uint8_t Width = W;
+                static const uint8_t Height = H;
+                static constexpr DisplayField fields[Count] = { { 0, 0, W - 1, DisplayField::Left } };
+        };
+
+        template<uint8_t W, uint8_t H>
+        constexpr DisplayField GridLayout<W, H>::fields[];
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        unsigned long row( const char * name, unsigned long bytes, const char * note = "" )
+        {
+                printf( "  %-24s %5lu  %s\n", name, bytes, note );
+                return bytes;
+        }
+
+        //------------------------------------------------------------------------------
+        // The state is Height lines of Width + 1 plus a Width shadow; on the AVR
+        // the callback and context add four bytes.
+        //------------------------------------------------------------------------------
+        template<uint8_t W, uint8_t H>
+        void panel()
+        {
+                const unsigned buffers = H * (2 * W + 1);
+                printf( "  %2ux%u   %4u %4zu %6.1f%%   %s\n", W, H, buffers, sizeof(Display< GridLayout<W, H> >),
+                        (buffers + 4) * 100.0 / 2048, buffers <= MemoryBudget::Panel ? "fits" : "over budget" );
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int memoryMain( int argc, char ** argv )
+{
+        const unsigned long leds = argc > 0 ? strtoul(argv[0], nullptr, 10) : 0;
+
+        //the firmware's objects are budgeted their AVR sizes, which the Nano's
+        //build holds them to; the host's say nothing about the board's.
+        printf( "memory: the Nano's SRAM by budget, bytes.\n" );
+        unsigned long total = 0;
+        total += row( "g_cabinet", MemoryBudget::Cabinet );
+        row( "  SensorHistory", MemoryBudget::History, "(in Cabinet)" );
+        row( "  Scheduler", MemoryBudget::Scheduler, "(in Cabinet)" );
+        row( "  I2CQueue", MemoryBudget::BusQueue, "(in Cabinet)" );
+        row( "  LcdWriter", MemoryBudget::LcdWriter, "(in Cabinet)" );
+        row( "  LedEffects", MemoryBudget::Effects, "(in Cabinet)" );
+        row( "  Console", MemoryBudget::Console, "(in Cabinet)" );
+        row( "  Journal", MemoryBudget::Journal, "(in Cabinet)" );
+        row( "  AlertEngine", MemoryBudget::Alerts, "(in Cabinet)" );
+        row( "  TelemetryStream", MemoryBudget::Telemetry, "(in Cabinet)" );
+        row( "  DoorMonitor", MemoryBudget::Door, "(in Cabinet)" );
+        row( "  AdaptiveSampler", MemoryBudget::Sampler, "(in Cabinet)" );
+        total += row( "g_leds", Hal::LedStrip::Count * 3 + 1, "LEDCOUNT pixels" );
+        total += row( "DEVICES", MemoryBudget::Devices, ".data" );
+        total += row( "g_gasSensors", MemoryBudget::GasSensors * MemoryBudget::GasSensor, "estimated" );
+        total += row( "g_lcd", MemoryBudget::Lcd, "estimated" );
+        total += row( "Serial", MemoryBudget::SerialPort, "estimated" );
+        total += row( "Wire and twi buffers", MemoryBudget::WireBuffers, "estimated" );
+        total += row( "FastLED", MemoryBudget::FastLed, "estimated" );
+        total += row( "core and vtables", MemoryBudget::Core, ".data, estimated" );
+        total += row( "tables and literals", MemoryBudget::Tables, ".data, estimated" );
+        total += row( "stack", MemoryBudget::Stack, "reserved" );
+        printf( "  %-24s %5lu  of %u, %s\n", "total", total, MemoryBudget::Sram,
+                total <= MemoryBudget::Sram ? "fits" : "OVER" );
+        const bool ok = total <= MemoryBudget::Sram;
+
+        //the pixels are all that LEDCOUNT grows. FastLED keeps three bytes an
+        //LED; the Blue Pill keeps the pixels and the copy being sent, plus the
+        //ring, which stays the same size.
+        printf( "\nmemory: LED pixels by LEDCOUNT, now %u. Budget %u bytes natively and on the Nano.\n",
+                Hal::LedStrip::Count, MemoryBudget::LedPixels );
+        printf( "  LEDs    Nano  of 2KB   Blue Pill  of 20KB\n" );
+        const unsigned long counts[] = { 30, 50, 100, 150, 300, 1000, leds };
+        for( unsigned long count : counts )
+        {
+                if( count == 0 )
+                {
+                        continue;
+                }
+                const unsigned long nano = count * 3;
+                const unsigned long bluePill = count * 6 + Ws2812Stream::RingSize;
+                printf( "  %4lu   %5lu %6.1f%%   %7lu %6.1f%%   %s\n", count,
+                        nano, nano * 100.0 / 2048, bluePill, bluePill * 100.0 / 20480,
+                        nano <= MemoryBudget::LedPixels ? "fits" : "over the Nano's budget" );
+        }
+
+        printf( "\nmemory: panel buffers by size, now %ux%u. Budget %u bytes natively and on the Nano.\n",
+                TempAndVocLayout::Width, TempAndVocLayout::Height, MemoryBudget::Panel );
+        printf( "  size  bytes host  of 2KB\n" );
+        panel<16, 2>();
+        panel<20, 2>();
+        panel<24, 2>();
+        panel<16, 4>();
+        panel<20, 4>();
+        panel<40, 4>();
+
+        printf( "\nmemory: check_ram.py measures the Nano's .data and .bss after every build. The\n"
+                "console's memory command reads them on the board, with the least free RAM\n"
+                "seen by a loop pass and stack never used.\n" );
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+/*------------------------------------------------------------------------------
+    ()      File: native_main.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Native build entry point. Dispatches to the host-side tools.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        struct Tool
+        {
+                const char * name;
+                int (*entry)( int, char ** );
+                const char * usage;
+        };
+
+        const Tool s_tools[] =
+        {
+                { "bench", benchMain, "bench [seconds] [door-period-ms] [adaptive|fixed]" },
+                { "bench-format", benchFormatMain, "bench-format [iterations]" },
+                { "telemetry", telemetryMain, "telemetry record <file> [seconds] | decode <file> | replay <file> [speed]" },
+                { "slaves", slavesMain, "slaves [count] [seconds] [clock-hz]" },
+                { "layout", layoutMain, "layout" },
+                { "fleet", fleetMain, "fleet [count] [seconds] [threads]" },
+                { "trace", traceMain, "trace record <trace> [seconds] | import <capture> <trace> | replay <trace> [output] | check <trace> <golden>" },
+                { "journal", journalMain, "journal [hours] [door-period-s] [eeprom-file]" },
+                { "alerts", alertsMain, "alerts [minutes]" },
+                { "sensors", sensorsMain, "sensors [seconds]" },
+                { "lcd", lcdMain, "lcd [seconds]" },
+                { "console", consoleMain, "console [command]..." },
+                { "ws2812", ws2812Main, "ws2812 [leds] [iterations]" },
+                { "memory", memoryMain, "memory [leds]" },
+        };
+        const int TOOL_COUNT = sizeof(s_tools) / sizeof(s_tools[0]);
+}
+
+//------------------------------------------------------------------------------
+// With no tool named, the benchmark runs with its defaults.
+//------------------------------------------------------------------------------
+int main( int argc, char ** argv )
+{
+        if( argc < 2 )
+        {
+                return benchMain( 0, nullptr );
+        }
+
+        for( int tool=0; tool<TOOL_COUNT; tool++ )
+        {
+                if( strcmp(argv[1], s_tools[tool].name) == 0 )
+                {
+                        return s_tools[tool].entry( argc - 2, argv + 2 );
+                }
+        }
+
+        fprintf( stderr, "usage:\n" );
+        for( int tool=0; tool<TOOL_COUNT; tool++ )
+        {
+                fprintf( stderr, "  %s %s\n", argv[0], s_tools[tool].usage );
+        }
+        return 1;
+}
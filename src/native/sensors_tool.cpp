@@ -0,0 +1,173 @@
+/*------------------------------------------------------------------------------
+    ()      File: sensors_tool.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Times the sensor cycle with one BME680 and with a pair on the local
+              bus, with their conversions overlapping and one after another.
+              The bus transactions are serialised either way.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include "../hal.h"
+#include "../pinconfig.h"
+#include "../cabinet.h"
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        //------------------------------------------------------------------------------
+        // A board with the second sensor strapped to 0x77 and mounted higher up,
+        // where the enclosure is warmer. Built inside its own world.
+        //------------------------------------------------------------------------------
+        struct Instance
+        {
+                explicit Instance( bool pair )
+                        : top( &bus, 0x76 )
+                        , bottom( &bus, 0x77 )
+                        , lcd( Cabinet::LcdAddress, 16, 2, LCD_5x8DOTS, bus )
+                        , cabinet( devices(pair) )
+                {
+                        top.setTemperatureOffset( 1.5f );
+                }
+
+                Cabinet::Devices devices( bool pair )
+                {
+                        const Cabinet::Devices devices = { &bus, { &top, pair ? &bottom : nullptr }, &lcd, &leds, &storage, DOORPIN };
+                        return devices;
+                }
+
+                Hal::I2CBus bus;
+                Hal::GasSensor top;
+                Hal::GasSensor bottom;
+                Hal::Lcd lcd;
+                Hal::LedStrip leds;
+                Hal::Storage storage;
+                Cabinet cabinet;
+        };
+
+        struct Result
+        {
+                unsigned long cycles = 0;
+                unsigned long cyclesUnplugged = 0;      //after the bottom sensor is pulled.
+                double meanCycleMs = 0.0;
+                unsigned long maxCycleUs = 0;
+                uint8_t sensors = 0;
+                EnvironmentInfo aggregate;
+                EnvironmentInfo first;
+                EnvironmentInfo second;
+        };
+
+        //------------------------------------------------------------------------------
+        // Sampling is held in Fast so every cycle does the same work. With
+        // unplug the bottom sensor is pulled halfway through.
+        //------------------------------------------------------------------------------
+        Result run( bool pair, bool pipelined, unsigned long seconds, bool unplug = false )
+        {
+                Sim::World * world = Sim::createWorld();
+                Sim::enterWorld( world );
+                Hal::serialBegin( TELEMETRY_BAUD );
+
+                Result result;
+                {
+                        Instance instance( pair );
+                        Cabinet & cabinet = instance.cabinet;
+                        instance.bus.begin();
+                        cabinet.sampler().setAdaptive( false );
+                        cabinet.setPipelined( pipelined );
+                        cabinet.begin();
+
+                        const uint64_t endMicros = (uint64_t)seconds * 1000000;
+                        const uint64_t unplugMicros = unplug ? endMicros / 2 : endMicros;
+                        unsigned long readings = cabinet.sensorReadings();
+                        uint64_t totalMicros = 0;
+                        while( Sim::nowMicros() < endMicros )
+                        {
+                                const bool unplugged = Sim::nowMicros() >= unplugMicros;
+                                instance.bottom.setConnected( !unplugged );
+                                cabinet.loop();
+                                if( cabinet.sensorReadings() != readings )
+                                {
+                                        readings = cabinet.sensorReadings();
+                                        result.cycles++;
+                                        result.cyclesUnplugged += unplugged ? 1 : 0;
+                                        totalMicros += cabinet.cycleMicros();
+                                        result.maxCycleUs = Max( result.maxCycleUs, cabinet.cycleMicros() );
+                                }
+                                Sim::advanceMicros( idleMicros(cabinet, endMicros - Sim::nowMicros()) );
+                        }
+
+                        result.meanCycleMs = result.cycles == 0 ? 0.0 : totalMicros / 1000.0 / result.cycles;
+                        result.sensors = cabinet.sensorCount();
+                        result.aggregate = cabinet.environment();
+                        result.first = cabinet.sensorEnvironment( 0 );
+                        result.second = cabinet.sensorEnvironment( 1 );
+                }
+
+                Sim::enterWorld( nullptr );
+                Sim::destroyWorld( world );
+                return result;
+        }
+
+        void print( const char * name, const Result & result )
+        {
+                printf( "  %-22s %u  %8lu  %10.1f ms  %8.1f ms\n", name, result.sensors, result.cycles,
+                        result.meanCycleMs, result.maxCycleUs / 1000.0 );
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int sensorsMain( int argc, char ** argv )
+{
+        const unsigned long seconds = argc > 0 ? strtoul(argv[0], nullptr, 10) : 60;
+
+        const Result single = run( false, true, seconds );
+        const Result sequential = run( true, false, seconds );
+        const Result pipelined = run( true, true, seconds );
+        const Result unplugged = run( true, true, seconds, true );
+
+        printf( "sensors: %lu s each, first conversion to last reading\n", seconds );
+        printf( "  %-22s %s  %8s  %13s  %11s\n", "", "n", "cycles", "mean", "max" );
+        print( "one sensor", single );
+        print( "pair, one at a time", sequential );
+        print( "pair, overlapped", pipelined );
+        print( "pair, one pulled", unplugged );
+        printf( "sensors: overlapped the pair takes %.2fx one sensor's cycle, one at a time %.2fx\n",
+                pipelined.meanCycleMs / single.meanCycleMs, sequential.meanCycleMs / single.meanCycleMs );
+        printf( "sensors: top %.2f *C, bottom %.2f *C, enclosure %.2f *C, worst air %lu ohms\n",
+                pipelined.first.temperature, pipelined.second.temperature,
+                pipelined.aggregate.temperature, (unsigned long)pipelined.aggregate.voc );
+        printf( "sensors: with the bottom pulled, %lu cycles after, enclosure %.2f *C from the top alone\n",
+                unplugged.cyclesUnplugged, unplugged.aggregate.temperature );
+
+        const bool carriedOn = unplugged.sensors == 1 && unplugged.cyclesUnplugged != 0
+                            && unplugged.aggregate.temperature == unplugged.first.temperature;
+        return pipelined.sensors == 2 && single.sensors == 1 && carriedOn ? 0 : 2;
+}
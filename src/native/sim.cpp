@@ -0,0 +1,1092 @@
+/*------------------------------------------------------------------------------
+    ()      File: sim.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Simulated back-ends for the native build.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include "sim.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <math.h>
+#include <string.h>
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Everything one simulated board owns.
+//------------------------------------------------------------------------------
+struct Sim::World
+{
+        struct PinEvent
+        {
+                uint64_t atMicros;
+                uint8_t pin;
+                bool level;
+        };
+
+        uint64_t now = 0;
+        uint8_t pins[256];
+        void (*pinHandlers[256])( void * context ) = {};
+        void * pinContexts[256] = {};
+        std::vector<PinEvent> pinEvents;    //kept sorted, soonest last.
+
+        uint32_t pixels[Sim::LedStrip::MaxPixels];
+        uint16_t pixelCount = 0;
+        unsigned long pushes = 0;
+
+        unsigned long baud = 0;
+        int serialQueued = 0;
+        uint64_t serialDrainedAt = 0;
+        uint64_t serialBlockedMicros = 0;
+        std::vector<uint8_t> serialTransmitted;
+        std::deque<uint8_t> serialReceived;
+
+        World() { memset( pins, 1, sizeof(pins) ); }
+};
+
+namespace
+{
+        thread_local Sim::World t_defaultWorld;
+        thread_local Sim::World * t_world = &t_defaultWorld;
+
+        Sim::World & current()
+        {
+                return *t_world;
+        }
+
+        //probes are per thread, a fleet's worker threads never share counters.
+        thread_local Sim::ProbeStats s_probes[Sim::Probe::MaxProbes];
+
+        Sim::Reading defaultSource( unsigned long timeMs );
+        Sim::BME680::Source s_source = defaultSource;
+
+        const int SERIAL_TX_BUFFER = 63;
+        const size_t SERIAL_RX_BUFFER = 64;
+
+        //------------------------------------------------------------------------------
+        // Ten bit times per byte, 8N1.
+        //------------------------------------------------------------------------------
+        void serialDrain()
+        {
+                Sim::World & world = current();
+                if( world.baud == 0 )
+                {
+                        return;
+                }
+
+                const uint64_t byteMicros = 10000000ull / world.baud;
+                const uint64_t drained = (world.now - world.serialDrainedAt) / byteMicros;
+                if( drained >= (uint64_t)world.serialQueued )
+                {
+                        world.serialQueued = 0;
+                        world.serialDrainedAt = world.now;
+                }
+                else
+                {
+                        world.serialQueued -= (int)drained;
+                        world.serialDrainedAt += drained * byteMicros;
+                }
+        }
+
+        //------------------------------------------------------------------------------
+        // A slow drift with a little deterministic noise, roughly what a closed
+        // enclosure looks like while printing.
+        //------------------------------------------------------------------------------
+        Sim::Reading defaultSource( unsigned long timeMs )
+        {
+                const double t = timeMs / 1000.0;
+                const double noise = (double)((timeMs * 2654435761u) >> 24 & 0xFF) / 255.0 - 0.5;
+
+                Sim::Reading reading;
+                reading.temperature = (float)(24.0 + 3.0 * sin(t / 600.0) + noise * 0.05);
+                reading.humidity = (float)(40.0 + 2.0 * sin(t / 900.0));
+                reading.pressure = 101325;
+                reading.gas_resistance = (uint32_t)(250000.0 + 80000.0 * sin(t / 300.0) + noise * 2000.0);
+                return reading;
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// World
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+Sim::World * Sim::createWorld( uint64_t startMicros )
+{
+        World * world = new World();
+        world->now = startMicros;
+        return world;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::destroyWorld( World * world )
+{
+        if( world == t_world )
+        {
+                t_world = &t_defaultWorld;
+        }
+        delete world;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::enterWorld( World * world )
+{
+        t_world = world != nullptr ? world : &t_defaultWorld;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Clock
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint64_t Sim::nowMicros()
+{
+        return current().now;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::advanceMicros( uint64_t us )
+{
+        World & world = current();
+        const uint64_t target = world.now + us;
+        while( !world.pinEvents.empty() && world.pinEvents.back().atMicros <= target )
+        {
+                const World::PinEvent event = world.pinEvents.back();
+                world.pinEvents.pop_back();
+                world.now = std::max( world.now, event.atMicros );
+                setPin( event.pin, event.level );
+        }
+        world.now = target;
+}
+
+//------------------------------------------------------------------------------
+// As a sleeping core, woken by the edge's interrupt.
+//------------------------------------------------------------------------------
+void Sim::sleepMicros( uint64_t us )
+{
+        const uint64_t now = nowMicros();
+        const uint64_t edge = nextPinEventMicros();
+        advanceMicros( edge != NoEvent && edge > now && edge - now < us ? edge - now : us );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint64_t Sim::nextPinEventMicros()
+{
+        const World & world = current();
+        return world.pinEvents.empty() ? NoEvent : world.pinEvents.back().atMicros;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// GPIO
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::setPin( uint8_t pin, bool level )
+{
+        World & world = current();
+        const uint8_t previous = world.pins[pin];
+        world.pins[pin] = level ? 1 : 0;
+        if( previous != world.pins[pin] && world.pinHandlers[pin] != nullptr )
+        {
+                world.pinHandlers[pin]( world.pinContexts[pin] );
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Sim::getPin( uint8_t pin )
+{
+        return current().pins[pin] != 0;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::attachPinChange( uint8_t pin, void (*handler)( void * context ), void * context )
+{
+        World & world = current();
+        world.pinHandlers[pin] = handler;
+        world.pinContexts[pin] = context;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::schedulePin( uint64_t atMicros, uint8_t pin, bool level )
+{
+        World & world = current();
+        using PinEvent = World::PinEvent;
+        const PinEvent event = { atMicros, pin, level };
+        auto later = []( const PinEvent & a, const PinEvent & b ) { return a.atMicros > b.atMicros; };
+        world.pinEvents.insert( std::lower_bound(world.pinEvents.begin(), world.pinEvents.end(), event, later), event );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Probe
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+Sim::Probe::Probe( const char * name )
+        : m_stats( nullptr )
+        , m_virtualBegin( nowMicros() )
+        , m_hostBegin( hostNanos() )
+{
+        for( uint8_t i=0; i<MaxProbes; i++ )
+        {
+                if( s_probes[i].name == nullptr || strcmp(s_probes[i].name, name) == 0 )
+                {
+                        s_probes[i].name = name;
+                        m_stats = &s_probes[i];
+                        break;
+                }
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+Sim::Probe::~Probe()
+{
+        if( m_stats == nullptr )
+        {
+                return;
+        }
+
+        const uint64_t virtualTime = nowMicros() - m_virtualBegin;
+        const uint64_t hostTime = hostNanos() - m_hostBegin;
+
+        m_stats->count++;
+        m_stats->virtualMicros += virtualTime;
+        m_stats->hostNanos += hostTime;
+        if( virtualTime > m_stats->virtualMaxMicros ) m_stats->virtualMaxMicros = virtualTime;
+        if( hostTime > m_stats->hostMaxNanos ) m_stats->hostMaxNanos = hostTime;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint64_t Sim::Probe::hostNanos()
+{
+        using namespace std::chrono;
+        return (uint64_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+const Sim::ProbeStats * Sim::Probe::stats( uint8_t index )
+{
+        if( index >= MaxProbes || s_probes[index].name == nullptr )
+        {
+                return nullptr;
+        }
+        return &s_probes[index];
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::Probe::resetAll()
+{
+        for( uint8_t i=0; i<MaxProbes; i++ )
+        {
+                s_probes[i] = ProbeStats();
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// I2C Bus
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::I2CBus::beginTransmission( uint8_t address )
+{
+        m_txAddress = address;
+        m_txLength = 0;
+}
+
+//------------------------------------------------------------------------------
+// As Wire, bytes past the buffer are refused.
+//------------------------------------------------------------------------------
+size_t Sim::I2CBus::write( uint8_t data )
+{
+        if( m_txLength >= BufferLength )
+        {
+                return 0;
+        }
+        m_tx[m_txLength++] = data;
+        return 1;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t Sim::I2CBus::write( const uint8_t * data, size_t length )
+{
+        size_t written = 0;
+        while( written < length && write(data[written]) != 0 )
+        {
+                written++;
+        }
+        return written;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint8_t Sim::I2CBus::endTransmission( bool stop )
+{
+        (void)stop;
+        charge( 1 + m_txLength );   //address byte.
+
+        I2CDevice * target = device( m_txAddress );
+        if( target != nullptr )
+        {
+                target->received( m_tx, m_txLength );
+        }
+        m_txLength = 0;
+        return 0;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::I2CBus::attach( uint8_t address, I2CDevice * device )
+{
+        if( address < 128 )
+        {
+                m_devices[address] = device;
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint8_t Sim::I2CBus::requestFrom( uint8_t address, uint8_t count )
+{
+        count = count < BufferLength ? count : BufferLength;
+        charge( 1 + count );
+
+        memset( m_rx, 0, count );
+        I2CDevice * target = device( address );
+        if( target != nullptr )
+        {
+                target->requested( m_rx, count );
+        }
+        m_rxLength = count;
+        m_rxIndex = 0;
+        return count;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+Sim::I2CDevice * Sim::I2CBus::device( uint8_t address ) const
+{
+        return address < 128 ? m_devices[address] : nullptr;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int Sim::I2CBus::read()
+{
+        if( m_rxIndex >= m_rxLength )
+        {
+                return -1;
+        }
+        return m_rx[m_rxIndex++];
+}
+
+//------------------------------------------------------------------------------
+// 9 clocks per byte (8 data + ack), plus start and stop conditions.
+//------------------------------------------------------------------------------
+void Sim::I2CBus::charge( unsigned long bytes )
+{
+        const uint64_t bits = bytes * 9 + 2;
+        const uint64_t us = (bits * 1000000 + m_clockHz - 1) / m_clockHz;
+
+        m_stats.transactions++;
+        m_stats.bytes += bytes;
+        m_stats.busMicros += us;
+        advanceMicros( us );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// BME680
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Sim::BME680::begin( uint8_t address, bool initSettings )
+{
+        (void)initSettings;
+        m_address = address;
+        registerRead( 1 );      //chip id.
+        if( address != m_strapped )
+        {
+                return false;
+        }
+        registerRead( 41 );     //calibration block.
+        return true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Sim::BME680::setGasHeater( uint16_t heaterTemp, uint16_t heaterTime )
+{
+        (void)heaterTemp;
+        m_heaterTime = heaterTime;
+        registerWrite( 2 );
+        return true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+unsigned long Sim::BME680::beginReading()
+{
+        if( !m_connected )
+        {
+                registerWrite( 2 );
+                m_inProgress = false;
+                return 0;
+        }
+
+        //oversampling, heater profile and forced mode.
+        registerWrite( 2 );
+        registerWrite( 2 );
+        registerWrite( 2 );
+        registerWrite( 2 );
+
+        m_inProgress = true;
+        m_readingEnd = (unsigned long)(nowMicros() / 1000) + measurementMillis();
+        m_charge += measurementCharge();
+        return m_readingEnd;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Sim::BME680::endReading()
+{
+        if( !m_inProgress && beginReading() == 0 )
+        {
+                return false;
+        }
+
+        //endReading blocks until the measurement completes.
+        const int remaining = remainingReadingMillis();
+        if( remaining > 0 )
+        {
+                advanceMicros( (uint64_t)remaining * 1000 );
+        }
+
+        registerRead( 15 );     //field data.
+        m_inProgress = false;
+        m_readings++;
+
+        const Reading reading = s_source( (unsigned long)(nowMicros() / 1000) );
+        temperature = reading.temperature + m_temperatureOffset;
+        humidity = reading.humidity;
+        pressure = reading.pressure;
+        gas_resistance = reading.gas_resistance;
+        return true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int Sim::BME680::remainingReadingMillis()
+{
+        if( !m_inProgress )
+        {
+                return reading_not_started;
+        }
+
+        const unsigned long now = (unsigned long)(nowMicros() / 1000);
+        if( (long)(m_readingEnd - now) <= 0 )
+        {
+                return reading_complete;
+        }
+        return (int)(m_readingEnd - now);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::BME680::setSource( Source source )
+{
+        s_source = source ? source : defaultSource;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::BME680::registerWrite( uint8_t count )
+{
+        const uint64_t begin = nowMicros();
+        m_bus->beginTransmission( m_address );
+        for( uint8_t i=0; i<count; i++ )
+        {
+                m_bus->write( 0 );
+        }
+        m_bus->endTransmission();
+        m_busMicros += nowMicros() - begin;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::BME680::registerRead( uint8_t count )
+{
+        const uint64_t begin = nowMicros();
+        m_bus->beginTransmission( m_address );
+        m_bus->write( 0 );
+        m_bus->endTransmission( false );
+        m_bus->requestFrom( m_address, count );
+        while( m_bus->available() )
+        {
+                m_bus->read();
+        }
+        m_busMicros += nowMicros() - begin;
+}
+
+//------------------------------------------------------------------------------
+// Per the BME680 datasheet, 1.963ms per oversampling cycle plus fixed
+// conversion overheads and the heater duration.
+//------------------------------------------------------------------------------
+unsigned long Sim::BME680::measurementMillis() const
+{
+        static const uint8_t cycles[] = { 0, 1, 2, 4, 8, 16 };
+        const unsigned long total = cycles[m_osTemperature] + cycles[m_osPressure] + cycles[m_osHumidity];
+        const unsigned long us = total * 1963 + 477 * 4 + 477 * 5 + 1000;
+        return (us + 999) / 1000 + m_heaterTime;
+}
+
+//------------------------------------------------------------------------------
+// Datasheet supply currents: 350uA temperature, 714uA pressure and 340uA
+// humidity while converting, about 12mA with the heater at 320*C.
+//------------------------------------------------------------------------------
+uint64_t Sim::BME680::measurementCharge() const
+{
+        static const uint8_t cycles[] = { 0, 1, 2, 4, 8, 16 };
+        const uint64_t conversion = (uint64_t)cycles[m_osTemperature] * 1963 * 350
+                                  + (uint64_t)cycles[m_osPressure] * 1963 * 714
+                                  + (uint64_t)cycles[m_osHumidity] * 1963 * 340;
+        return conversion + (uint64_t)m_heaterTime * 1000 * 12000;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// LCD
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+namespace
+{
+        const uint8_t LCD_CLEARDISPLAY = 0x01;
+        const uint8_t LCD_SETDDRAMADDR = 0x80;
+        const uint8_t LCD_BACKLIGHT = 0x08;
+        const uint8_t LCD_EN = 0x04;
+        const uint8_t LCD_RS = 0x01;
+        const uint8_t s_rowOffsets[] = { 0x00, 0x40, 0x14, 0x54 };
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+Sim::Lcd::Lcd( uint8_t address, uint8_t columns, uint8_t rows, uint8_t charsize, I2CBus & bus )
+        : m_bus( bus )
+        , m_address( address )
+        , m_columns( columns < MaxColumns ? columns : MaxColumns )
+        , m_rows( rows < MaxRows ? rows : MaxRows )
+{
+        (void)charsize;
+        memset( m_frame, 0, sizeof(m_frame) );
+        m_bus.attach( address, this );
+}
+
+//------------------------------------------------------------------------------
+// Initialisation sequence: 4-bit mode handshake, function set, display
+// control, clear, entry mode and home.
+//------------------------------------------------------------------------------
+void Sim::Lcd::begin()
+{
+        expanderWrite( m_backlight );
+        advanceMicros( 1000 );
+        for( int i=0; i<3; i++ )
+        {
+                write4bits( 0x30 );
+                advanceMicros( 4500 );
+        }
+        write4bits( 0x20 );
+        command( 0x28 );
+        command( 0x0C );
+        clear();
+        command( 0x06 );
+        command( 0x02 );
+        advanceMicros( 2000 );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::Lcd::backlight()
+{
+        m_backlight = LCD_BACKLIGHT;
+        expanderWrite( 0 );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::Lcd::clear()
+{
+        command( LCD_CLEARDISPLAY );
+        advanceMicros( 2000 );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::Lcd::setCursor( uint8_t column, uint8_t row )
+{
+        if( row >= m_rows )
+        {
+                row = m_rows - 1;
+        }
+        command( LCD_SETDDRAMADDR | (column + s_rowOffsets[row]) );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t Sim::Lcd::write( uint8_t value )
+{
+        send( value, LCD_RS );
+        return 1;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::Lcd::printstr( const char * str )
+{
+        while( *str )
+        {
+                write( (uint8_t)*str++ );
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::Lcd::command( uint8_t value )
+{
+        send( value, 0 );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::Lcd::send( uint8_t value, uint8_t mode )
+{
+        write4bits( (value & 0xF0) | mode );
+        write4bits( ((value << 4) & 0xF0) | mode );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::Lcd::write4bits( uint8_t value )
+{
+        expanderWrite( value );
+        expanderWrite( value | LCD_EN );
+        advanceMicros( 1 );
+        expanderWrite( value & ~LCD_EN );
+        advanceMicros( 50 );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::Lcd::expanderWrite( uint8_t value )
+{
+        m_bus.beginTransmission( m_address );
+        m_bus.write( value | m_backlight );
+        m_bus.endTransmission();
+}
+
+//------------------------------------------------------------------------------
+// The HD44780 latches the data pins on the falling edge of enable.
+//------------------------------------------------------------------------------
+void Sim::Lcd::received( const uint8_t * data, size_t length )
+{
+        m_transactions++;
+        m_bytes += 1 + length;
+        m_longest = length + 1 > m_longest ? length + 1 : m_longest;
+        for( size_t i=0; i<length; i++ )
+        {
+                const uint8_t pins = data[i];
+                if( (m_pins & LCD_EN) != 0 && (pins & LCD_EN) == 0 )
+                {
+                        strobed( m_pins & 0xF0, (m_pins & LCD_RS) != 0 );
+                }
+                m_pins = pins;
+        }
+}
+
+//------------------------------------------------------------------------------
+// Until function set selects 4-bit mode each strobe is a whole instruction,
+// after it strobes pair up high nibble first.
+//------------------------------------------------------------------------------
+void Sim::Lcd::strobed( uint8_t nibble, bool data )
+{
+        if( !m_fourBit )
+        {
+                if( (nibble & 0xF0) == 0x20 )
+                {
+                        m_fourBit = true;
+                        m_haveHighNibble = false;
+                }
+                return;
+        }
+
+        if( !m_haveHighNibble )
+        {
+                m_highNibble = nibble;
+                m_haveHighNibble = true;
+                return;
+        }
+
+        m_haveHighNibble = false;
+        const uint8_t value = m_highNibble | (nibble >> 4);
+        if( data )
+        {
+                character( value );
+        }
+        else
+        {
+                instruction( value );
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::Lcd::instruction( uint8_t value )
+{
+        if( value & LCD_SETDDRAMADDR )
+        {
+                m_ddram = value & 0x7F;
+        }
+        else if( value == LCD_CLEARDISPLAY )
+        {
+                blank();
+                m_ddram = 0;
+        }
+        else if( (value & 0xFE) == 0x02 )       //return home.
+        {
+                m_ddram = 0;
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::Lcd::character( uint8_t value )
+{
+        for( uint8_t row=0; row<m_rows; row++ )
+        {
+                if( m_ddram >= s_rowOffsets[row] && m_ddram < s_rowOffsets[row] + m_columns )
+                {
+                        m_frame[row][m_ddram - s_rowOffsets[row]] = (char)value;
+                        break;
+                }
+        }
+        m_ddram = (m_ddram + 1) & 0x7F;
+        m_characterWrites++;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::Lcd::blank()
+{
+        for( uint8_t row=0; row<m_rows; row++ )
+        {
+                memset( m_frame[row], ' ', m_columns );
+                m_frame[row][m_columns] = '\0';
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// LED Strip
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+Sim::LedStrip::LedStrip( uint16_t count )
+        : m_count( count < MaxPixels ? count : MaxPixels )
+{
+        current().pixelCount = m_count;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::LedStrip::setPixel( uint16_t led, uint8_t r, uint8_t g, uint8_t b )
+{
+        if( led < m_count )
+        {
+                current().pixels[led] = ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+        }
+}
+
+//------------------------------------------------------------------------------
+// 24 bits at 800kHz per pixel, then the 50us latch.
+//------------------------------------------------------------------------------
+void Sim::LedStrip::show()
+{
+        advanceMicros( (uint64_t)m_count * 30 + 50 );
+        current().pushes++;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+unsigned long Sim::LedStrip::pushes()
+{
+        return current().pushes;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint32_t Sim::LedStrip::pixel( uint16_t led )
+{
+        World & world = current();
+        return led < world.pixelCount ? world.pixels[led] : 0;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint16_t Sim::LedStrip::count()
+{
+        return current().pixelCount;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Serial
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Sim::serialBegin( unsigned long baud )
+{
+        World & world = current();
+        world.baud = baud;
+        world.serialQueued = 0;
+        world.serialDrainedAt = world.now;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+unsigned long Sim::serialBaud()
+{
+        return current().baud;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int Sim::serialAvailableForWrite()
+{
+        serialDrain();
+        return SERIAL_TX_BUFFER - current().serialQueued;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t Sim::serialWrite( const uint8_t * data, size_t length )
+{
+        World & world = current();
+        for( size_t i=0; i<length; i++ )
+        {
+                serialDrain();
+                if( world.serialQueued >= SERIAL_TX_BUFFER && world.baud != 0 )
+                {
+                        const uint64_t byteMicros = 10000000ull / world.baud;
+                        const uint64_t wait = byteMicros - (world.now - world.serialDrainedAt);
+                        world.serialBlockedMicros += wait;
+                        advanceMicros( wait );
+                        serialDrain();
+                }
+                world.serialQueued++;
+                world.serialTransmitted.push_back( data[i] );
+        }
+        return length;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int Sim::serialAvailable()
+{
+        return (int)current().serialReceived.size();
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int Sim::serialRead()
+{
+        World & world = current();
+        if( world.serialReceived.empty() )
+        {
+                return -1;
+        }
+        const uint8_t value = world.serialReceived.front();
+        world.serialReceived.pop_front();
+        return value;
+}
+
+//------------------------------------------------------------------------------
+// Returns how much of the text fitted in the RX buffer.
+//------------------------------------------------------------------------------
+size_t Sim::serialReceive( const char * text )
+{
+        World & world = current();
+        size_t accepted = 0;
+        while( text[accepted] != '\0' && world.serialReceived.size() < SERIAL_RX_BUFFER )
+        {
+                world.serialReceived.push_back( (uint8_t)text[accepted++] );
+        }
+        return accepted;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+const uint8_t * Sim::serialTransmitted()
+{
+        return current().serialTransmitted.data();
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+size_t Sim::serialTransmittedSize()
+{
+        return current().serialTransmitted.size();
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint64_t Sim::serialBlockedMicros()
+{
+        return current().serialBlockedMicros;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Storage
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+Sim::Storage::Storage()
+{
+        memset( m_cells, 0xFF, sizeof(m_cells) );
+        memset( m_pageWrites, 0, sizeof(m_pageWrites) );
+}
+
+Sim::Storage::~Storage()
+{
+        if( m_file != nullptr )
+        {
+                fclose( m_file );
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Sim::Storage::open( const char * path )
+{
+        m_file = fopen( path, "r+b" );
+        if( m_file != nullptr )
+        {
+                return fread( m_cells, 1, sizeof(m_cells), m_file ) == sizeof(m_cells);
+        }
+
+        m_file = fopen( path, "w+b" );
+        return m_file != nullptr && fwrite( m_cells, 1, sizeof(m_cells), m_file ) == sizeof(m_cells) && fflush( m_file ) == 0;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Sim::Storage::ready() const
+{
+        return nowMicros() >= m_busyUntil;
+}
+
+void Sim::Storage::read( uint8_t page, uint16_t offset, uint8_t * out, uint16_t length ) const
+{
+        memcpy( out, &m_cells[page * PageSize + offset], length );
+        m_stats.reads++;
+        m_stats.bytesRead += length;
+}
+
+//------------------------------------------------------------------------------
+// As the Nano's, one byte written per call, unchanged bytes passed over.
+//------------------------------------------------------------------------------
+uint16_t Sim::Storage::program( uint8_t page, uint16_t offset, const uint8_t * data, uint16_t length )
+{
+        const uint16_t address = page * PageSize + offset;
+        for( uint16_t i=0; i<length; i++ )
+        {
+                if( m_cells[address + i] == data[i] )
+                {
+                        continue;
+                }
+                if( m_cells[address + i] != 0xFF )
+                {
+                        m_stats.violations++;
+                }
+                if( write(address + i, m_cells[address + i] & data[i]) )
+                {
+                        m_stats.bytesProgrammed++;
+                }
+                return i + 1;
+        }
+        return length;
+}
+
+uint16_t Sim::Storage::erase( uint8_t page, uint16_t offset )
+{
+        while( offset < PageSize && m_cells[page * PageSize + offset] == 0xFF )
+        {
+                offset++;
+        }
+        if( offset < PageSize )
+        {
+                if( write(page * PageSize + offset, 0xFF) )
+                {
+                        m_stats.bytesErased++;
+                }
+                offset++;
+        }
+        return offset;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Sim::Storage::write( uint16_t address, uint8_t value )
+{
+        m_busyUntil = nowMicros() + WriteMicros;
+        if( m_cut )
+        {
+                if( m_cutAfter == 0 )
+                {
+                        return false;
+                }
+                m_cutAfter--;
+        }
+
+        m_cells[address] = value;
+        m_pageWrites[address / PageSize]++;
+        if( m_file != nullptr )
+        {
+                fseek( m_file, address, SEEK_SET );
+                fputc( value, m_file );
+                fflush( m_file );
+        }
+        return true;
+}
@@ -0,0 +1,418 @@
+/*------------------------------------------------------------------------------
+    ()      File: sim.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Simulated back-ends for the native build. A virtual clock, GPIO,
+              an I2C bus that accounts for every byte it carries, and stand-ins
+              for the BME680, the PCF8574 LCD backpack and a WS2812 strip.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//Driver constants mirrored from the Arduino libraries.
+#define BME680_OS_NONE          0
+#define BME680_OS_1X            1
+#define BME680_OS_2X            2
+#define BME680_OS_4X            3
+#define BME680_OS_8X            4
+#define BME680_OS_16X           5
+#define BME680_FILTER_SIZE_0    0
+#define BME680_FILTER_SIZE_1    1
+#define BME680_FILTER_SIZE_3    2
+#define BME680_FILTER_SIZE_7    3
+#define BME680_FILTER_SIZE_15   4
+#define LCD_5x8DOTS             0x00
+
+namespace Sim
+{
+//------------------------------------------------------------------------------
+// World - the clock, pins, serial port and LED strip of one simulated board.
+// Each thread simulates one world at a time and starts in a default world of
+// its own, which the single cabinet tools never leave. Devices charge their
+// time to whichever world is current when they are used.
+//------------------------------------------------------------------------------
+    struct World;
+
+    World * createWorld( uint64_t startMicros = 0 );
+    void destroyWorld( World * world );
+    void enterWorld( World * world );       //nullptr for the thread's default.
+
+//------------------------------------------------------------------------------
+// Virtual Clock - only moves when the harness or a blocking device says so.
+//------------------------------------------------------------------------------
+    static const uint64_t NoEvent = ~0ull;
+
+    uint64_t nowMicros();
+    void advanceMicros( uint64_t us );
+    void sleepMicros( uint64_t us );        //stops early at the next pin edge.
+    uint64_t nextPinEventMicros();          //NoEvent when none are scheduled.
+
+//------------------------------------------------------------------------------
+// GPIO - inputs idle high, as with INPUT_PULLUP. A level change on a pin with
+// a handler attached "interrupts" whatever is running. Scheduled edges fire as
+// the clock passes them, including part way through blocking device calls.
+//------------------------------------------------------------------------------
+    void setPin( uint8_t pin, bool level );
+    bool getPin( uint8_t pin );
+    void attachPinChange( uint8_t pin, void (*handler)( void * context ), void * context );
+    void schedulePin( uint64_t atMicros, uint8_t pin, bool level );
+
+//------------------------------------------------------------------------------
+// Probe - accumulates virtual and host time spent inside a named scope.
+//------------------------------------------------------------------------------
+    struct ProbeStats
+    {
+        const char * name = nullptr;
+        unsigned long count = 0;
+        uint64_t virtualMicros = 0;
+        uint64_t virtualMaxMicros = 0;
+        uint64_t hostNanos = 0;
+        uint64_t hostMaxNanos = 0;
+    };
+
+    class Probe
+    {
+    public:
+        static const uint8_t MaxProbes = 16;
+
+        explicit Probe( const char * name );
+        ~Probe();
+
+        static uint64_t hostNanos();
+        static const ProbeStats * stats( uint8_t index );
+        static void resetAll();
+
+    private:
+        ProbeStats * m_stats;
+        uint64_t m_virtualBegin;
+        uint64_t m_hostBegin;
+    };
+
+//------------------------------------------------------------------------------
+// I2C Device - a model that wants to see the bytes written to its address.
+//------------------------------------------------------------------------------
+    class I2CDevice
+    {
+    public:
+        virtual void received( const uint8_t * data, size_t length ) = 0;
+
+        // Bytes for a read from the device, returns how many it supplied.
+        virtual uint8_t requested( uint8_t * out, uint8_t count ) { (void)out; (void)count; return 0; }
+
+    protected:
+        ~I2CDevice() {}
+    };
+
+//------------------------------------------------------------------------------
+// I2C Bus - Wire compatible, including its 32 byte buffer. Time on the wire is
+// charged to the virtual clock and writes are handed to attached devices.
+//------------------------------------------------------------------------------
+    class I2CBus
+    {
+    public:
+        static const uint8_t BufferLength = 32;
+
+        struct Stats
+        {
+            unsigned long transactions = 0;
+            unsigned long bytes = 0;        //includes address bytes.
+            uint64_t busMicros = 0;
+        };
+
+        void begin() {}
+        void setClock( uint32_t hz ) { m_clockHz = hz; }
+
+        void beginTransmission( uint8_t address );
+        size_t write( uint8_t data );
+        size_t write( const uint8_t * data, size_t length );
+        uint8_t endTransmission( bool stop = true );
+
+        uint8_t requestFrom( uint8_t address, uint8_t count );
+        int available() const { return m_rxLength - m_rxIndex; }
+        int read();
+
+        const Stats & stats() const { return m_stats; }
+        void resetStats() { m_stats = Stats(); }
+
+        void attach( uint8_t address, I2CDevice * device );
+
+    private:
+        void charge( unsigned long bytes );
+        I2CDevice * device( uint8_t address ) const;
+
+        I2CDevice * m_devices[128] = {};        //by 7-bit address.
+
+        uint32_t m_clockHz = 100000;
+        uint8_t m_txAddress = 0;
+        uint8_t m_tx[BufferLength];
+        uint8_t m_txLength = 0;
+        uint8_t m_rx[BufferLength];
+        uint8_t m_rxLength = 0;
+        uint8_t m_rxIndex = 0;
+        Stats m_stats;
+    };
+
+//------------------------------------------------------------------------------
+// BME680 - Adafruit_BME680 compatible subset. Readings come from a source
+// callback so harnesses can feed scripted or recorded values. A sensor only
+// answers at the address it is strapped to, begin() at the other fails as it
+// would on hardware.
+//------------------------------------------------------------------------------
+    struct Reading
+    {
+        float temperature = 0.0f;
+        float humidity = 0.0f;
+        uint32_t pressure = 0;
+        uint32_t gas_resistance = 0;
+    };
+
+    class BME680
+    {
+    public:
+        using Source = Reading (*)( unsigned long timeMs );
+
+        static constexpr int reading_not_started = -1;
+        static constexpr int reading_complete = 0;
+
+        explicit BME680( I2CBus * bus, uint8_t strappedAddress = 0x76 ) : m_bus( bus ), m_strapped( strappedAddress ) {}
+
+        bool begin( uint8_t address = 0x77, bool initSettings = true );
+        bool setTemperatureOversampling( uint8_t os ) { m_osTemperature = os; return true; }
+        bool setHumidityOversampling( uint8_t os )    { m_osHumidity = os; return true; }
+        bool setPressureOversampling( uint8_t os )    { m_osPressure = os; return true; }
+        bool setIIRFilterSize( uint8_t size )         { (void)size; return true; }
+        bool setGasHeater( uint16_t heaterTemp, uint16_t heaterTime );
+
+        unsigned long beginReading();
+        bool endReading();
+        int remainingReadingMillis();
+
+        static void setSource( Source source );
+
+        // Added to the source's temperature, for sensors placed apart.
+        void setTemperatureOffset( float degrees ) { m_temperatureOffset = degrees; }
+
+        // Unplugged, every reading fails as the driver's does when the chip
+        // stops acknowledging.
+        void setConnected( bool connected ) { m_connected = connected; }
+        unsigned long readingsTaken() const { return m_readings; }
+        uint64_t busMicros() const { return m_busMicros; }
+
+        // Supply charge drawn by conversions and the heater, in pC (uA x us).
+        // Sleep current is left to the caller, it depends only on elapsed time.
+        uint64_t chargePicocoulombs() const { return m_charge; }
+        static constexpr double SleepMicroamps = 0.15;
+
+        float temperature = 0.0f;
+        float humidity = 0.0f;
+        uint32_t pressure = 0;
+        uint32_t gas_resistance = 0;
+
+    private:
+        void registerWrite( uint8_t count );
+        void registerRead( uint8_t count );
+        unsigned long measurementMillis() const;
+        uint64_t measurementCharge() const;
+
+        I2CBus * m_bus;
+        uint8_t m_strapped;
+        float m_temperatureOffset = 0.0f;
+        uint8_t m_address = 0x77;
+        uint8_t m_osTemperature = BME680_OS_8X;
+        uint8_t m_osHumidity = BME680_OS_2X;
+        uint8_t m_osPressure = BME680_OS_4X;
+        uint16_t m_heaterTime = 0;
+        bool m_connected = true;
+        bool m_inProgress = false;
+        unsigned long m_readingEnd = 0;
+        unsigned long m_readings = 0;
+        uint64_t m_busMicros = 0;
+        uint64_t m_charge = 0;
+    };
+
+//------------------------------------------------------------------------------
+// LCD - LiquidCrystal_I2C compatible. Every command and character is sent as
+// two enable-strobed nibbles, three expander writes each, as the library does.
+// The panel itself is modelled from the expander bytes seen on the bus, so
+// anything else writing to the backpack lands in the framebuffer too.
+//------------------------------------------------------------------------------
+    class Lcd : public I2CDevice
+    {
+    public:
+        static const uint8_t MaxColumns = 40;
+        static const uint8_t MaxRows = 4;
+
+        Lcd( uint8_t address, uint8_t columns, uint8_t rows, uint8_t charsize, I2CBus & bus );
+
+        void begin();
+        void backlight();
+        void clear();
+        void setCursor( uint8_t column, uint8_t row );
+        size_t write( uint8_t value );
+        void printstr( const char * str );
+
+        //inspection.
+        const char * line( uint8_t row ) const { return m_frame[row]; }
+        unsigned long characterWrites() const { return m_characterWrites; }
+        unsigned long transactions() const { return m_transactions; }
+        unsigned long bytes() const { return m_bytes; }            //includes address bytes.
+        size_t longestTransaction() const { return m_longest; }  //bytes, with the address.
+
+        void received( const uint8_t * data, size_t length ) override;
+
+    private:
+        void command( uint8_t value );
+        void send( uint8_t value, uint8_t mode );
+        void write4bits( uint8_t value );
+        void expanderWrite( uint8_t value );
+
+        void strobed( uint8_t nibble, bool data );
+        void instruction( uint8_t value );
+        void character( uint8_t value );
+        void blank();
+
+        I2CBus & m_bus;
+        uint8_t m_address;
+        uint8_t m_columns;
+        uint8_t m_rows;
+        uint8_t m_backlight = 0;
+        unsigned long m_characterWrites = 0;
+        unsigned long m_transactions = 0;
+        unsigned long m_bytes = 0;
+        size_t m_longest = 0;
+
+        //panel state, decoded from the expander.
+        uint8_t m_pins = 0;
+        bool m_fourBit = false;
+        bool m_haveHighNibble = false;
+        uint8_t m_highNibble = 0;
+        uint8_t m_ddram = 0;
+        char m_frame[MaxRows][MaxColumns+1];
+    };
+
+//------------------------------------------------------------------------------
+// LED Strip - WS2812 timing, 30us per pixel plus the latch.
+//------------------------------------------------------------------------------
+    class LedStrip
+    {
+    public:
+        static const uint16_t MaxPixels = 1024;
+
+        explicit LedStrip( uint16_t count );
+
+        void setPixel( uint16_t led, uint8_t r, uint8_t g, uint8_t b );
+        void show();
+
+        static unsigned long pushes();
+        static uint32_t pixel( uint16_t led );
+        static uint16_t count();
+
+    private:
+        uint16_t m_count;
+    };
+
+//------------------------------------------------------------------------------
+// Serial - a UART with the AVR core's 64 byte TX buffer, drained at the baud
+// rate as the virtual clock moves. Writing past the free space blocks, as the
+// core does. Everything transmitted is kept for the harness.
+//
+// The harness types into the 64 byte RX buffer with serialReceive(), bytes
+// that do not fit are lost as on the core.
+//------------------------------------------------------------------------------
+    void serialBegin( unsigned long baud );
+    unsigned long serialBaud();
+    int serialAvailableForWrite();
+    size_t serialWrite( const uint8_t * data, size_t length );
+    int serialAvailable();
+    int serialRead();
+
+    const uint8_t * serialTransmitted();
+    size_t serialTransmittedSize();
+    uint64_t serialBlockedMicros();
+    size_t serialReceive( const char * text );
+
+//------------------------------------------------------------------------------
+// Storage - the Nano's EEPROM, one byte started per call and busy for 3.3ms
+// of virtual time after it. Held in memory, and written through to a file
+// once one is opened so it outlives the process. Programming a byte that is
+// not erased is counted as a violation of the flash rules the firmware keeps
+// to, and ANDs in as flash would.
+//
+// cutAfter() simulates power failing: once that many more bytes have been
+// written every further write is dropped, until reconnect().
+//------------------------------------------------------------------------------
+    class Storage
+    {
+    public:
+        static const uint16_t PageSize = 64;
+        static const uint8_t Pages = 16;
+        static const uint8_t ProgramUnit = 1;
+        static const uint32_t WriteMicros = 3300;
+
+        struct Stats
+        {
+            unsigned long reads = 0;
+            unsigned long bytesRead = 0;
+            unsigned long bytesProgrammed = 0;
+            unsigned long bytesErased = 0;
+            unsigned long violations = 0;
+        };
+
+        Storage();
+        ~Storage();
+
+        // Loads the file if it exists, otherwise starts erased and creates it.
+        bool open( const char * path );
+
+        bool ready() const;
+        void read( uint8_t page, uint16_t offset, uint8_t * out, uint16_t length ) const;
+        uint16_t program( uint8_t page, uint16_t offset, const uint8_t * data, uint16_t length );
+        uint16_t erase( uint8_t page, uint16_t offset );
+
+        void cutAfter( unsigned long bytes ) { m_cutAfter = bytes; m_cut = true; }
+        void reconnect() { m_cut = false; }
+
+        const Stats & stats() const { return m_stats; }
+        void resetStats() { m_stats = Stats(); }
+        unsigned long pageWrites( uint8_t page ) const { return m_pageWrites[page]; }
+
+    private:
+        bool write( uint16_t address, uint8_t value );
+
+        uint8_t m_cells[Pages * PageSize];
+        unsigned long m_pageWrites[Pages];
+        FILE * m_file = nullptr;
+        uint64_t m_busyUntil = 0;
+        bool m_cut = false;
+        unsigned long m_cutAfter = 0;
+        mutable Stats m_stats;
+    };
+}
@@ -0,0 +1,290 @@
+/*------------------------------------------------------------------------------
+    ()      File: slaves.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Master simulator for the slave register map. Polls the simulated
+              cabinet and any number of stand-in cabinets on one virtual bus and
+              reports what the bus can sustain.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "../hal.h"
+#include "../cabinet.h"
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+extern Cabinet g_cabinet;
+
+namespace
+{
+        const uint8_t POLL_LENGTH = RegisterMap::Reg_TemperatureTrend;    //header and readings.
+        const unsigned long CABINET_PERIOD_MS = 1000;
+
+        //------------------------------------------------------------------------------
+        // Puts a register map on the simulated bus, as the Wire handlers do on
+        // hardware.
+        //------------------------------------------------------------------------------
+        class SlaveDevice : public Sim::I2CDevice
+        {
+        public:
+                explicit SlaveDevice( SlaveRegisters & registers ) : m_registers( registers ) {}
+
+                void received( const uint8_t * data, size_t length ) override { m_registers.received( data, (uint8_t)length ); }
+                uint8_t requested( uint8_t * out, uint8_t count ) override { return m_registers.requested( out, count ); }
+
+        private:
+                SlaveRegisters & m_registers;
+        };
+
+        //------------------------------------------------------------------------------
+        // A stand-in cabinet. Every reading is derived from the snapshot sequence,
+        // so a read mixing two snapshots is caught.
+        //------------------------------------------------------------------------------
+        struct StandIn
+        {
+                SlaveRegisters registers;
+                unsigned long nextPublish = 0;
+
+                void publish()
+                {
+                        RegisterMap & map = registers.edit();
+                        const uint16_t next = map.sequence + 1;
+                        map.uptime = next;
+                        map.readings.temperature = (int16_t)(2000 + next % 1000);
+                        map.readings.humidity = (uint16_t)(next * 3);
+                        map.readings.pressure = 100000u + next;
+                        map.readings.gasResistance = 200000u + next * 7u;
+                        map.readings.airQuality = next % 1000;
+                        map.readings.flags = next & RegisterMap::Flag_DoorOpen;
+                        registers.publish();
+                }
+
+                static bool consistent( const RegisterMap & map )
+                {
+                        const uint16_t sequence = map.sequence;
+                        return map.uptime == sequence
+                            && map.readings.temperature == (int16_t)(2000 + sequence % 1000)
+                            && map.readings.humidity == (uint16_t)(sequence * 3)
+                            && map.readings.pressure == 100000u + sequence
+                            && map.readings.gasResistance == 200000u + sequence * 7u
+                            && map.readings.airQuality == sequence % 1000
+                            && map.readings.flags == (sequence & RegisterMap::Flag_DoorOpen);
+                }
+        };
+
+        struct Polled
+        {
+                unsigned long polls = 0;
+                unsigned long snapshots = 0;    //polls that found a new sequence.
+                unsigned long torn = 0;
+                uint16_t lastSequence = 0;
+        };
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        bool readBlock( Sim::I2CBus & bus, uint8_t address, uint8_t * out, uint8_t length )
+        {
+                if( bus.requestFrom(address, length) != length )
+                {
+                        return false;
+                }
+                for( uint8_t i=0; i<length; i++ )
+                {
+                        out[i] = (uint8_t)bus.read();
+                }
+                return true;
+        }
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        void setPointer( Sim::I2CBus & bus, uint8_t address, uint8_t reg )
+        {
+                bus.beginTransmission( address );
+                bus.write( reg );
+                bus.endTransmission();
+        }
+}
+
+//------------------------------------------------------------------------------
+// slaves [count] [seconds] [clock-hz]
+//
+// Slave 0 is the simulated firmware, the rest are stand-ins publishing at
+// 1 Hz. The master sets each register pointer once, then polls the header
+// and readings round robin, back to back, with bare 24 byte reads. Half way
+// through it writes new config to the firmware and reads it back.
+//------------------------------------------------------------------------------
+int slavesMain( int argc, char ** argv )
+{
+        const int count = argc > 0 ? atoi(argv[0]) : 32;
+        const unsigned long seconds = argc > 1 ? strtoul(argv[1], nullptr, 10) : 60;
+        const uint32_t clockHz = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 10) : 100000;
+
+        if( count < 1 || SLAVE_ADDRESS + count > 0x78 )
+        {
+                fprintf( stderr, "slaves: 1 to %d slaves fit the address space\n", 0x78 - SLAVE_ADDRESS );
+                return 1;
+        }
+
+        setup();
+
+        Sim::I2CBus bus;
+        bus.setClock( clockHz );
+
+        std::vector<SlaveDevice> devices;
+        std::vector<StandIn> standIns( count - 1 );
+        devices.reserve( count );
+        devices.emplace_back( g_cabinet.registers() );
+        for( int i=0; i<count-1; i++ )
+        {
+                standIns[i].publish();
+                standIns[i].nextPublish = Hal::millis() + (unsigned long)i * CABINET_PERIOD_MS / count;
+                devices.emplace_back( standIns[i].registers );
+        }
+        for( int i=0; i<count; i++ )
+        {
+                bus.attach( SLAVE_ADDRESS + i, &devices[i] );
+                setPointer( bus, SLAVE_ADDRESS + i, RegisterMap::Reg_Header );
+        }
+        bus.resetStats();
+
+        std::vector<Polled> polled( count );
+        const uint64_t beginMicros = Sim::nowMicros();
+        const uint64_t endMicros = beginMicros + (uint64_t)seconds * 1000000;
+        bool configWritten = false;
+        int slave = 0;
+
+        while( Sim::nowMicros() < endMicros )
+        {
+                g_cabinet.loop();
+
+                const unsigned long now = Hal::millis();
+                for( StandIn & standIn : standIns )
+                {
+                        if( (long)(now - standIn.nextPublish) >= 0 )
+                        {
+                                standIn.publish();
+                                standIn.nextPublish += CABINET_PERIOD_MS;
+                        }
+                }
+
+                if( !configWritten && Sim::nowMicros() - beginMicros >= (endMicros - beginMicros) / 2 )
+                {
+                        const uint8_t write[] = { RegisterMap::Reg_Config, 0xD0, 0x07, 128 };     //2000 ms, half brightness.
+                        bus.beginTransmission( SLAVE_ADDRESS );
+                        bus.write( write, sizeof(write) );
+                        bus.endTransmission();
+                        setPointer( bus, SLAVE_ADDRESS, RegisterMap::Reg_Header );
+                        configWritten = true;
+                }
+
+                RegisterMap map;
+                memset( &map, 0, sizeof(map) );
+                if( !readBlock(bus, SLAVE_ADDRESS + slave, reinterpret_cast<uint8_t *>(&map), POLL_LENGTH) )
+                {
+                        continue;
+                }
+
+                Polled & stats = polled[slave];
+                stats.polls++;
+                if( map.sequence != stats.lastSequence )
+                {
+                        stats.snapshots++;
+                        stats.lastSequence = map.sequence;
+                }
+                if( map.version != RegisterMap::Version || map.size != sizeof(RegisterMap)
+                 || (slave != 0 && !StandIn::consistent(map)) )
+                {
+                        stats.torn++;
+                }
+                slave = (slave + 1) % count;
+        }
+
+        const double elapsedSeconds = (Sim::nowMicros() - beginMicros) / 1e6;
+        const Sim::I2CBus::Stats & bus_ = bus.stats();
+        unsigned long polls = 0;
+        unsigned long snapshots = 0;
+        unsigned long torn = 0;
+        for( const Polled & stats : polled )
+        {
+                polls += stats.polls;
+                snapshots += stats.snapshots;
+                torn += stats.torn;
+        }
+
+        printf( "slaves: %d on one bus at %lu Hz, %.0f s simulated\n\n", count, (unsigned long)clockHz, elapsedSeconds );
+        printf( "polls        %10lu  (%.1f /s, %.2f /s per slave)\n", polls, polls / elapsedSeconds, polls / elapsedSeconds / count );
+        printf( "per poll     %10.1f us, %.1f bytes on the wire\n", bus_.busMicros / (double)bus_.transactions, bus_.bytes / (double)bus_.transactions );
+        printf( "bus busy     %10.1f %%\n", bus_.busMicros / 10000.0 / elapsedSeconds );
+        printf( "snapshots    %10lu  new sequences seen\n", snapshots );
+        printf( "torn reads   %10lu\n", torn );
+        printf( "1 Hz slaves  %10.0f  this bus could poll at once a second\n", 1e6 * bus_.transactions / (double)bus_.busMicros );
+
+        //the firmware's view of itself against what the master read.
+        RegisterMap map;
+        memset( &map, 0, sizeof(map) );
+        setPointer( bus, SLAVE_ADDRESS, RegisterMap::Reg_Readings );
+        readBlock( bus, SLAVE_ADDRESS, reinterpret_cast<uint8_t *>(&map.readings), sizeof(map.readings) );
+        setPointer( bus, SLAVE_ADDRESS, RegisterMap::Reg_Config );
+        readBlock( bus, SLAVE_ADDRESS, reinterpret_cast<uint8_t *>(&map.config), sizeof(map.config) );
+
+        printf( "\nfirmware slave 0x%02x\n", SLAVE_ADDRESS );
+        printf( "  temperature  %6.2f *C  (firmware %.2f)\n", map.readings.temperature / 100.0, g_cabinet.environment().temperature );
+        printf( "  gas          %6lu ohms  (firmware %.0f)\n", (unsigned long)map.readings.gasResistance, g_cabinet.environment().voc );
+        printf( "  config       refresh %u ms, brightness %u%s\n", map.config.refreshMs, map.config.brightness,
+                configWritten && map.config.refreshMs == 2000 && map.config.brightness == 128 ? ", written config applied" : "" );
+
+        //walk the profiled jobs as a master would, select then read back.
+        uint8_t job = 0;
+        do
+        {
+                const uint8_t write[] = { RegisterMap::Reg_Profile, job };
+                bus.beginTransmission( SLAVE_ADDRESS );
+                bus.write( write, sizeof(write) );
+                bus.endTransmission();
+                g_cabinet.loop();
+
+                uint8_t * profile = reinterpret_cast<uint8_t *>( &map.profile );
+                const uint8_t half = sizeof(map.profile) / 2;
+                setPointer( bus, SLAVE_ADDRESS, RegisterMap::Reg_Profile );
+                readBlock( bus, SLAVE_ADDRESS, profile, half );
+                setPointer( bus, SLAVE_ADDRESS, RegisterMap::Reg_Profile + half );
+                readBlock( bus, SLAVE_ADDRESS, profile + half, sizeof(map.profile) - half );
+                if( map.profile.jobs == 0 )
+                {
+                        break;
+                }
+                printf( "  profile %u/%u  %-16.16s %8lu runs, mean %6lu us, max %6lu us\n",
+                        map.profile.select, map.profile.jobs, map.profile.name, (unsigned long)map.profile.count,
+                        (unsigned long)map.profile.meanMicros, (unsigned long)map.profile.maxMicros );
+        }
+        while( ++job < map.profile.jobs );
+        return torn == 0 ? 0 : 2;
+}
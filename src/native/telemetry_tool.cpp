@@ -0,0 +1,252 @@
+/*------------------------------------------------------------------------------
+    ()      File: telemetry_tool.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Host side telemetry tools. Records the serial stream of a
+              simulated cabinet, decodes captures to CSV and replays them at
+              their original pace.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../hal.h"
+#include "../cabinet.h"
+#include "../telemetry.h"
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+extern Cabinet g_cabinet;
+
+namespace
+{
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        void printCsv( const TelemetryPacket & packet, void * )
+        {
+                printf( "%u,%lu,%.2f,%.2f,%lu,%lu,%u\n",
+                        packet.sequence, (unsigned long)packet.timestamp,
+                        packet.temperature / 100.0, packet.humidity / 100.0,
+                        (unsigned long)packet.pressure, (unsigned long)packet.gasResistance,
+                        (packet.flags & TelemetryPacket::Flag_DoorOpen) ? 1u : 0u );
+        }
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        void printSummary( const DecodeStats & stats, size_t bytes )
+        {
+                fprintf( stderr, "telemetry: %zu bytes, %lu frames, %lu valid, %lu corrupt, %lu sequence gaps, %lu console lines\n",
+                         bytes, stats.frames, stats.valid, stats.corrupt, stats.sequenceGaps, stats.text );
+        }
+
+        //------------------------------------------------------------------------------
+        // Runs the firmware on the virtual clock, opening or closing the door
+        // every 15 s, and saves everything it transmitted.
+        //------------------------------------------------------------------------------
+        int record( const char * path, unsigned long seconds )
+        {
+                const uint64_t endMicros = (uint64_t)seconds * 1000000;
+                for( uint64_t at = 15000000; at < endMicros; at += 15000000 )
+                {
+                        Sim::schedulePin( at, DOORPIN, (at / 15000000) % 2 == 1 );
+                }
+
+                setup();
+                unsigned long passes = 0;
+                while( Sim::nowMicros() < endMicros )
+                {
+                        loop();
+                        passes++;
+                        Sim::advanceMicros( 20 );
+                }
+
+                FILE * file = fopen( path, "wb" );
+                if( file == nullptr )
+                {
+                        fprintf( stderr, "telemetry: cannot create %s\n", path );
+                        return 1;
+                }
+                fwrite( Sim::serialTransmitted(), 1, Sim::serialTransmittedSize(), file );
+                fclose( file );
+
+                const std::vector<uint8_t> stream( Sim::serialTransmitted(), Sim::serialTransmitted() + Sim::serialTransmittedSize() );
+                printSummary( decodeStream(stream, nullptr, nullptr), stream.size() );
+                fprintf( stderr, "telemetry: %lu baud, loop() blocked on the UART for %llu us\n",
+                         Sim::serialBaud(), (unsigned long long)Sim::serialBlockedMicros() );
+                fprintf( stderr, "telemetry: %lu loop passes, idle %.1f %% of the last 10 s\n", passes, g_cabinet.idlePermille() / 10.0 );
+                return 0;
+        }
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        struct ReplayContext
+        {
+                double speed;
+                bool started = false;
+                uint32_t firstTimestamp = 0;
+                std::chrono::steady_clock::time_point wallStart;
+        };
+
+        void replayPacket( const TelemetryPacket & packet, void * context )
+        {
+                ReplayContext & replay = *static_cast<ReplayContext *>( context );
+                if( !replay.started )
+                {
+                        replay.started = true;
+                        replay.firstTimestamp = packet.timestamp;
+                        replay.wallStart = std::chrono::steady_clock::now();
+                }
+
+                const double offsetMs = (double)(packet.timestamp - replay.firstTimestamp) / replay.speed;
+                std::this_thread::sleep_until( replay.wallStart + std::chrono::microseconds((long long)(offsetMs * 1000.0)) );
+                printCsv( packet, nullptr );
+                fflush( stdout );
+        }
+}
+
+//------------------------------------------------------------------------------
+// Bytes before the first delimiter may be a partial frame and are skipped.
+//------------------------------------------------------------------------------
+DecodeStats decodeStream( const std::vector<uint8_t> & stream, PacketVisitor visit, void * context )
+{
+        DecodeStats stats;
+        bool haveLast = false;
+        uint16_t lastSequence = 0;
+        size_t begin = 0;
+
+        for( size_t i=0; i<stream.size(); i++ )
+        {
+                if( stream[i] != 0 )
+                {
+                        continue;
+                }
+
+                const size_t length = i - begin;
+                const size_t frameStart = begin;
+                begin = i + 1;
+                if( length == 0 )
+                {
+                        continue;
+                }
+
+                if( TelemetryCodec::isText(&stream[frameStart], length) )
+                {
+                        stats.text++;
+                        continue;
+                }
+
+                stats.frames++;
+                TelemetryPacket packet;
+                if( !TelemetryCodec::decode(&stream[frameStart], length, packet) )
+                {
+                        stats.corrupt++;
+                        continue;
+                }
+
+                if( haveLast && packet.sequence != (uint16_t)(lastSequence + 1) )
+                {
+                        stats.sequenceGaps++;
+                }
+                haveLast = true;
+                lastSequence = packet.sequence;
+
+                stats.valid++;
+                if( visit )
+                {
+                        visit( packet, context );
+                }
+        }
+        return stats;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool readFile( const char * path, std::vector<uint8_t> & out )
+{
+        FILE * file = fopen( path, "rb" );
+        if( file == nullptr )
+        {
+                fprintf( stderr, "cannot open %s\n", path );
+                return false;
+        }
+
+        uint8_t buffer[4096];
+        size_t read;
+        while( (read = fread(buffer, 1, sizeof(buffer), file)) != 0 )
+        {
+                out.insert( out.end(), buffer, buffer + read );
+        }
+        fclose( file );
+        return true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int telemetryMain( int argc, char ** argv )
+{
+        if( argc >= 2 && strcmp(argv[0], "record") == 0 )
+        {
+                return record( argv[1], argc > 2 ? strtoul(argv[2], nullptr, 10) : 600 );
+        }
+
+        std::vector<uint8_t> stream;
+        if( argc >= 2 && strcmp(argv[0], "decode") == 0 )
+        {
+                if( !readFile(argv[1], stream) )
+                {
+                        return 1;
+                }
+                printf( "sequence,timestamp_ms,temperature_c,humidity_pct,pressure_pa,gas_ohms,door_open\n" );
+                const DecodeStats stats = decodeStream( stream, printCsv, nullptr );
+                printSummary( stats, stream.size() );
+                return stats.corrupt == 0 ? 0 : 2;
+        }
+
+        if( argc >= 2 && strcmp(argv[0], "replay") == 0 )
+        {
+                if( !readFile(argv[1], stream) )
+                {
+                        return 1;
+                }
+                ReplayContext context;
+                context.speed = argc > 2 ? atof(argv[2]) : 1.0;
+                if( context.speed <= 0.0 )
+                {
+                        context.speed = 1.0;
+                }
+                printf( "sequence,timestamp_ms,temperature_c,humidity_pct,pressure_pa,gas_ohms,door_open\n" );
+                printSummary( decodeStream(stream, replayPacket, &context), stream.size() );
+                return 0;
+        }
+
+        fprintf( stderr, "usage: telemetry record <file> [seconds] | decode <file> | replay <file> [speed]\n" );
+        return 1;
+}
@@ -0,0 +1,86 @@
+/*------------------------------------------------------------------------------
+    ()      File: tools.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Entry points of the host-side tools built by the native env.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include <vector>
+#include "../telemetry.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+class Cabinet;
+
+//------------------------------------------------------------------------------
+// Firmware entry points, defined in main.cpp.
+//------------------------------------------------------------------------------
+void setup();
+void loop();
+
+//------------------------------------------------------------------------------
+// Tools - each takes the arguments following its name on the command line.
+//------------------------------------------------------------------------------
+int benchMain( int argc, char ** argv );
+int benchFormatMain( int argc, char ** argv );
+int telemetryMain( int argc, char ** argv );
+int slavesMain( int argc, char ** argv );
+int layoutMain( int argc, char ** argv );
+int fleetMain( int argc, char ** argv );
+int traceMain( int argc, char ** argv );
+int journalMain( int argc, char ** argv );
+int alertsMain( int argc, char ** argv );
+int sensorsMain( int argc, char ** argv );
+int lcdMain( int argc, char ** argv );
+int consoleMain( int argc, char ** argv );
+int ws2812Main( int argc, char ** argv );
+int memoryMain( int argc, char ** argv );
+
+//------------------------------------------------------------------------------
+// Shared by the tools.
+//------------------------------------------------------------------------------
+struct DecodeStats
+{
+    unsigned long frames = 0;
+    unsigned long valid = 0;
+    unsigned long corrupt = 0;
+    unsigned long sequenceGaps = 0;
+    unsigned long text = 0;         //console lines, not counted as frames.
+};
+
+using PacketVisitor = void (*)( const TelemetryPacket & packet, void * context );
+
+bool readFile( const char * path, std::vector<uint8_t> & out );
+
+// Splits a captured telemetry stream at the delimiters and decodes every frame.
+DecodeStats decodeStream( const std::vector<uint8_t> & stream, PacketVisitor visit, void * context );
+
+// Virtual time the current world can skip after a pass of cabinet's loop(),
+// up to the next deadline or scheduled pin edge and at most limitMicros.
+// Never less than the loop's own bookkeeping.
+uint64_t idleMicros( const Cabinet & cabinet, uint64_t limitMicros );
@@ -0,0 +1,193 @@
+/*------------------------------------------------------------------------------
+    ()      File: trace.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Compact binary traces of what a cabinet sensed.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <string.h>
+#include "trace.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        const uint8_t MAGIC[4] = { 'P', 'C', 'T', 'R' };
+        const size_t HEADER_SIZE = sizeof(MAGIC) + 1;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// TraceWriter
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+TraceWriter::TraceWriter( std::vector<uint8_t> & out )
+        : m_out( out )
+{
+        m_out.insert( m_out.end(), MAGIC, MAGIC + sizeof(MAGIC) );
+        m_out.push_back( (uint8_t)Version );
+}
+
+//------------------------------------------------------------------------------
+// Readings are delta coded against the last reading, door records leave it be.
+//------------------------------------------------------------------------------
+void TraceWriter::add( const TraceRecord & record )
+{
+        varint( (record.timeMs - m_last.timeMs) << 2 | record.kind );
+        m_last.timeMs = record.timeMs;
+        m_records++;
+
+        if( record.kind != TraceRecord::Reading )
+        {
+                return;
+        }
+        signedVarint( record.temperature - m_last.temperature );
+        signedVarint( record.humidity - m_last.humidity );
+        signedVarint( record.pressure - m_last.pressure );
+        signedVarint( record.gasResistance - m_last.gasResistance );
+        m_last.temperature = record.temperature;
+        m_last.humidity = record.humidity;
+        m_last.pressure = record.pressure;
+        m_last.gasResistance = record.gasResistance;
+}
+
+//------------------------------------------------------------------------------
+// Seven bits a byte, low first, the top bit set on all but the last.
+//------------------------------------------------------------------------------
+void TraceWriter::varint( uint32_t value )
+{
+        while( value >= 0x80 )
+        {
+                m_out.push_back( (uint8_t)(value | 0x80) );
+                value >>= 7;
+        }
+        m_out.push_back( (uint8_t)value );
+}
+
+//------------------------------------------------------------------------------
+// Zigzag, so small changes either way stay short.
+//------------------------------------------------------------------------------
+void TraceWriter::signedVarint( int32_t value )
+{
+        varint( ((uint32_t)value << 1) ^ (uint32_t)(value >> 31) );
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// TraceReader
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+TraceReader::TraceReader( const uint8_t * data, size_t length )
+        : m_data( data )
+        , m_length( length )
+{
+        if( length < HEADER_SIZE || memcmp(data, MAGIC, sizeof(MAGIC)) != 0 || data[sizeof(MAGIC)] != TraceWriter::Version )
+        {
+                m_failed = true;
+                return;
+        }
+        m_position = HEADER_SIZE;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool TraceReader::next( TraceRecord & record )
+{
+        if( m_failed || m_position == m_length )
+        {
+                return false;
+        }
+
+        uint32_t header;
+        if( !varint(header) || (header & 0x3) > TraceRecord::DoorClosed )
+        {
+                m_failed = true;
+                return false;
+        }
+        m_last.timeMs += header >> 2;
+        m_last.kind = (uint8_t)(header & 0x3);
+
+        if( m_last.kind == TraceRecord::Reading )
+        {
+                int32_t deltas[4];
+                for( uint8_t i=0; i<4; i++ )
+                {
+                        if( !signedVarint(deltas[i]) )
+                        {
+                                m_failed = true;
+                                return false;
+                        }
+                }
+                m_last.temperature += deltas[0];
+                m_last.humidity += deltas[1];
+                m_last.pressure += deltas[2];
+                m_last.gasResistance += deltas[3];
+        }
+
+        record = m_last;
+        return true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool TraceReader::varint( uint32_t & value )
+{
+        value = 0;
+        for( uint8_t shift=0; shift<35; shift+=7 )
+        {
+                if( m_position == m_length )
+                {
+                        return false;
+                }
+                const uint8_t byte = m_data[m_position++];
+                value |= (uint32_t)(byte & 0x7F) << shift;
+                if( (byte & 0x80) == 0 )
+                {
+                        return true;
+                }
+        }
+        return false;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool TraceReader::signedVarint( int32_t & value )
+{
+        uint32_t zigzag;
+        if( !varint(zigzag) )
+        {
+                return false;
+        }
+        value = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+        return true;
+}
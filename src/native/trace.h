@@ -0,0 +1,107 @@
+/*------------------------------------------------------------------------------
+    ()      File: trace.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Compact binary traces of what a cabinet sensed: timestamped
+                            BME680 readings and door edges, for replay through the firmware.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// File format:
+//
+//   | "PCTR" | version u8 |  then records to the end of the file.
+//
+// Each record starts with a varint of (milliseconds since the previous record
+// << 2 | kind). A reading follows with four zigzag varints, each the change
+// from the previous reading: temperature in centi *C, humidity in centi %,
+// pressure in Pa and gas resistance in ohms. Door records carry nothing more.
+// A slowly drifting reading costs 6 to 9 bytes against 14 raw.
+//------------------------------------------------------------------------------
+struct TraceRecord
+{
+    enum Kind : uint8_t { Reading, DoorOpen, DoorClosed };
+
+    uint32_t timeMs = 0;
+    uint8_t kind = Reading;
+
+    //readings only.
+    int32_t temperature = 0;
+    int32_t humidity = 0;
+    int32_t pressure = 0;
+    int32_t gasResistance = 0;
+};
+
+//------------------------------------------------------------------------------
+// Appends records to a byte buffer, in time order.
+//------------------------------------------------------------------------------
+class TraceWriter
+{
+public:
+    static const uint8_t Version = 1;
+
+    explicit TraceWriter( std::vector<uint8_t> & out );
+
+    void add( const TraceRecord & record );
+    unsigned long records() const { return m_records; }
+
+private:
+    void varint( uint32_t value );
+    void signedVarint( int32_t value );
+
+    std::vector<uint8_t> & m_out;
+    TraceRecord m_last;
+    unsigned long m_records = 0;
+};
+
+//------------------------------------------------------------------------------
+// Walks a trace. next() is false at the end, or at the first malformed record
+// with failed() set.
+//------------------------------------------------------------------------------
+class TraceReader
+{
+public:
+    TraceReader( const uint8_t * data, size_t length );
+
+    bool next( TraceRecord & record );
+    bool failed() const { return m_failed; }
+
+private:
+    bool varint( uint32_t & value );
+    bool signedVarint( int32_t & value );
+
+    const uint8_t * m_data;
+    size_t m_length;
+    size_t m_position = 0;
+    bool m_failed = false;
+    TraceRecord m_last;
+};
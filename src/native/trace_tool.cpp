@@ -0,0 +1,452 @@
+/*------------------------------------------------------------------------------
+    ()      File: trace_tool.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Sensor traces. Records what a cabinet sensed, from the simulator
+                            or a telemetry capture, and replays it through the firmware on
+                            the virtual clock, writing the display and LED output for
+                            comparison against a golden file.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "../hal.h"
+#include "../pinconfig.h"
+#include "../cabinet.h"
+#include "trace.h"
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+extern Hal::Lcd g_lcd;
+extern Hal::GasSensor g_gasSensors[Cabinet::MaxSensors];
+extern Cabinet g_cabinet;
+
+namespace
+{
+        //virtual time run on past the last record, so its effects settle.
+        const uint32_t SETTLE_MS = 5000;
+
+        //each simulated door movement bounces, ending on the new level.
+        const uint32_t BOUNCE_MS[] = { 0, 1, 3 };
+        const int BOUNCE_EDGES = sizeof(BOUNCE_MS) / sizeof(BOUNCE_MS[0]);
+
+        //the readings being replayed, for the sensor source.
+        std::vector<TraceRecord> s_readings;
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        bool writeFile( const char * path, const std::vector<uint8_t> & data )
+        {
+                FILE * file = fopen( path, "wb" );
+                if( file == nullptr )
+                {
+                        fprintf( stderr, "trace: cannot create %s\n", path );
+                        return false;
+                }
+                fwrite( data.data(), 1, data.size(), file );
+                fclose( file );
+                return true;
+        }
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        double hostSeconds()
+        {
+                timespec now;
+                clock_gettime( CLOCK_MONOTONIC, &now );
+                return now.tv_sec + now.tv_nsec / 1e9;
+        }
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        TraceRecord reading( uint32_t timeMs, float temperature, float humidity, uint32_t pressure, uint32_t gasResistance )
+        {
+                TraceRecord record;
+                record.timeMs = timeMs;
+                record.kind = TraceRecord::Reading;
+                record.temperature = (int32_t)FieldWriter::toFixed( temperature, 2 );
+                record.humidity = (int32_t)FieldWriter::toFixed( humidity, 2 );
+                record.pressure = (int32_t)pressure;
+                record.gasResistance = (int32_t)gasResistance;
+                return record;
+        }
+
+        TraceRecord door( uint32_t timeMs, bool open )
+        {
+                TraceRecord record;
+                record.timeMs = timeMs;
+                record.kind = open ? TraceRecord::DoorOpen : TraceRecord::DoorClosed;
+                return record;
+        }
+
+        //------------------------------------------------------------------------------
+        // Runs the firmware on the simulated sensor, opening or closing the door
+        // every 15 s, and keeps every reading it took and every edge it saw.
+        //------------------------------------------------------------------------------
+        int record( const char * path, unsigned long seconds )
+        {
+                std::vector<uint8_t> data;
+                TraceWriter writer( data );
+                const uint64_t endMicros = (uint64_t)seconds * 1000000;
+
+                bool open = Hal::digitalRead( DOORPIN );
+                writer.add( door(0, open) );
+                std::vector<TraceRecord> edges;
+                for( uint32_t at = 15000; at < seconds * 1000; at += 15000 )
+                {
+                        open = !open;
+                        for( int edge=0; edge<BOUNCE_EDGES; edge++ )
+                        {
+                                const bool level = (edge % 2 == 0) ? open : !open;
+                                edges.push_back( door(at + BOUNCE_MS[edge], level) );
+                                Sim::schedulePin( (uint64_t)(at + BOUNCE_MS[edge]) * 1000, DOORPIN, level );
+                        }
+                }
+
+                setup();
+                unsigned long readings = g_gasSensors[0].readingsTaken();
+                size_t edge = 0;
+                while( Sim::nowMicros() < endMicros )
+                {
+                        g_cabinet.loop();
+
+                        //edges due by now go in ahead of a reading taken in the same pass.
+                        const uint32_t now = (uint32_t)Hal::millis();
+                        for( ; edge < edges.size() && edges[edge].timeMs <= now; edge++ )
+                        {
+                                writer.add( edges[edge] );
+                        }
+                        if( g_gasSensors[0].readingsTaken() != readings )
+                        {
+                                readings = g_gasSensors[0].readingsTaken();
+                                writer.add( reading(now, g_gasSensors[0].temperature, g_gasSensors[0].humidity, g_gasSensors[0].pressure, g_gasSensors[0].gas_resistance) );
+                        }
+
+                        Sim::advanceMicros( idleMicros(g_cabinet, endMicros - Sim::nowMicros()) );
+                }
+
+                if( !writeFile(path, data) )
+                {
+                        return 1;
+                }
+                fprintf( stderr, "trace: %lu records in %zu bytes, %.1f bytes a record\n",
+                         writer.records(), data.size(), (double)data.size() / writer.records() );
+                return 0;
+        }
+
+        //------------------------------------------------------------------------------
+        // Telemetry carries each reading and the door state with the firmware's
+        // timestamp. Repeated readings, sent with door events, are left out.
+        //------------------------------------------------------------------------------
+        struct ImportContext
+        {
+                TraceWriter * writer;
+                bool started = false;
+                uint32_t firstTimestamp = 0;
+                TraceRecord last;
+                bool open = false;
+        };
+
+        void importPacket( const TelemetryPacket & packet, void * context )
+        {
+                ImportContext & import = *static_cast<ImportContext *>( context );
+                if( !import.started )
+                {
+                        import.firstTimestamp = packet.timestamp;
+                }
+                const uint32_t timeMs = packet.timestamp - import.firstTimestamp;
+
+                const bool open = (packet.flags & TelemetryPacket::Flag_DoorOpen) != 0;
+                if( !import.started || open != import.open )
+                {
+                        import.writer->add( door(timeMs, open) );
+                        import.open = open;
+                }
+
+                TraceRecord record;
+                record.timeMs = timeMs;
+                record.temperature = packet.temperature;
+                record.humidity = packet.humidity;
+                record.pressure = (int32_t)packet.pressure;
+                record.gasResistance = (int32_t)packet.gasResistance;
+                if( record.gasResistance != 0
+                 && (!import.started || record.temperature != import.last.temperature || record.humidity != import.last.humidity
+                  || record.pressure != import.last.pressure || record.gasResistance != import.last.gasResistance) )
+                {
+                        import.writer->add( record );
+                        import.last = record;
+                }
+                import.started = true;
+        }
+
+        int import( const char * capturePath, const char * path )
+        {
+                std::vector<uint8_t> capture;
+                if( !readFile(capturePath, capture) )
+                {
+                        return 1;
+                }
+
+                std::vector<uint8_t> data;
+                TraceWriter writer( data );
+                ImportContext context;
+                context.writer = &writer;
+                const DecodeStats stats = decodeStream( capture, importPacket, &context );
+                if( !writeFile(path, data) )
+                {
+                        return 1;
+                }
+                fprintf( stderr, "trace: %lu of %lu frames valid, %lu records in %zu bytes\n",
+                         stats.valid, stats.frames, writer.records(), data.size() );
+                return 0;
+        }
+
+        //------------------------------------------------------------------------------
+        // Holds each traced reading until the next, as the real air would.
+        //------------------------------------------------------------------------------
+        Sim::Reading tracedReading( unsigned long timeMs )
+        {
+                const auto later = std::upper_bound( s_readings.begin(), s_readings.end(), (uint32_t)timeMs,
+                        []( uint32_t time, const TraceRecord & record ) { return time < record.timeMs; } );
+                const TraceRecord & record = later == s_readings.begin() ? *later : *(later - 1);
+
+                Sim::Reading reading;
+                reading.temperature = record.temperature / 100.0f;
+                reading.humidity = record.humidity / 100.0f;
+                reading.pressure = (uint32_t)record.pressure;
+                reading.gas_resistance = (uint32_t)record.gasResistance;
+                return reading;
+        }
+
+        //------------------------------------------------------------------------------
+        // One line per change of the panel or of the pixels pushed, stamped with
+        // the virtual time. Pixels are run length coded.
+        //------------------------------------------------------------------------------
+        std::string ledLine()
+        {
+                std::string line;
+                char run[24];
+                for( uint16_t led=0; led<Sim::LedStrip::count(); )
+                {
+                        const uint32_t colour = Sim::LedStrip::pixel( led );
+                        uint16_t length = 1;
+                        while( led + length < Sim::LedStrip::count() && Sim::LedStrip::pixel(led + length) == colour )
+                        {
+                                length++;
+                        }
+                        snprintf( run, sizeof(run), " %06x*%u", (unsigned)colour, length );
+                        line += run;
+                        led += length;
+                }
+                return line;
+        }
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        struct Replay
+        {
+                std::vector<std::string> output;
+                unsigned long records = 0;
+                uint32_t virtualMs = 0;
+                double hostSeconds = 0.0;
+        };
+
+        bool replay( const char * path, Replay & result )
+        {
+                std::vector<uint8_t> data;
+                if( !readFile(path, data) )
+                {
+                        return false;
+                }
+
+                TraceReader reader( data.data(), data.size() );
+                TraceRecord record;
+                uint32_t lastMs = 0;
+                while( reader.next(record) )
+                {
+                        if( record.kind == TraceRecord::Reading )
+                        {
+                                s_readings.push_back( record );
+                        }
+                        else if( record.timeMs == 0 )
+                        {
+                                Sim::setPin( DOORPIN, record.kind == TraceRecord::DoorOpen );
+                        }
+                        else
+                        {
+                                Sim::schedulePin( (uint64_t)record.timeMs * 1000, DOORPIN, record.kind == TraceRecord::DoorOpen );
+                        }
+                        lastMs = record.timeMs;
+                        result.records++;
+                }
+                if( reader.failed() || s_readings.empty() )
+                {
+                        fprintf( stderr, "trace: %s is not a trace or has no readings\n", path );
+                        return false;
+                }
+                Sim::BME680::setSource( tracedReading );
+
+                const double hostBegin = hostSeconds();
+                const uint64_t endMicros = (uint64_t)(lastMs + SETTLE_MS) * 1000;
+                std::string panel;
+                unsigned long pushes = Sim::LedStrip::pushes();
+                char stamp[16];
+
+                setup();
+                while( Sim::nowMicros() < endMicros )
+                {
+                        g_cabinet.loop();
+                        const uint64_t idle = idleMicros( g_cabinet, endMicros - Sim::nowMicros() );
+
+                        //only once nothing is in flight, so a redraw shows up whole.
+                        if( g_cabinet.idleMillis(Hal::millis()) == 0 )
+                        {
+                                Sim::advanceMicros( idle );
+                                continue;
+                        }
+
+                        snprintf( stamp, sizeof(stamp), "%9lu ", Hal::millis() );
+                        std::string shown = std::string("|") + g_lcd.line(0) + "|" + g_lcd.line(1) + "|";
+                        if( shown != panel )
+                        {
+                                panel = shown;
+                                result.output.push_back( stamp + std::string("lcd ") + panel );
+                        }
+                        if( Sim::LedStrip::pushes() != pushes )
+                        {
+                                pushes = Sim::LedStrip::pushes();
+                                result.output.push_back( stamp + std::string("led") + ledLine() );
+                        }
+
+                        Sim::advanceMicros( idle );
+                }
+
+                result.virtualMs = lastMs + SETTLE_MS;
+                result.hostSeconds = hostSeconds() - hostBegin;
+                return true;
+        }
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        void printThroughput( const Replay & result )
+        {
+                fprintf( stderr, "trace: %lu records, %.0f s of trace in %.3f s, %.0f samples/s, %.0f x real time, %lu readings taken\n",
+                         result.records, result.virtualMs / 1000.0, result.hostSeconds,
+                         result.records / result.hostSeconds, result.virtualMs / 1000.0 / result.hostSeconds,
+                         g_cabinet.sensorReadings() );
+        }
+
+        //------------------------------------------------------------------------------
+        // Reports the first line that differs, the rest usually follow from it.
+        //------------------------------------------------------------------------------
+        int check( const Replay & result, const char * goldenPath )
+        {
+                std::vector<uint8_t> golden;
+                if( !readFile(goldenPath, golden) )
+                {
+                        return 1;
+                }
+
+                std::string expected( golden.begin(), golden.end() );
+                size_t position = 0;
+                for( size_t line=0; line<result.output.size(); line++ )
+                {
+                        const size_t end = expected.find( '\n', position );
+                        const std::string want = expected.substr( position, end == std::string::npos ? std::string::npos : end - position );
+                        if( position >= expected.size() || want != result.output[line] )
+                        {
+                                fprintf( stderr, "trace: differs from %s at line %zu\n  expected %s\n  replayed %s\n",
+                                         goldenPath, line + 1, position >= expected.size() ? "<end of file>" : want.c_str(), result.output[line].c_str() );
+                                return 2;
+                        }
+                        position = end == std::string::npos ? expected.size() : end + 1;
+                }
+                if( position < expected.size() )
+                {
+                        fprintf( stderr, "trace: %s has lines past the end of the replay, from line %zu\n", goldenPath, result.output.size() + 1 );
+                        return 2;
+                }
+
+                fprintf( stderr, "trace: matches %s, %zu lines\n", goldenPath, result.output.size() );
+                return 0;
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int traceMain( int argc, char ** argv )
+{
+        if( argc >= 2 && strcmp(argv[0], "record") == 0 )
+        {
+                return record( argv[1], argc > 2 ? strtoul(argv[2], nullptr, 10) : 3600 );
+        }
+
+        if( argc >= 3 && strcmp(argv[0], "import") == 0 )
+        {
+                return import( argv[1], argv[2] );
+        }
+
+        if( argc >= 2 && (strcmp(argv[0], "replay") == 0 || strcmp(argv[0], "check") == 0) )
+        {
+                Replay result;
+                if( !replay(argv[1], result) )
+                {
+                        return 1;
+                }
+                printThroughput( result );
+
+                if( strcmp(argv[0], "check") == 0 )
+                {
+                        return argc > 2 ? check( result, argv[2] ) : 1;
+                }
+
+                FILE * out = argc > 2 ? fopen( argv[2], "w" ) : stdout;
+                if( out == nullptr )
+                {
+                        fprintf( stderr, "trace: cannot create %s\n", argv[2] );
+                        return 1;
+                }
+                for( const std::string & line : result.output )
+                {
+                        fprintf( out, "%s\n", line.c_str() );
+                }
+                if( out != stdout )
+                {
+                        fclose( out );
+                }
+                return 0;
+        }
+
+        fprintf( stderr, "usage: trace record <trace> [seconds] | import <capture> <trace> | replay <trace> [output] | check <trace> <golden>\n" );
+        return 1;
+}
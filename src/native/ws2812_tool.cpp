@@ -0,0 +1,258 @@
+/*------------------------------------------------------------------------------
+    ()      File: ws2812_tool.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Checks the Blue Pill's WS2812 encoding by decoding the SPI stream it
+              produces back into pulse timings and pixels, and benchmarks the encoder.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "../hal.h"
+#include "../ws2812.h"
+#include "tools.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        //datasheet limits, ns. The older parts take 200..500 and 550..850.
+        const double T0H_MIN = 200, T0H_MAX = 500;
+        const double T1H_MIN = 580, T1H_MAX = 1000;
+        const double BIT_MIN = 650, BIT_MAX = 1850;
+        const double LATCH_MIN = 280000;
+
+        const double SPI_BIT_NS = 1e9 / Ws2812Stream::SpiHz;
+
+        //------------------------------------------------------------------------------
+        // A bit at a time, what the table has to agree with.
+        //------------------------------------------------------------------------------
+        void reference( const uint8_t * colours, uint16_t count, uint8_t * out )
+        {
+                for( uint16_t i=0; i<count; i++ )
+                {
+                        uint32_t bits = 0;
+                        for( int bit=7; bit>=0; bit-- )
+                        {
+                                bits = (bits << 3) | (((colours[i] >> bit) & 1) ? 6u : 4u);
+                        }
+                        out[i * 3] = (uint8_t)(bits >> 16);
+                        out[i * 3 + 1] = (uint8_t)(bits >> 8);
+                        out[i * 3 + 2] = (uint8_t)bits;
+                }
+        }
+
+        //------------------------------------------------------------------------------
+        // Runs a frame the way the DMA does: a half goes out, the interrupt
+        // refills it while the other half is sent, until refill() says stop.
+        // Returns what reached the line and the refills it took.
+        //------------------------------------------------------------------------------
+        std::vector<uint8_t> transmit( const std::vector<uint8_t> & pixels, uint16_t leds, unsigned long & refills )
+        {
+                uint8_t ring[Ws2812Stream::RingSize];
+                Ws2812Stream stream;
+                stream.start( pixels.data(), leds, ring );
+
+                std::vector<uint8_t> line;
+                refills = 0;
+                for( uint8_t half=0; ; half^=1 )
+                {
+                        uint8_t * sent = &ring[half * Ws2812Stream::HalfSize];
+                        line.insert( line.end(), sent, sent + Ws2812Stream::HalfSize );
+                        refills++;
+                        if( !stream.refill(sent) )
+                        {
+                                return line;
+                        }
+                }
+        }
+
+        //------------------------------------------------------------------------------
+        // Measures every high pulse on the line and reads the bits back. False,
+        // with the reason, on any timing outside the datasheet.
+        //------------------------------------------------------------------------------
+        bool decode( const std::vector<uint8_t> & line, std::vector<uint8_t> & colours, double & latchNs )
+        {
+                long rise = -1;
+                long fall = -1;
+                uint8_t value = 0;
+                uint8_t bits = 0;
+                const long count = (long)line.size() * 8;
+                for( long i=0; i<=count; i++ )
+                {
+                        const bool high = i < count && ((line[i / 8] >> (7 - i % 8)) & 1);
+                        const bool wasHigh = i > 0 && ((line[(i - 1) / 8] >> (7 - (i - 1) % 8)) & 1);
+                        if( high && !wasHigh )
+                        {
+                                if( rise >= 0 )
+                                {
+                                        const double period = (i - rise) * SPI_BIT_NS;
+                                        if( period < BIT_MIN || period > BIT_MAX )
+                                        {
+                                                printf( "  bit %lu lasts %.0f ns\n", (unsigned long)colours.size() * 8 + bits, period );
+                                                return false;
+                                        }
+                                }
+                                rise = i;
+                        }
+                        else if( !high && wasHigh )
+                        {
+                                fall = i;
+                                const double width = (i - rise) * SPI_BIT_NS;
+                                const bool one = width >= T1H_MIN && width <= T1H_MAX;
+                                if( !one && (width < T0H_MIN || width > T0H_MAX) )
+                                {
+                                        printf( "  bit %lu high for %.0f ns\n", (unsigned long)colours.size() * 8 + bits, width );
+                                        return false;
+                                }
+                                value = (uint8_t)((value << 1) | (one ? 1 : 0));
+                                if( ++bits == 8 )
+                                {
+                                        colours.push_back( value );
+                                        bits = 0;
+                                }
+                        }
+                }
+                latchNs = (count - fall) * SPI_BIT_NS;
+                return bits == 0;
+        }
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        bool check( uint16_t leds )
+        {
+                std::vector<uint8_t> pixels( leds * 3 );
+                for( uint8_t & colour : pixels )
+                {
+                        colour = (uint8_t)rand();
+                }
+
+                unsigned long refills = 0;
+                const std::vector<uint8_t> line = transmit( pixels, leds, refills );
+                std::vector<uint8_t> colours;
+                double latchNs = 0;
+                const bool timed = decode( line, colours, latchNs );
+                const bool same = colours == pixels;
+                const bool latched = latchNs >= LATCH_MIN;
+
+                printf( "  %5u LEDs  %6zu bytes  %6.2f ms  %4lu interrupts  latch %5.1f us  %s\n",
+                        leds, line.size(), line.size() * 8 * SPI_BIT_NS / 1e6, refills, latchNs / 1000,
+                        timed && same && latched ? "ok" : !timed ? "BAD TIMING" : !same ? "WRONG PIXELS" : "SHORT LATCH" );
+                return timed && same && latched;
+        }
+
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        template<typename Encoder>
+        double nanosPerLed( Encoder encoder, const std::vector<uint8_t> & pixels, std::vector<uint8_t> & out, unsigned long iterations )
+        {
+                const uint16_t leds = (uint16_t)(pixels.size() / 3);
+                const uint64_t begin = Sim::Probe::hostNanos();
+                for( unsigned long i=0; i<iterations; i++ )
+                {
+                        encoder( pixels.data(), (uint16_t)pixels.size(), out.data() );
+                        out[i % out.size()] ^= 1;
+                }
+                return (double)(Sim::Probe::hostNanos() - begin) / ((double)iterations * leds);
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+int ws2812Main( int argc, char ** argv )
+{
+        const uint16_t leds = argc > 0 ? (uint16_t)strtoul(argv[0], nullptr, 10) : LEDCOUNT;
+        const unsigned long iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+
+        //every colour byte, against the bitwise encoder.
+        uint8_t all[256], fast[256 * 3], slow[256 * 3];
+        for( int i=0; i<256; i++ )
+        {
+                all[i] = (uint8_t)i;
+        }
+        Ws2812Stream::encode( all, 256, fast );
+        reference( all, 256, slow );
+        const bool table = memcmp( fast, slow, sizeof(fast) ) == 0;
+        printf( "ws2812: %.0f ns SPI bits, nibble table %s the bitwise encoder\n", SPI_BIT_NS, table ? "matches" : "DIFFERS FROM" );
+
+        //frames decoded off the line, across the half boundaries.
+        bool ok = table;
+        srand( 1 );
+        const uint16_t lengths[] = { 1, 7, 8, 9, 16, LEDCOUNT, 150, 1000 };
+        for( uint16_t length : lengths )
+        {
+                ok = check( length ) && ok;
+        }
+        if( leds != LEDCOUNT )
+        {
+                ok = check( leds ) && ok;
+        }
+
+        std::vector<uint8_t> pixels( leds * 3 );
+        std::vector<uint8_t> out( pixels.size() * Ws2812Stream::BytesPerColour );
+        for( size_t i=0; i<pixels.size(); i++ )
+        {
+                pixels[i] = (uint8_t)(i * 37);
+        }
+        const double bitwise = nanosPerLed( reference, pixels, out, iterations );
+        const double nibbles = nanosPerLed( Ws2812Stream::encode, pixels, out, iterations );
+        printf( "  encode, host    bitwise %6.1f ns/LED   nibble table %6.1f ns/LED   %.1fx\n", bitwise, nibbles, bitwise / nibbles );
+
+        //what loop() waits for. FastLED holds the core for the whole strip;
+        //the DMA driver's show() copies the pixels and encodes the first two
+        //halves, then each interrupt encodes LedsPerHalf more.
+        std::vector<uint8_t> sending( pixels.size() );
+        uint8_t ring[Ws2812Stream::RingSize];
+        Ws2812Stream stream;
+        uint64_t begin = Sim::Probe::hostNanos();
+        for( unsigned long i=0; i<iterations; i++ )
+        {
+                memcpy( sending.data(), pixels.data(), pixels.size() );
+                stream.start( sending.data(), leds, ring );
+        }
+        const double showNanos = (double)(Sim::Probe::hostNanos() - begin) / iterations;
+
+        unsigned long refills = 0;
+        stream.start( pixels.data(), leds, ring );
+        begin = Sim::Probe::hostNanos();
+        for( unsigned long i=0; i<iterations; i++ )
+        {
+                refills++;
+                if( !stream.refill(&ring[(i & 1) * Ws2812Stream::HalfSize]) )
+                {
+                        stream.start( pixels.data(), leds, ring );
+                }
+        }
+        const double refillNanos = (double)(Sim::Probe::hostNanos() - begin) / refills;
+
+        printf( "  %u LEDs, blocking   show() %8.0f us on the AVR\n", leds, leds * 30.0 + 50 );
+        printf( "  %u LEDs, DMA        show() %8.3f us host, then an interrupt every %.0f us of %.3f us host\n",
+                leds, showNanos / 1000, Ws2812Stream::HalfSize * 8 * SPI_BIT_NS / 1000, refillNanos / 1000 );
+        return ok ? 0 : 1;
+}
@@ -33,7 +33,15 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #if defined( IS_NANO_BUILD  )
     #define LEDPIN 2
     #define DOORPIN 9
+    #define GAS_SENSORS 1
 #elif defined( IS_BLUEPILL_BUILD )
     #define LEDPIN PA7
     #define DOORPIN PB12
-#endif //
\ No newline at end of file
+    #define GAS_SENSORS 2
+    #define SLAVE_ADDRESS 0x40
+#elif defined( IS_NATIVE_BUILD )
+    #define LEDPIN 2
+    #define DOORPIN 9
+    #define GAS_SENSORS 2
+    #define SLAVE_ADDRESS 0x40
+#endif //
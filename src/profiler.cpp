@@ -0,0 +1,158 @@
+/*------------------------------------------------------------------------------
+    ()      File: profiler.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Per-job timing counters and latency histograms.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include "profiler.h"
+#include "hal.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+#if defined(PROFILING)
+PROFILER_STORAGE ProfileStats Profiler::s_jobs[Profiler::MaxJobs];
+PROFILER_STORAGE uint8_t Profiler::s_jobCount = 0;
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// ProfileStats
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void ProfileStats::record( uint32_t micros )
+{
+        if( totalMicros > 0xFFFFFFFFUL - micros )
+        {
+                totalMicros /= 2;
+                count /= 2;
+        }
+
+        count++;
+        totalMicros += micros;
+        if( micros > maxMicros )
+        {
+                maxMicros = micros;
+        }
+
+        uint16_t & counter = buckets[bucket(micros)];
+        if( counter == 0xFFFF )
+        {
+                for( uint8_t i=0; i<Buckets; i++ )
+                {
+                        buckets[i] /= 2;
+                }
+        }
+        counter++;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint8_t ProfileStats::bucket( uint32_t micros )
+{
+        uint8_t index = 0;
+        for( micros >>= 3; micros != 0 && index < Buckets - 1; micros >>= 1 )
+        {
+                index++;
+        }
+        return index;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint32_t ProfileStats::bucketFloorMicros( uint8_t bucket )
+{
+        return bucket == 0 ? 0 : 8UL << (bucket - 1);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Profiler
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Profiler::begin()
+{
+        Hal::profileClockBegin();
+}
+
+//------------------------------------------------------------------------------
+// Keeps the jobs, so their order and indices stay put for a reader.
+//------------------------------------------------------------------------------
+void Profiler::reset()
+{
+        for( uint8_t job=0; job<s_jobCount; job++ )
+        {
+                const char * name = s_jobs[job].name;
+                s_jobs[job] = ProfileStats();
+                s_jobs[job].name = name;
+        }
+}
+
+//------------------------------------------------------------------------------
+// Jobs past MaxJobs are not timed.
+//------------------------------------------------------------------------------
+ProfileStats * Profiler::find( const char * name )
+{
+        for( uint8_t job=0; job<s_jobCount; job++ )
+        {
+                if( s_jobs[job].name == name )
+                {
+                        return &s_jobs[job];
+                }
+        }
+
+        if( s_jobCount == MaxJobs )
+        {
+                return nullptr;
+        }
+        s_jobs[s_jobCount].name = name;
+        return &s_jobs[s_jobCount++];
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+Profiler::Scope::Scope( const char * name )
+        : m_stats( find(name) )
+        , m_begin( Hal::profileTicks() )
+{
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+Profiler::Scope::~Scope()
+{
+        if( m_stats != nullptr )
+        {
+                m_stats->record( Hal::profileTicksToMicros(Hal::profileTicks() - m_begin) );
+        }
+}
+#endif //defined(PROFILING)
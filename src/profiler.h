@@ -0,0 +1,101 @@
+/*------------------------------------------------------------------------------
+    ()      File: profiler.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Per-job timing counters and log bucket latency histograms, fed by
+              the HAL_PROBE scopes when built with PROFILING.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Bucket 0 holds durations under 8us, bucket k those from 8<<(k-1)us up to
+// twice that, and the last bucket everything from 32ms on.
+//
+// Once the total would no longer fit, total and count are both halved, so
+// the mean carries on as an average that slowly favours recent runs. The
+// buckets decay the same way when one fills, keeping their proportions
+// rather than pinning the busiest at 65535.
+//------------------------------------------------------------------------------
+struct ProfileStats
+{
+    static const uint8_t Buckets = 14;
+
+    const char * name = nullptr;
+    uint32_t count = 0;
+    uint32_t totalMicros = 0;
+    uint32_t maxMicros = 0;
+    uint16_t buckets[Buckets] = {};
+
+    void record( uint32_t micros );
+    uint32_t meanMicros() const { return count == 0 ? 0 : totalMicros / count; }
+
+    static uint8_t bucket( uint32_t micros );
+    static uint32_t bucketFloorMicros( uint8_t bucket );
+};
+
+// Native fleets run cabinets on several threads, each keeps its own table.
+#if defined(IS_NATIVE_BUILD)
+#define PROFILER_STORAGE thread_local
+#else
+#define PROFILER_STORAGE
+#endif //defined(IS_NATIVE_BUILD)
+
+//------------------------------------------------------------------------------
+// A fixed table of jobs, each found by name the first time its scope runs.
+// Names are compared by pointer, every HAL_PROBE site passes a literal.
+//------------------------------------------------------------------------------
+class Profiler
+{
+public:
+    static const uint8_t MaxJobs = 8;
+
+    static void begin();
+    static void reset();
+
+    static uint8_t jobs() { return s_jobCount; }
+    static const ProfileStats * stats( uint8_t job ) { return job < s_jobCount ? &s_jobs[job] : nullptr; }
+
+    class Scope
+    {
+    public:
+        explicit Scope( const char * name );
+        ~Scope();
+
+    private:
+        ProfileStats * m_stats;
+        uint32_t m_begin;
+    };
+
+private:
+    static ProfileStats * find( const char * name );
+
+    static PROFILER_STORAGE ProfileStats s_jobs[MaxJobs];
+    static PROFILER_STORAGE uint8_t s_jobCount;
+};
@@ -0,0 +1,136 @@
+/*------------------------------------------------------------------------------
+    ()      File: sampling.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Adaptive BME680 sampling.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <string.h>
+#include "sampling.h"
+#include "hal.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        //------------------------------------------------------------------------------
+        // Fast is the original fixed configuration.
+        //------------------------------------------------------------------------------
+        const AdaptiveSampler::Profile PROFILES[AdaptiveSampler::MAX_MODE] PROGMEM =
+        {
+                {  1, BME680_OS_8X, BME680_OS_2X, BME680_OS_4X },
+                {  3, BME680_OS_4X, BME680_OS_1X, BME680_OS_2X },
+                { 10, BME680_OS_2X, BME680_OS_1X, BME680_OS_1X },
+        };
+
+        bool exceeds( int16_t value, int16_t threshold )
+        {
+                return value > threshold || value < -threshold;
+        }
+}
+
+//------------------------------------------------------------------------------
+// Starts fast, so the history and display fill quickly after power on.
+//------------------------------------------------------------------------------
+void AdaptiveSampler::begin( unsigned long baseInterval, unsigned long now )
+{
+        m_baseInterval = baseInterval;
+        m_mode = Fast;
+        m_calmSince = now;
+        m_havePrevious = false;
+}
+
+//------------------------------------------------------------------------------
+// With adaptation off the sensor stays in Fast, the original behaviour.
+//------------------------------------------------------------------------------
+void AdaptiveSampler::setAdaptive( bool adaptive )
+{
+        m_adaptive = adaptive;
+        m_mode = Fast;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+AdaptiveSampler::Profile AdaptiveSampler::profile() const
+{
+        Profile profile;
+        memcpy_P( &profile, &PROFILES[m_mode], sizeof(profile) );
+        return profile;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool AdaptiveSampler::wake( unsigned long now )
+{
+        return enter( Fast, now );
+}
+
+//------------------------------------------------------------------------------
+// Slopes are only meaningful once the history has two buckets, pass 0 before.
+//------------------------------------------------------------------------------
+bool AdaptiveSampler::update( int16_t deciDegrees, int16_t airQualityPermille,
+                              int16_t deciDegreesPerMinute, int16_t permillePerMinute, unsigned long now )
+{
+        m_readings[m_mode]++;
+
+        const bool stepped = m_havePrevious
+                && ( exceeds(deciDegrees - m_previousDeciDegrees, StepDeciDegrees)
+                  || exceeds(airQualityPermille - m_previousPermille, StepPermille) );
+        const bool sloped = exceeds( deciDegreesPerMinute, SlopeDeciDegrees )
+                         || exceeds( permillePerMinute, SlopePermille );
+
+        m_havePrevious = true;
+        m_previousDeciDegrees = deciDegrees;
+        m_previousPermille = airQualityPermille;
+
+        if( stepped || sloped )
+        {
+                return enter( Fast, now );
+        }
+
+        if( m_mode + 1 < MAX_MODE && (now - m_calmSince) >= CalmMs )
+        {
+                return enter( (Mode)(m_mode + 1), now );
+        }
+        return false;
+}
+
+//------------------------------------------------------------------------------
+// Entering a mode, even the current one, restarts the calm period.
+//------------------------------------------------------------------------------
+bool AdaptiveSampler::enter( Mode mode, unsigned long now )
+{
+        m_calmSince = now;
+        if( !m_adaptive || mode == m_mode )
+        {
+                return false;
+        }
+
+        m_mode = mode;
+        m_transitions++;
+        return true;
+}
@@ -0,0 +1,99 @@
+/*------------------------------------------------------------------------------
+    ()      File: sampling.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Chooses how often and how finely the BME680 is sampled from how
+              quickly the enclosure is changing.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Three sampling modes. A door event, a jump between consecutive readings or
+// a one minute slope past its threshold puts the sensor straight into Fast.
+// Each CalmMs without any of those steps it down one mode, so a settled
+// enclosure ends up reading every ten base intervals at low oversampling.
+//
+// The heater profile is the same in every mode: a shorter soak shifts the gas
+// resistance the VOC table is calibrated against. The saving comes from
+// running it less often.
+//------------------------------------------------------------------------------
+class AdaptiveSampler
+{
+public:
+    enum Mode : uint8_t { Fast, Steady, Slow, MAX_MODE };
+
+    struct Profile
+    {
+        uint8_t intervalScale;      //multiple of the base interval.
+        uint8_t osTemperature;
+        uint8_t osHumidity;
+        uint8_t osPressure;
+    };
+
+    static const unsigned long CalmMs = 30000;
+
+    // Change between consecutive readings that counts as a disturbance.
+    static const int16_t StepDeciDegrees = 5;
+    static const int16_t StepPermille = 30;
+
+    // One minute slopes that count as a disturbance.
+    static const int16_t SlopeDeciDegrees = 5;
+    static const int16_t SlopePermille = 60;
+
+    void begin( unsigned long baseInterval, unsigned long now );
+    void setBaseInterval( unsigned long baseInterval ) { m_baseInterval = baseInterval; }
+    void setAdaptive( bool adaptive );
+
+    // Each returns true when the mode changed and the profile must be reapplied.
+    bool wake( unsigned long now );
+    bool update( int16_t deciDegrees, int16_t airQualityPermille,
+                 int16_t deciDegreesPerMinute, int16_t permillePerMinute, unsigned long now );
+
+    Mode mode() const { return m_mode; }
+    Profile profile() const;
+    unsigned long interval() const { return m_baseInterval * profile().intervalScale; }
+
+    unsigned long readings( Mode mode ) const { return m_readings[mode]; }
+    unsigned long transitions() const { return m_transitions; }
+
+private:
+    bool enter( Mode mode, unsigned long now );
+
+    Mode m_mode = Fast;
+    bool m_adaptive = true;
+    bool m_havePrevious = false;
+    int16_t m_previousDeciDegrees = 0;
+    int16_t m_previousPermille = 0;
+    unsigned long m_baseInterval = 1000;
+    unsigned long m_calmSince = 0;
+
+    unsigned long m_readings[MAX_MODE] = {};
+    unsigned long m_transitions = 0;
+};
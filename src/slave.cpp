@@ -0,0 +1,144 @@
+/*------------------------------------------------------------------------------
+    ()      File: slave.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Register map served to a master on the global bus.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include "slave.h"
+#include "hal.h"
+#include "utility.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+SlaveRegisters::SlaveRegisters()
+{
+        memset( m_maps, 0, sizeof(m_maps) );
+        memset( &m_written, 0, sizeof(m_written) );
+        for( uint8_t i=0; i<2; i++ )
+        {
+                m_maps[i].version = RegisterMap::Version;
+                m_maps[i].size = sizeof(RegisterMap);
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+RegisterMap & SlaveRegisters::edit()
+{
+        RegisterMap & back = m_maps[m_front ^ 1];
+        back = m_maps[m_front];
+        return back;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void SlaveRegisters::publish()
+{
+        RegisterMap & back = m_maps[m_front ^ 1];
+        back.version = RegisterMap::Version;
+        back.size = sizeof(RegisterMap);
+        back.sequence = m_maps[m_front].sequence + 1;
+        m_front ^= 1;
+}
+
+//------------------------------------------------------------------------------
+// The first byte moves the register pointer, any that follow are written
+// from there. Only the config block and the profile select are writable, the
+// rest is ignored.
+//------------------------------------------------------------------------------
+void SlaveRegisters::received( const uint8_t * data, uint8_t length )
+{
+        if( length == 0 )
+        {
+                return;
+        }
+
+        m_pointer = Min<uint8_t>( data[0], sizeof(RegisterMap) );
+
+        uint8_t * config = reinterpret_cast<uint8_t *>( &m_written );
+        for( uint8_t i=1; i<length; i++ )
+        {
+                const uint8_t reg = data[0] + i - 1;
+                if( reg >= RegisterMap::Reg_Config && reg < RegisterMap::Reg_Config + sizeof(RegisterMap::Config) )
+                {
+                        if( !m_configWritten )
+                        {
+                                m_written = m_maps[m_front].config;
+                                m_configWritten = true;
+                        }
+                        config[reg - RegisterMap::Reg_Config] = data[i];
+                }
+                else if( reg == RegisterMap::Reg_Profile )
+                {
+                        m_profileSelect = data[i];
+                        m_profileSelected = true;
+                }
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint8_t SlaveRegisters::requested( uint8_t * out, uint8_t capacity )
+{
+        const uint8_t * front = reinterpret_cast<const uint8_t *>( &m_maps[m_front] );
+        const uint8_t length = Min<uint8_t>( capacity, sizeof(RegisterMap) - m_pointer );
+        memcpy( out, front + m_pointer, length );
+        return length;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool SlaveRegisters::takeConfig( RegisterMap::Config & config )
+{
+        Hal::InterruptGuard guard;
+        if( !m_configWritten )
+        {
+                return false;
+        }
+
+        config = m_written;
+        m_configWritten = false;
+        return true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool SlaveRegisters::takeProfileSelect( uint8_t & select )
+{
+        Hal::InterruptGuard guard;
+        if( !m_profileSelected )
+        {
+                return false;
+        }
+
+        select = m_profileSelect;
+        m_profileSelected = false;
+        return true;
+}
@@ -0,0 +1,182 @@
+/*------------------------------------------------------------------------------
+    ()      File: slave.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Register map served to a master on the global bus.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include <stddef.h>
+#include "profiler.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// The cabinet as a master sees it, little endian and packed:
+//
+//   |0x00 | version, size, snapshot sequence, uptime s             8 bytes  |
+//   |0x08 | readings - centi *C, centi %, Pa, ohms, permille,       16 bytes |
+//   |     |            flags, alert                                         |
+//   |0x18 | temperature ten minute trend, deci *C                   8 bytes  |
+//   |0x20 | air quality ten minute trend, permille                  8 bytes  |
+//   |0x28 | health counters                                         8 bytes  |
+//   |0x30 | config, writable                                        9 bytes  |
+//   |0x39 | idle permille, over the last 10 s                       2 bytes  |
+//   |0x40 | profile of the selected job, select writable           58 bytes  |
+//
+// A master writes a register number, then reads. The first 24 bytes fit one
+// Wire buffer, so the header and latest readings come in a single burst.
+//
+// Writing a job index to 0x40 shows that job's profile from the next
+// snapshot, with bit 7 set the counters are cleared first. The block is
+// zero in builds without PROFILING.
+//------------------------------------------------------------------------------
+struct RegisterMap
+{
+    static const uint8_t Version = 4;
+
+    enum Register : uint8_t
+    {
+        Reg_Header = 0x00,
+        Reg_Readings = 0x08,
+        Reg_TemperatureTrend = 0x18,
+        Reg_AirQualityTrend = 0x20,
+        Reg_Health = 0x28,
+        Reg_Config = 0x30,
+        Reg_Idle = 0x39,
+        Reg_Profile = 0x40,
+    };
+
+    enum ProfileSelect { ProfileSelect_Reset = 0x80 };
+
+    enum Flags { Flag_DoorOpen = 0x1 };
+
+    struct Readings
+    {
+        int16_t temperature;
+        uint16_t humidity;
+        uint32_t pressure;
+        uint32_t gasResistance;
+        uint16_t airQuality;
+        uint8_t flags;
+        uint8_t alert;          //level in the top nibble, rule in the bottom, 0 for none.
+    } __attribute__((packed));
+
+    struct Trend
+    {
+        int16_t min;
+        int16_t max;
+        int16_t mean;
+        int16_t slopePerMinute;
+    } __attribute__((packed));
+
+    struct Health
+    {
+        uint16_t sensorReadings;
+        uint16_t doorEvents;
+        uint16_t busFailures;
+        uint16_t telemetryDropped;
+    } __attribute__((packed));
+
+    struct Config
+    {
+        uint16_t refreshMs;     //fast sampling interval, steady air is read less often.
+        uint8_t brightness;
+        uint8_t openColour[3];
+        uint8_t closedColour[3];
+    } __attribute__((packed));
+
+    struct Profile
+    {
+        uint8_t select;
+        uint8_t jobs;
+        char name[16];              //NUL padded, unterminated at full length.
+        uint32_t count;
+        uint32_t meanMicros;
+        uint32_t maxMicros;
+        uint16_t buckets[ProfileStats::Buckets];
+    } __attribute__((packed));
+
+    uint8_t version;
+    uint8_t size;
+    uint16_t sequence;
+    uint32_t uptime;
+    Readings readings;
+    Trend temperatureTrend;
+    Trend airQualityTrend;
+    Health health;
+    Config config;
+    uint16_t idlePermille;
+    uint8_t reserved[5];
+    Profile profile;
+} __attribute__((packed));
+
+static_assert( offsetof(RegisterMap, readings) == RegisterMap::Reg_Readings, "register map layout" );
+static_assert( offsetof(RegisterMap, temperatureTrend) == RegisterMap::Reg_TemperatureTrend, "register map layout" );
+static_assert( offsetof(RegisterMap, airQualityTrend) == RegisterMap::Reg_AirQualityTrend, "register map layout" );
+static_assert( offsetof(RegisterMap, health) == RegisterMap::Reg_Health, "register map layout" );
+static_assert( offsetof(RegisterMap, config) == RegisterMap::Reg_Config, "register map layout" );
+static_assert( offsetof(RegisterMap, idlePermille) == RegisterMap::Reg_Idle, "register map layout" );
+static_assert( offsetof(RegisterMap, profile) == RegisterMap::Reg_Profile, "register map layout" );
+static_assert( sizeof(RegisterMap) == 0x7A, "register map layout" );
+
+//------------------------------------------------------------------------------
+// Two copies of the map. The slave handlers only ever read the front one; the
+// main loop fills the back one and publish() swaps them with a single byte
+// write, so a request never waits on sensor work and a burst read never sees
+// half of one snapshot and half of the next.
+//
+// The register pointer stays where the master left it, a master after the same
+// block every time sets it once and then polls with bare reads.
+//------------------------------------------------------------------------------
+class SlaveRegisters
+{
+public:
+    SlaveRegisters();
+
+    // The back buffer, holding a copy of what is currently published.
+    RegisterMap & edit();
+    void publish();
+
+    // Slave handlers, interrupt context on hardware.
+    void received( const uint8_t * data, uint8_t length );
+    uint8_t requested( uint8_t * out, uint8_t capacity );
+
+    // Takes config the master has written since the last call.
+    bool takeConfig( RegisterMap::Config & config );
+    bool takeProfileSelect( uint8_t & select );
+
+private:
+    RegisterMap m_maps[2];
+    volatile uint8_t m_front = 0;
+    volatile uint8_t m_pointer = 0;
+
+    RegisterMap::Config m_written;
+    volatile bool m_configWritten = false;
+    volatile uint8_t m_profileSelect = 0;
+    volatile bool m_profileSelected = false;
+};
@@ -0,0 +1,260 @@
+/*------------------------------------------------------------------------------
+    ()      File: telemetry.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Framed binary telemetry over Serial.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include "telemetry.h"
+#include "hal.h"
+#include "utility.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        //------------------------------------------------------------------------------
+        //------------------------------------------------------------------------------
+        uint8_t * put16( uint8_t * out, uint16_t value )
+        {
+                out[0] = (uint8_t)value;
+                out[1] = (uint8_t)(value >> 8);
+                return out + 2;
+        }
+
+        uint8_t * put32( uint8_t * out, uint32_t value )
+        {
+                return put16( put16(out, (uint16_t)value), (uint16_t)(value >> 16) );
+        }
+
+        uint16_t get16( const uint8_t * in )
+        {
+                return (uint16_t)(in[0] | (in[1] << 8));
+        }
+
+        uint32_t get32( const uint8_t * in )
+        {
+                return get16(in) | ((uint32_t)get16(in + 2) << 16);
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// TelemetryCodec
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Bitwise rather than table driven, 512 bytes of table is too much SRAM/flash
+// for one 20 byte packet a second.
+//------------------------------------------------------------------------------
+uint16_t TelemetryCodec::crc16( const uint8_t * data, size_t length )
+{
+        uint16_t crc = 0xFFFF;
+        while( length-- != 0 )
+        {
+                crc ^= (uint16_t)(*data++) << 8;
+                for( uint8_t bit=0; bit<8; bit++ )
+                {
+                        crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+                }
+        }
+        return crc;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+uint8_t TelemetryCodec::encode( const TelemetryPacket & packet, uint8_t * out )
+{
+        uint8_t raw[TelemetryPacket::RawSize];
+        uint8_t * cursor = raw;
+
+        *cursor++ = TelemetryPacket::Version;
+        cursor = put16( cursor, packet.sequence );
+        cursor = put32( cursor, packet.timestamp );
+        cursor = put16( cursor, (uint16_t)packet.temperature );
+        cursor = put16( cursor, packet.humidity );
+        cursor = put32( cursor, packet.pressure );
+        cursor = put32( cursor, packet.gasResistance );
+        *cursor++ = packet.flags;
+        put16( cursor, crc16(raw, TelemetryPacket::PayloadSize) );
+
+        const size_t length = cobsEncode( raw, sizeof(raw), out );
+        out[length] = 0;
+        return (uint8_t)(length + 1);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool TelemetryCodec::decode( const uint8_t * frame, size_t length, TelemetryPacket & packet )
+{
+        uint8_t raw[TelemetryPacket::FrameSize];
+        if( length > sizeof(raw) || cobsDecode(frame, length, raw) != TelemetryPacket::RawSize )
+        {
+                return false;
+        }
+
+        if( raw[0] != TelemetryPacket::Version
+         || get16(&raw[TelemetryPacket::PayloadSize]) != crc16(raw, TelemetryPacket::PayloadSize) )
+        {
+                return false;
+        }
+
+        packet.sequence = get16( &raw[1] );
+        packet.timestamp = get32( &raw[3] );
+        packet.temperature = (int16_t)get16( &raw[7] );
+        packet.humidity = get16( &raw[9] );
+        packet.pressure = get32( &raw[11] );
+        packet.gasResistance = get32( &raw[15] );
+        packet.flags = raw[19];
+        return true;
+}
+
+//------------------------------------------------------------------------------
+// Consistent Overhead Byte Stuffing: each zero is replaced by the distance to
+// the next one, so the encoded frame contains no zeros.
+//------------------------------------------------------------------------------
+size_t TelemetryCodec::cobsEncode( const uint8_t * in, size_t length, uint8_t * out )
+{
+        size_t codeIndex = 0;
+        size_t written = 1;
+        uint8_t code = 1;
+
+        for( size_t i=0; i<length; i++ )
+        {
+                if( in[i] != 0 )
+                {
+                        out[written++] = in[i];
+                        code++;
+                }
+
+                if( in[i] == 0 || code == 0xFF )
+                {
+                        out[codeIndex] = code;
+                        codeIndex = written++;
+                        code = 1;
+                }
+        }
+        out[codeIndex] = code;
+        return written;
+}
+
+//------------------------------------------------------------------------------
+// Returns 0 for malformed input.
+//------------------------------------------------------------------------------
+size_t TelemetryCodec::cobsDecode( const uint8_t * in, size_t length, uint8_t * out )
+{
+        size_t read = 0;
+        size_t written = 0;
+
+        while( read < length )
+        {
+                const uint8_t code = in[read++];
+                if( code == 0 || read + code - 1 > length )
+                {
+                        return 0;
+                }
+
+                for( uint8_t i=1; i<code; i++ )
+                {
+                        out[written++] = in[read++];
+                }
+
+                if( code != 0xFF && read < length )
+                {
+                        out[written++] = 0;
+                }
+        }
+        return written;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// TelemetryStream
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool TelemetryStream::send( TelemetryPacket & packet )
+{
+        packet.sequence = m_sequence++;
+
+        uint8_t frame[TelemetryPacket::FrameSize];
+        const uint8_t length = TelemetryCodec::encode( packet, frame );
+        if( length > QueueSize - m_count )
+        {
+                m_dropped++;
+                return false;
+        }
+
+        for( uint8_t i=0; i<length; i++ )
+        {
+                m_queue[(m_head + m_count + i) % QueueSize] = frame[i];
+        }
+        m_count += length;
+        return true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool TelemetryStream::sendText( const char * text, uint8_t length )
+{
+        if( !roomForText(length) )
+        {
+                return false;
+        }
+
+        for( uint8_t i=0; i<length; i++ )
+        {
+                m_queue[(m_head + m_count + i) % QueueSize] = (uint8_t)text[i];
+        }
+        m_queue[(m_head + m_count + length) % QueueSize] = 0;
+        m_count += length + 1;
+        return true;
+}
+
+//------------------------------------------------------------------------------
+// Writes what the UART can take right now, in at most two contiguous runs.
+//------------------------------------------------------------------------------
+void TelemetryStream::pump()
+{
+        while( m_count != 0 )
+        {
+                const uint8_t room = (uint8_t)Min<int>( Hal::serialAvailableForWrite(), 0xFF );
+                const uint8_t contiguous = Min<uint8_t>( m_count, QueueSize - m_head );
+                const uint8_t length = Min( room, contiguous );
+                if( length == 0 )
+                {
+                        return;
+                }
+
+                Hal::serialWrite( &m_queue[m_head], length );
+                m_head = (m_head + length) % QueueSize;
+                m_count -= length;
+        }
+}
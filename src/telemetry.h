@@ -0,0 +1,134 @@
+/*------------------------------------------------------------------------------
+    ()      File: telemetry.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              Framed binary telemetry over Serial. Packets are CRC checked,
+              COBS framed and drained from a queue without ever blocking.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include <stddef.h>
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+#ifndef TELEMETRY_BAUD
+#define TELEMETRY_BAUD 115200
+#endif //TELEMETRY_BAUD
+
+//------------------------------------------------------------------------------
+// Wire format, all fields little endian:
+//
+//   | 0 | version                  u8   |
+//   | 1 | sequence                 u16  |
+//   | 3 | timestamp, ms            u32  |
+//   | 7 | temperature, centi *C    i16  |
+//   | 9 | humidity, centi %        u16  |
+//   |11 | pressure, Pa             u32  |
+//   |15 | gas resistance, ohms     u32  |
+//   |19 | flags, bit 0 door open   u8   |
+//   |20 | CRC-16/CCITT-FALSE       u16  |  over bytes 0..19
+//
+// The 22 bytes are COBS encoded and terminated by a single zero byte, so a
+// receiver can resynchronise at any delimiter.
+//
+// Console replies share the port as lines of text, each also ended by a zero.
+// A packet's first COBS code is at most 23, so a frame starting with a
+// printable character is text.
+//------------------------------------------------------------------------------
+struct TelemetryPacket
+{
+    static const uint8_t Version = 1;
+    static const uint8_t PayloadSize = 20;
+    static const uint8_t RawSize = PayloadSize + 2;
+    static const uint8_t FrameSize = RawSize + RawSize / 254 + 2;  //COBS overhead + delimiter.
+
+    enum Flags { Flag_DoorOpen = 0x1 };
+
+    uint16_t sequence = 0;
+    uint32_t timestamp = 0;
+    int16_t temperature = 0;
+    uint16_t humidity = 0;
+    uint32_t pressure = 0;
+    uint32_t gasResistance = 0;
+    uint8_t flags = 0;
+};
+
+static_assert( TelemetryPacket::RawSize + 1 < ' ', "a packet's first COBS code must stay below printable text" );
+
+//------------------------------------------------------------------------------
+// Encoding and decoding shared by the firmware and the host tools.
+//------------------------------------------------------------------------------
+struct TelemetryCodec
+{
+    static uint16_t crc16( const uint8_t * data, size_t length );
+
+    // Returns the bytes written to out, at most TelemetryPacket::FrameSize.
+    static uint8_t encode( const TelemetryPacket & packet, uint8_t * out );
+
+    // Decodes one frame without its delimiter. False on a malformed frame,
+    // a bad CRC or an unknown version.
+    static bool decode( const uint8_t * frame, size_t length, TelemetryPacket & packet );
+
+    // Whether a frame, without its delimiter, is a console line.
+    static bool isText( const uint8_t * frame, size_t length ) { return length != 0 && frame[0] >= ' '; }
+
+    static size_t cobsEncode( const uint8_t * in, size_t length, uint8_t * out );
+    static size_t cobsDecode( const uint8_t * in, size_t length, uint8_t * out );
+};
+
+//------------------------------------------------------------------------------
+// Queues whole frames and hands bytes to the UART only as fast as its buffer
+// has room. A frame that does not fit in the queue is dropped and counted,
+// loop() never waits on the serial port.
+//------------------------------------------------------------------------------
+class TelemetryStream
+{
+public:
+    static const uint8_t QueueSize = 64;
+
+    // Stamps the sequence number and queues the packet.
+    bool send( TelemetryPacket & packet );
+
+    // Queues a line of console text and its delimiter. Room for a frame is
+    // kept back so replies never crowd out a packet; false, and not counted,
+    // if the line does not fit beside it.
+    bool sendText( const char * text, uint8_t length );
+    bool roomForText( uint8_t length ) const { return length + 1 + TelemetryPacket::FrameSize <= QueueSize - m_count; }
+
+    void pump();
+
+    bool idle() const { return m_count == 0; }
+    uint16_t sent() const { return m_sequence; }
+    uint16_t dropped() const { return m_dropped; }
+
+private:
+    uint8_t m_queue[QueueSize];
+    uint8_t m_head = 0;
+    uint8_t m_count = 0;
+    uint16_t m_sequence = 0;
+    uint16_t m_dropped = 0;
+};
@@ -30,6 +30,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
+#include "hal.h"
 #include "utility.h"
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
@@ -37,7 +38,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //------------------------------------------------------------------------------
 // BME680 Lookup Table - String defines.
 //------------------------------------------------------------------------------
-const char * VOCTable::_asString[MAX] =
+const char VOCTable::_asString[MAX][8] PROGMEM =
 {
         ENUM_AS_STRING(Good),
         ENUM_AS_STRING(Average),
@@ -48,52 +49,227 @@ const char * VOCTable::_asString[MAX] =
 };
 
 //------------------------------------------------------------------------------
+// A band runs from above its own entry down to the next one's, anything under
+// Severe's still counts as Severe.
 //------------------------------------------------------------------------------
-// Timer
+uint8_t VOCTable::severity( uint32_t resistance, uint8_t previous )
+{
+        uint8_t severity = previous;
+        if( severity >= MAX )
+        {
+                severity = Good;
+                while( severity < Severe && resistance <= _table[severity] )
+                {
+                        severity++;
+                }
+                return severity;
+        }
+
+        while( severity > Good && resistance > _table[severity - 1] + _table[severity - 1] / 32 )
+        {
+                severity--;
+        }
+        while( severity < Severe && resistance <= _table[severity] - _table[severity] / 32 )
+        {
+                severity++;
+        }
+        return severity;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Scheduler
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
+// Periodic tasks are first released one period from now.
+//------------------------------------------------------------------------------
+uint8_t Scheduler::addPeriodic( Task task, void * context, unsigned long period, uint8_t priority, unsigned long now )
+{
+        const uint8_t id = addOneShot( task, context, priority );
+        if( id == InvalidTask )
+        {
+                return InvalidTask;
+        }
+
+        Slot & slot = m_slots[id];
+        slot.period = period;
+        slot.release = now + period;
+        slot.deadline = slot.release;
+        slot.armed = true;
+        return id;
+}
+
+//------------------------------------------------------------------------------
+// One-shot tasks are dormant until given a deadline with runAfter.
+//------------------------------------------------------------------------------
+uint8_t Scheduler::addOneShot( Task task, void * context, uint8_t priority )
+{
+        if( m_count >= MaxTasks || task == nullptr )
+        {
+                return InvalidTask;
+        }
+
+        Slot & slot = m_slots[m_count];
+        slot.task = task;
+        slot.context = context;
+        slot.priority = priority;
+        slot.armed = false;
+        return m_count++;
+}
+
+//------------------------------------------------------------------------------
+// Takes effect from the next release, one new period from now.
+//------------------------------------------------------------------------------
+void Scheduler::setPeriod( uint8_t id, unsigned long period, unsigned long now )
+{
+        if( id >= m_count || m_slots[id].period == 0 || period == 0 )
+        {
+                return;
+        }
+
+        Slot & slot = m_slots[id];
+        slot.period = period;
+        slot.release = now + period;
+}
+
+//------------------------------------------------------------------------------
+// Arms a task, or brings an armed one forward. Never pushes a deadline back.
 //------------------------------------------------------------------------------
-Timer::Timer( unsigned long duration, int& jobs, int jobOnComplete )
-        : m_duration( duration )
-        , m_jobs( jobs )
-        , m_jobOnComplete( jobOnComplete )
-{}
+void Scheduler::runAfter( uint8_t id, unsigned long delay, unsigned long now )
+{
+        if( id >= m_count )
+        {
+                return;
+        }
+
+        Slot & slot = m_slots[id];
+        const unsigned long deadline = now + delay;
+        if( !slot.armed || due( deadline, slot.deadline ) )
+        {
+                slot.deadline = deadline;
+                slot.armed = true;
+        }
+}
 
 //------------------------------------------------------------------------------
+// Only valid from inside a running task, reschedules that task.
 //------------------------------------------------------------------------------
-void Timer::reset( unsigned long time )
+void Scheduler::continueAfter( unsigned long delay )
 {
-        m_beginTime = time;
-        m_alreadyTriggered = false;
+        if( m_current == InvalidTask )
+        {
+                return;
+        }
+
+        m_slots[m_current].deadline = m_now + delay;
+        m_continued = true;
 }
 
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
-bool Timer::tick( unsigned long time )
+void Scheduler::cancel( uint8_t id )
 {
-        //has the time elapsed?
-        if( (time - m_beginTime) < m_duration )
+        if( id < m_count )
         {
-                return false;
+                m_slots[id].armed = false;
         }
+}
 
-        //is the flag not currently set?
-        if( (m_jobs & m_jobOnComplete) != 0 )
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Scheduler::pending( uint8_t id ) const
+{
+        return id < m_count && m_slots[id].armed;
+}
+
+//------------------------------------------------------------------------------
+// Runs every due task once, highest priority first. Work a task schedules
+// for "now" waits for the next call, so one busy task cannot starve loop().
+//------------------------------------------------------------------------------
+void Scheduler::run( unsigned long now )
+{
+        uint16_t ran = 0;
+        m_now = now;
+
+        for(;;)
         {
-                return true;
+                uint8_t next = InvalidTask;
+                for( uint8_t id=0; id<m_count; id++ )
+                {
+                        const Slot & slot = m_slots[id];
+                        if( !slot.armed || (ran & (1u << id)) != 0 || !due( slot.deadline, now ) )
+                        {
+                                continue;
+                        }
+                        if( next == InvalidTask || slot.priority > m_slots[next].priority )
+                        {
+                                next = id;
+                        }
+                }
+
+                if( next == InvalidTask )
+                {
+                        return;
+                }
+
+                Slot & slot = m_slots[next];
+                ran |= (1u << next);
+
+                //a periodic release moves the cadence on, skipping missed periods.
+                if( slot.period != 0 && due( slot.release, now ) )
+                {
+                        slot.release += slot.period;
+                        if( due( slot.release, now ) )
+                        {
+                                slot.release = now + slot.period;
+                        }
+                }
+
+                m_current = next;
+                m_continued = false;
+                slot.armed = false;
+                slot.task( slot.context );
+                m_current = InvalidTask;
+
+                if( m_continued )
+                {
+                        slot.armed = true;
+                }
+                else if( slot.period != 0 )
+                {
+                        slot.deadline = slot.release;
+                        slot.armed = true;
+                }
         }
+}
 
-        //if already triggered, then we are in the reset stage.
-        //if not already triggered, we are in the set stage.
-        if( m_alreadyTriggered )
+//------------------------------------------------------------------------------
+// Milliseconds until the earliest armed task is due, 0 if one is overdue.
+//------------------------------------------------------------------------------
+unsigned long Scheduler::nextDeadline( unsigned long now ) const
+{
+        unsigned long earliest = NoDeadline;
+        for( uint8_t id=0; id<m_count; id++ )
         {
-                reset( time );
-                return true;
+                const Slot & slot = m_slots[id];
+                if( !slot.armed )
+                {
+                        continue;
+                }
+                if( due( slot.deadline, now ) )
+                {
+                        return 0;
+                }
+                earliest = Min( earliest, slot.deadline - now );
         }
+        return earliest;
+}
 
-        m_jobs |= m_jobOnComplete;
-        m_alreadyTriggered = true;
-        return true;
-}
\ No newline at end of file
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+bool Scheduler::due( unsigned long deadline, unsigned long now )
+{
+        return (long)(now - deadline) >= 0;
+}
@@ -31,11 +31,13 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 #include <stdio.h>
+#include <stdint.h>
 #if defined (IS_BLUEPILL_BUILD)
 #include <cstring>
 #else
 #include <string.h>
 #endif //defined(IS_BLUEPILL_BUILD)
+#include "format.h"
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
@@ -64,26 +66,69 @@ struct VOCTable
 {
     enum                                        { Good,     Average,    Subpar,   Bad,      Awful,  Severe,     MAX };
     static constexpr uint32_t _table[MAX] =     { 431331,   213212,     108042,   54586,    27080,  13591 };
-    static const char * _asString[MAX];
+    static const char _asString[MAX][8];       //in flash.
+
+    // Resistance as a rounded fraction of a Good reading, capped at scale.
+    static uint16_t ofGood( uint32_t resistance, uint16_t scale )
+    {
+        if( resistance >= _table[Good] )
+            return scale;
+        return (uint16_t)((resistance * scale + _table[Good] / 2) / _table[Good]);
+    }
+    static uint8_t percentOfGood( uint32_t resistance )         { return (uint8_t)ofGood(resistance, 100); }
+    static uint16_t permilleOfGood( uint32_t resistance )       { return ofGood(resistance, 1000); }
+
+    // The band a reading falls in, moving on from previous only once the
+    // reading is a 32nd past the boundary, so it cannot flap. MAX as previous
+    // starts afresh.
+    static uint8_t severity( uint32_t resistance, uint8_t previous );
 };
 
 //------------------------------------------------------------------------------
-// Helper timer class for periodic tasks.
+// Cooperative scheduler for periodic and one-shot tasks. Statically allocated,
+// deadlines are millis() values compared so that wraparound is harmless.
+// A running task may ask to continue after N ms instead of calling delay(),
+// a periodic task falls back to its period once it stops continuing.
 //------------------------------------------------------------------------------
-class Timer
+class Scheduler
 {
 public:
-    Timer( unsigned long duration, int& jobs, int jobOnComplete );
-    void reset( unsigned long time );
-    bool tick( unsigned long time );
-
- private:
-    unsigned long m_beginTime = 0;
-    unsigned long m_duration = 0;
-    
-    int& m_jobs;
-    int m_jobOnComplete = 0;
-    bool m_alreadyTriggered = false;
+    using Task = void (*)( void * context );
+
+    static const uint8_t MaxTasks = 4;          //the cabinet's sensor, lights, summary and alert tasks.
+    static const uint8_t InvalidTask = 0xFF;
+    static const unsigned long NoDeadline = 0xFFFFFFFFUL;
+
+    uint8_t addPeriodic( Task task, void * context, unsigned long period, uint8_t priority, unsigned long now );
+    uint8_t addOneShot( Task task, void * context, uint8_t priority );
+
+    void setPeriod( uint8_t id, unsigned long period, unsigned long now );
+    void runAfter( uint8_t id, unsigned long delay, unsigned long now );
+    void continueAfter( unsigned long delay );
+    void cancel( uint8_t id );
+    bool pending( uint8_t id ) const;
+
+    void run( unsigned long now );
+    unsigned long nextDeadline( unsigned long now ) const;
+
+private:
+    static bool due( unsigned long deadline, unsigned long now );
+
+    struct Slot
+    {
+        Task task = nullptr;
+        void * context = nullptr;
+        unsigned long period = 0;       //0 for one-shot tasks.
+        unsigned long deadline = 0;
+        unsigned long release = 0;      //next periodic release.
+        uint8_t priority = 0;
+        bool armed = false;
+    } m_slots[MaxTasks];
+
+    uint8_t m_count = 0;
+    uint8_t m_current = InvalidTask;
+    bool m_continued = false;
+    unsigned long m_now = 0;
 };
 
 //------------------------------------------------------------------------------
@@ -92,57 +137,160 @@ public:
 struct EnvironmentInfo
 {
     float temperature = 0.0f;
+    float humidity = 0.0f;
+    uint32_t pressure = 0;
     float voc = 0.0f;
     bool doorOpen = false;
 };
 
+//------------------------------------------------------------------------------
+// Display Layout - one entry per field, columns inclusive. A layout is a type
+// providing Width, Height, Count and a constexpr fields[Count], checked when
+// the Display using it is instantiated.
+//------------------------------------------------------------------------------
+struct DisplayField
+{
+    enum Align : uint8_t { Left, Right };
+
+    uint8_t line;
+    uint8_t begin;
+    uint8_t end;
+    Align align;
+
+    constexpr uint8_t length() const { return end - begin + 1; }
+};
+
+namespace DisplayLayout
+{
+    constexpr bool inBounds( const DisplayField * fields, uint8_t count, uint8_t width, uint8_t height )
+    {
+        return count == 0
+            || ( fields[0].line < height && fields[0].begin <= fields[0].end && fields[0].end < width
+              && inBounds(fields + 1, count - 1, width, height) );
+    }
+
+    constexpr bool overlap( const DisplayField & a, const DisplayField & b )
+    {
+        return a.line == b.line && a.begin <= b.end && b.begin <= a.end;
+    }
+
+    constexpr bool overlapsAny( const DisplayField & field, const DisplayField * others, uint8_t count )
+    {
+        return count != 0 && ( overlap(field, others[0]) || overlapsAny(field, others + 1, count - 1) );
+    }
+
+    constexpr bool disjoint( const DisplayField * fields, uint8_t count )
+    {
+        return count == 0 || ( !overlapsAny(fields[0], fields + 1, count - 1) && disjoint(fields + 1, count - 1) );
+    }
+}
+
 //------------------------------------------------------------------------------
 // Display Helper
 //------------------------------------------------------------------------------
-//nb, do I _really_ need this to be a template? What other displays are you possible
-//expecting.. not fond of this whole thing being in a header.
+// Fields are addressed by compile time id, so every offset and length is a
+// constant and no range table is kept in SRAM.
 //------------------------------------------------------------------------------
-template<uint8_t Width, uint8_t Height, uint8_t MaxReserved = 2>
+template<typename Layout>
 class Display
 {
 public:
-    using callback = void (*)(const char*, int,int);
+    static const uint8_t Width = Layout::Width;
+    static const uint8_t Height = Layout::Height;
+
+    static_assert( DisplayLayout::inBounds(Layout::fields, Layout::Count, Width, Height), "display field outside the panel" );
+    static_assert( DisplayLayout::disjoint(Layout::fields, Layout::Count), "display fields overlap" );
+
+    // Receives each run of characters that differs from what the panel shows.
+    using callback = void (*)(void* context, const char* run, uint8_t line, uint8_t column, uint8_t length);
+
+    // Unchanged gaps up to this size are resent rather than split into two
+    // runs, a cursor move costs about as much as a character.
+    static const uint8_t MergeGap = 1;
 
 public:
-    Display( callback writeCbk )
+    Display( callback writeCbk, void* context )
         : m_drawFunction( writeCbk )
+        , m_context( context )
     {
-        memset( &m_state[0], '\0', Height*(Width+1) -1 );
+        memset( &m_state[0], '\0', sizeof(m_state) );
         clear();
+        invalidate();
     }
 
-    void reserve( uint8_t id, uint8_t line, uint8_t begin_inclusive, uint8_t end_inclusive )
+    // Text up to the field's length, placed by the field's alignment.
+    template<uint8_t Id>
+    void update( const char * str )
     {
-        if( id >= MaxReserved )
-           return;
+        constexpr DisplayField f = Layout::fields[Id];
+        FieldWriter writer = field<Id>();
+        if( f.align == DisplayField::Right )
+        {
+            uint8_t length = 0;
+            while( length < f.length() && str[length] != '\0' )
+            {
+                length++;
+            }
+            writer = FieldWriter( &(m_state[f.line][f.end + 1 - length]), length );
+        }
+        writer.text( str );
+    }
 
-        m_ranges[id].line = line;
-        m_ranges[id].begin = begin_inclusive;
-        m_ranges[id].end = end_inclusive;
+    // Blanks a field and returns a writer over it, for formatting straight
+    // into the display buffer.
+    template<uint8_t Id>
+    FieldWriter field()
+    {
+        static_assert( Id < Layout::Count, "no such display field" );
+        constexpr DisplayField f = Layout::fields[Id];
+
+        memset( &(m_state[f.line][f.begin]), ' ', f.length() );
+        return FieldWriter( &(m_state[f.line][f.begin]), f.length() );
     }
 
-    void update( uint8_t id, const char * str )
+    // Sends only the runs that changed since the last draw, the panel is
+    // never cleared.
+    void draw()
     {
-        const uint8_t line = m_ranges[id].line;
-        const uint8_t begin = m_ranges[id].begin;
-        const uint8_t end = m_ranges[id].end;
+        for(uint8_t line=0; line < Height; line++)
+        {
+            const char * state = m_state[line];
+            char * shadow = m_shadow[line];
+
+            uint8_t column = 0;
+            while( column < Width )
+            {
+                if( state[column] == shadow[column] )
+                {
+                    column++;
+                    continue;
+                }
 
-        const int range = end-begin+1;
-        const uint8_t size = Min(range, (int)strlen(str));
+                const uint8_t begin = column;
+                uint8_t end = column;
+                for( column++; column < Width; column++ )
+                {
+                    if( state[column] != shadow[column] )
+                    {
+                        end = column;
+                    }
+                    else if( column - end > MergeGap )
+                    {
+                        break;
+                    }
+                }
 
-        //fill
-        memset(&(m_state[line][begin]), ' ', range );
-        strncpy(&(m_state[line][begin]), str, size );
+                const uint8_t length = end - begin + 1;
+                m_drawFunction(m_context, &state[begin], line, begin, length);
+                memcpy(&shadow[begin], &state[begin], length);
+            }
+        }
     }
 
-    void draw()
+    // Forget what the panel shows, so the next draw sends every cell.
+    void invalidate()
     {
-        m_drawFunction(&m_state[0][0], Width, Height);
+        memset( &m_shadow[0], '\0', sizeof(m_shadow) );
     }
 
     void clear()
@@ -153,14 +301,12 @@ public:
         }
     }
 
-private:
-  struct Range 
-  { 
-      uint8_t line = 0;
-      uint8_t begin =0;
-      uint8_t end =0;
-  } m_ranges[MaxReserved];
+    // A terminated line of the buffer, as the next draw will show it.
+    const char * text( uint8_t line ) const { return m_state[line]; }
 
+private:
   callback m_drawFunction;
+  void* m_context;
   char m_state[Height][Width+1];
+  char m_shadow[Height][Width];
 };
@@ -0,0 +1,111 @@
+/*------------------------------------------------------------------------------
+    ()      File: ws2812.cpp
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              WS2812 pulse encoding for an SPI data line.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <string.h>
+#include "ws2812.h"
+#include "hal.h"
+#include "utility.h"
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace
+{
+        //------------------------------------------------------------------------------
+        // The twelve SPI bits for each nibble, most significant bit first. Two
+        // lookups per colour byte against 32 bytes of flash; a table by the whole
+        // byte would be 768.
+        //------------------------------------------------------------------------------
+        const uint16_t NIBBLE_PULSES[16] PROGMEM =
+        {
+                0x924, 0x926, 0x934, 0x936, 0x9A4, 0x9A6, 0x9B4, 0x9B6,
+                0xD24, 0xD26, 0xD34, 0xD36, 0xDA4, 0xDA6, 0xDB4, 0xDB6,
+        };
+
+        uint16_t pulses( uint8_t nibble )
+        {
+                return pgm_read_word( &NIBBLE_PULSES[nibble] );
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Ws2812Stream::encode( const uint8_t * colours, uint16_t count, uint8_t * out )
+{
+        while( count-- != 0 )
+        {
+                const uint8_t colour = *colours++;
+                const uint32_t bits = ((uint32_t)pulses( colour >> 4 ) << 12) | pulses( colour & 0xF );
+                *out++ = (uint8_t)(bits >> 16);
+                *out++ = (uint8_t)(bits >> 8);
+                *out++ = (uint8_t)bits;
+        }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+void Ws2812Stream::start( const uint8_t * pixels, uint16_t leds, uint8_t * ring )
+{
+        m_pixels = pixels;
+        m_colours = leds * 3;
+        m_queued = 0;
+        m_sent = 0;
+        m_total = frameBytes( leds );
+        fill( ring );
+        fill( ring + HalfSize );
+}
+
+//------------------------------------------------------------------------------
+// The half after this one is already going out. When everything up to it has
+// been sent it can only hold latch zeros, so stopping part way through it is
+// harmless.
+//------------------------------------------------------------------------------
+bool Ws2812Stream::refill( uint8_t * half )
+{
+        m_sent += HalfSize;
+        if( m_sent >= m_total )
+        {
+                return false;
+        }
+        fill( half );
+        return true;
+}
+
+//------------------------------------------------------------------------------
+// Halves hold whole colour bytes, so a half starts on one.
+//------------------------------------------------------------------------------
+void Ws2812Stream::fill( uint8_t * half )
+{
+        const uint16_t first = (uint16_t)Min<uint32_t>( m_queued / BytesPerColour, m_colours );
+        const uint16_t count = Min<uint16_t>( m_colours - first, HalfSize / BytesPerColour );
+        encode( m_pixels + first, count, half );
+        memset( half + count * BytesPerColour, 0, HalfSize - count * BytesPerColour );
+        m_queued += HalfSize;
+}
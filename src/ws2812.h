@@ -0,0 +1,82 @@
+/*------------------------------------------------------------------------------
+    ()      File: ws2812.h
+    /\      Copyright (c) 2020 Andrew Woodward-May - See legal.txt
+   //\\
+  //  \\    Description:
+              WS2812 pulse encoding for an SPI data line, streamed through a small
+              ring that is refilled as each half goes out.
+------------------------------
+------------------------------
+License Text - The MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------*/
+#pragma once
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdint.h>
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Each WS2812 bit becomes three SPI bits at 2.25MHz, 100 for a zero and 110
+// for a one: 444ns or 889ns high in a 1.33us bit. A colour byte is three SPI
+// bytes, an LED nine.
+//
+// A whole strip would need nine bytes of encoded buffer per LED, so only a
+// ring of two halves is kept. The transfer runs round the ring and each time
+// a half has gone out refill() encodes the next LEDs into it, which keeps the
+// work per interrupt the same however long the strip. Once the pixels are
+// sent the ring is filled with zeros until the line has been low for the
+// latch, then refill() says to stop.
+//------------------------------------------------------------------------------
+class Ws2812Stream
+{
+public:
+    static const uint32_t SpiHz = 2250000;
+    static const uint8_t SpiBitsPerBit = 3;
+    static const uint8_t BytesPerColour = SpiBitsPerBit;
+    static const uint8_t LedsPerHalf = 8;
+    static const uint8_t HalfSize = LedsPerHalf * 3 * BytesPerColour;
+    static const uint16_t RingSize = 2 * HalfSize;
+    static const uint16_t LatchBytes = 80;                   //285us low, the newer parts need 280.
+
+    // Encodes colour bytes, already in wire order, three SPI bytes each.
+    static void encode( const uint8_t * colours, uint16_t count, uint8_t * out );
+
+    // Fills both halves of the ring for a frame of leds pixels, three wire
+    // order bytes each. The pixels must stay put until the frame is done.
+    void start( const uint8_t * pixels, uint16_t leds, uint8_t * ring );
+
+    // Called each time a half has been sent, with that half. False once the
+    // frame and its latch are out and the transfer should stop.
+    bool refill( uint8_t * half );
+
+    // SPI bytes from the start of a frame to the end of its latch.
+    static uint32_t frameBytes( uint16_t leds ) { return (uint32_t)leds * 3 * BytesPerColour + LatchBytes; }
+
+private:
+    void fill( uint8_t * half );
+
+    const uint8_t * m_pixels = nullptr;
+    uint16_t m_colours = 0;
+    uint32_t m_queued = 0;
+    uint32_t m_sent = 0;
+    uint32_t m_total = 0;
+};